@@ -0,0 +1,1004 @@
+// bench_cps.cpp
+//
+// Generation throughput benchmarks. Configure with
+// -DCMAKE_BUILD_TYPE=Release for meaningful numbers.
+//
+// Usage: bench_cps [--json] [--threads N] [filter]
+//   --json       print results as a JSON array instead of a table
+//   --threads N  largest pool the parallel benchmarks use (default: one
+//                per hardware thread)
+//   filter       only run benchmarks whose name contains this text
+//
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+using std::string;
+using std::vector;
+
+#include "../cps/cps.hpp"
+using namespace cps;
+
+// Every allocation in the process goes through here so each benchmark can
+// report allocations per node.
+namespace
+{
+    std::atomic<std::size_t> allocations{0};
+}
+
+void *operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto memory = std::malloc(size == 0 ? 1 : size))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+// std::pmr::new_delete_resource allocates through the aligned overloads.
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    auto align = static_cast<std::size_t>(alignment);
+    if (auto memory = std::aligned_alloc(align, (size + align - 1) / align * align))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *memory, std::align_val_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t, std::align_val_t) noexcept
+{
+    std::free(memory);
+}
+
+namespace
+{
+
+    struct Measurement
+    {
+        double seconds;
+        std::size_t allocations;
+    };
+
+    struct Result
+    {
+        string name;
+        std::size_t nodes;
+        std::size_t bytes;
+        Measurement measurement;
+    };
+
+    bool json = false;
+    const char *filter = nullptr;
+    std::size_t maxThreads = 0;
+    vector<Result> results;
+
+    bool selected(const char *name)
+    {
+        return filter == nullptr || std::strstr(name, filter) != nullptr;
+    }
+
+    template<typename Function>
+    Measurement measure(Function function)
+    {
+        auto allocated = allocations.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        function();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return {elapsed.count(), allocations.load(std::memory_order_relaxed) - allocated};
+    }
+
+    void report(const string &name, Measurement measurement, std::size_t nodes, std::size_t bytes)
+    {
+        results.push_back({name, nodes, bytes, measurement});
+        if (json)
+        {
+            return;
+        }
+        std::printf("%-36s %10.2f ns/node %10.1f MB/s %8.3f allocs/node\n", name.c_str(),
+                    measurement.seconds * 1e9 / static_cast<double>(nodes),
+                    static_cast<double>(bytes) / measurement.seconds / 1e6,
+                    static_cast<double>(measurement.allocations) / static_cast<double>(nodes));
+    }
+
+    void writeJson()
+    {
+        std::printf("[\n");
+        for (std::size_t i = 0; i < results.size(); ++i)
+        {
+            auto &result = results[i];
+            auto seconds = result.measurement.seconds;
+            std::printf("  {\"name\": \"%s\", \"nodes\": %zu, \"bytes\": %zu, \"seconds\": %.9f, "
+                        "\"ns_per_node\": %.3f, \"bytes_per_second\": %.1f, \"allocations\": %zu, "
+                        "\"allocations_per_node\": %.6f}%s\n",
+                        result.name.c_str(), result.nodes, result.bytes, seconds,
+                        seconds * 1e9 / static_cast<double>(result.nodes),
+                        static_cast<double>(result.bytes) / seconds,
+                        result.measurement.allocations,
+                        static_cast<double>(result.measurement.allocations) / static_cast<double>(result.nodes),
+                        i + 1 == results.size() ? "" : ",");
+        }
+        std::printf("]\n");
+    }
+
+    // Emits the same shape repeatedly so short outputs are still measurable.
+    void benchmarkShape(const string &name, Shape &shape, std::size_t repetitions)
+    {
+        if (!selected(name.c_str()))
+        {
+            return;
+        }
+        BufferSink sink;
+        auto measurement = measure([&] {
+            for (std::size_t i = 0; i < repetitions; ++i)
+            {
+                shape.emit(sink);
+            }
+        });
+        report(name, measurement, repetitions, sink.str().size());
+    }
+
+    void benchmarkShapes()
+    {
+        const std::size_t repetitions = 200'000;
+
+        Circle circle(10);
+        benchmarkShape("Circle", circle, repetitions);
+        Rectangle rectangle(80, 40);
+        benchmarkShape("Rectangle", rectangle, repetitions);
+        for (auto sides : {3, 4, 8, 64, 1024})
+        {
+            Polygon polygon(sides, 10);
+            benchmarkShape("Polygon " + std::to_string(sides) + " sides", polygon, repetitions);
+        }
+        Rotated rotated(std::make_unique<Rectangle>(80, 40), 90);
+        benchmarkShape("Rotated", rotated, repetitions);
+        Scaled scaled(circle, {2, 0.5});
+        benchmarkShape("Scaled", scaled, repetitions);
+
+        // Skylines report per building; construction and emission are
+        // measured separately since construction generates the buildings.
+        for (auto buildings : {10, 1000, 100'000, 1'000'000})
+        {
+            auto name = "Skyline " + std::to_string(buildings) + " buildings";
+            if (!selected(name.c_str()))
+            {
+                continue;
+            }
+            auto count = static_cast<std::size_t>(buildings);
+            auto repeat = std::max<std::size_t>(1, 1'000'000 / count);
+            std::unique_ptr<Skyline> skyline;
+            auto measurement = measure([&] {
+                for (std::size_t i = 0; i < repeat; ++i)
+                {
+                    skyline = std::make_unique<Skyline>(buildings);
+                }
+            });
+            report(name + " build", measurement, count * repeat, 0);
+
+            BufferSink sink;
+            measurement = measure([&] {
+                for (std::size_t i = 0; i < repeat; ++i)
+                {
+                    skyline->emit(sink);
+                }
+            });
+            report(name + " emit", measurement, count * repeat, sink.str().size());
+        }
+
+        // Dense, overlapping footprints are where the merged outline pays off.
+        if (selected("Skyline outline"))
+        {
+            const std::size_t count = 50'000;
+            Buildings random(count);
+            generateBuildings(372, 0, random, 0, count);
+            vector<Footprint> footprints;
+            auto left = 0.0;
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                footprints.push_back({left, random.widths()[i], random.heights()[i]});
+                left += random.widths()[i] / 2;
+            }
+            Skyline skyline(footprints);
+
+            BufferSink buildings;
+            auto measurement = measure([&] { skyline.emit(buildings); });
+            report("Skyline outline off 50000 overlapping", measurement, count, buildings.str().size());
+
+            skyline.set_outline(true);
+            BufferSink outline;
+            measurement = measure([&] { skyline.emit(outline); });
+            report("Skyline outline on 50000 overlapping", measurement, count, outline.str().size());
+            if (!json)
+            {
+                std::printf("%-36s %10zu -> %zu bytes\n", "Skyline outline size", buildings.str().size(),
+                            outline.str().size());
+            }
+        }
+
+        if (selected("Skyline bulk generate"))
+        {
+            const std::size_t count = 10'000'000;
+            Buildings buildings(count);
+            auto measurement = measure([&] { generateBuildings(372, 0, buildings, 0, count); });
+            report("Skyline bulk generate", measurement, count, count * sizeof(Building));
+
+            auto size = std::make_pair(0.0, 0.0);
+            measurement = measure([&] { size = skylineSize(buildings.columns()); });
+            report("Skyline bulk measure", measurement, count, count * sizeof(Building));
+        }
+    }
+
+    // A complete tree of the given breadth and depth with Circle leaves.
+    template<typename Compound>
+    Shape::Shape_ptr compoundTree(int breadth, int depth, std::size_t &nodes)
+    {
+        ++nodes;
+        if (depth == 0)
+        {
+            return std::make_unique<Circle>(5);
+        }
+        auto compound = std::make_unique<Compound>();
+        for (auto child = 0; child < breadth; ++child)
+        {
+            compound->pushShape(compoundTree<Compound>(breadth, depth - 1, nodes));
+        }
+        return compound;
+    }
+
+    template<typename Compound>
+    void benchmarkCompound(const char *kind)
+    {
+        const std::pair<int, int> shapes[] = {{1000, 1}, {100'000, 1}, {100, 2}, {1000, 2}, {10, 5}, {2, 17}};
+        for (auto[breadth, depth] : shapes)
+        {
+            auto name = string(kind) + " breadth " + std::to_string(breadth) + " depth " + std::to_string(depth);
+            if (!selected(name.c_str()))
+            {
+                continue;
+            }
+            // Small trees are rebuilt until about a million nodes have been
+            // measured so they are not dominated by timer and cache noise.
+            std::size_t nodes = 0;
+            vector<Shape::Shape_ptr> trees;
+            auto measurement = measure([&] {
+                do
+                {
+                    trees.push_back(compoundTree<Compound>(breadth, depth, nodes));
+                    trees.back()->get_width();
+                    trees.back()->get_height();
+                } while (nodes < 1'000'000);
+            });
+            report(name + " build", measurement, nodes, 0);
+
+            BufferSink sink;
+            measurement = measure([&] {
+                for (auto &tree : trees)
+                {
+                    tree->emit(sink);
+                }
+            });
+            report(name + " emit", measurement, nodes, sink.str().size());
+        }
+    }
+
+    void benchmarkCompounds()
+    {
+        benchmarkCompound<HorizontalShapes>("Horizontal");
+        benchmarkCompound<VerticalShapes>("Vertical");
+        benchmarkCompound<LayeredShapes>("Layered");
+    }
+
+    void benchmarkNumberFormatting()
+    {
+        if (!selected("number formatting"))
+        {
+            return;
+        }
+        const std::size_t count = 4'000'000;
+        std::mt19937 generator(372);
+        std::uniform_real_distribution<> coordinate(-1000, 1000);
+        vector<double> values(count);
+        for (auto &value : values)
+        {
+            value = coordinate(generator);
+        }
+
+        string viaToString;
+        auto measurement = measure([&] {
+            for (auto value : values)
+            {
+                viaToString += std::to_string(value);
+                viaToString += ' ';
+            }
+        });
+        report("number formatting std::to_string", measurement, count, viaToString.size());
+
+        BufferSink fixed;
+        measurement = measure([&] {
+            for (auto value : values)
+            {
+                fixed << value << ' ';
+            }
+        });
+        report("number formatting Sink fixed", measurement, count, fixed.str().size());
+
+        BufferSink shortest;
+        shortest.set_numberFormat(NumberFormat::Shortest);
+        measurement = measure([&] {
+            for (auto value : values)
+            {
+                shortest << value << ' ';
+            }
+        });
+        report("number formatting Sink shortest", measurement, count, shortest.str().size());
+    }
+
+    Shape::Shape_ptr nestedScene(int depth)
+    {
+        Shape::Shape_ptr scene = std::make_unique<Circle>(1);
+        for (auto level = 0; level < depth; ++level)
+        {
+            vector<Shape::Shape_ptr> shapes;
+            shapes.push_back(std::move(scene));
+            shapes.push_back(std::make_unique<Circle>(1));
+            scene = std::make_unique<VerticalShapes>(std::move(shapes));
+        }
+        return scene;
+    }
+
+    // Time per level should stay flat as depth grows.
+    void benchmarkNestedFragments()
+    {
+        if (!selected("nested"))
+        {
+            return;
+        }
+        for (auto depth : {1250, 2500, 5000, 10000})
+        {
+            auto scene = nestedScene(depth);
+            auto levels = static_cast<std::size_t>(depth);
+
+            BufferSink flattened;
+            auto measurement = measure([&] { scene->fragment().writeTo(flattened); });
+            report("rope nested depth " + std::to_string(depth), measurement, levels, flattened.str().size());
+
+            BufferSink streamed;
+            measurement = measure([&] { scene->emit(streamed); });
+            report("emit nested depth " + std::to_string(depth), measurement, levels, streamed.str().size());
+        }
+    }
+
+    Shape::Shape_ptr gridScene(int rows, int columns)
+    {
+        auto grid = std::make_unique<HorizontalShapes>();
+        for (auto column = 0; column < columns; ++column)
+        {
+            auto stack = std::make_unique<VerticalShapes>();
+            for (auto row = 0; row < rows; ++row)
+            {
+                if ((row + column) % 2 == 0)
+                {
+                    stack->pushShape(std::make_unique<Rectangle>(10, 10));
+                }
+                else
+                {
+                    stack->pushShape(std::make_unique<Circle>(5));
+                }
+            }
+            grid->pushShape(std::move(stack));
+        }
+        return grid;
+    }
+
+    void benchmarkPeephole()
+    {
+        if (!selected("grid emit"))
+        {
+            return;
+        }
+        auto scene = gridScene(300, 300);
+        const auto nodes = std::size_t(300 * 300);
+
+        BufferSink plain;
+        auto measurement = measure([&] { scene->emit(plain); });
+        report("grid emit", measurement, nodes, plain.str().size());
+
+        BufferSink optimized;
+        measurement = measure([&] {
+            PeepholeSink peephole(optimized);
+            scene->emit(peephole);
+            peephole.finish();
+        });
+        report("grid emit + peephole", measurement, nodes, optimized.str().size());
+        if (!json)
+        {
+            std::printf("%-36s %10zu -> %zu bytes\n", "grid output size", plain.str().size(), optimized.str().size());
+        }
+    }
+
+    void benchmarkArena()
+    {
+        if (!selected("build/teardown"))
+        {
+            return;
+        }
+        const auto rows = 1000;
+        const auto columns = 1000;
+        const auto nodes = std::size_t(rows * columns);
+
+        auto measurement = measure([&] { gridScene(rows, columns); });
+        report("1M-node build/teardown heap", measurement, nodes, 0);
+
+        measurement = measure([&] {
+            Arena arena(1 << 20);
+            Shape::Shape_ptr scene;
+            {
+                ArenaScope scope(arena);
+                scene = gridScene(rows, columns);
+            }
+        });
+        report("1M-node build/teardown arena", measurement, nodes, 0);
+    }
+
+    flat::NodeId flatGridScene(flat::Scene &scene, int rows, int columns)
+    {
+        vector<flat::NodeId> stacks;
+        vector<flat::NodeId> stack;
+        for (auto column = 0; column < columns; ++column)
+        {
+            stack.clear();
+            for (auto row = 0; row < rows; ++row)
+            {
+                stack.push_back((row + column) % 2 == 0 ? scene.rectangle(10, 10) : scene.circle(5));
+            }
+            stacks.push_back(scene.vertical(stack));
+        }
+        return scene.horizontal(stacks);
+    }
+
+    void benchmarkFlatScene()
+    {
+        if (!selected("1M-node"))
+        {
+            return;
+        }
+        const auto rows = 1000;
+        const auto columns = 1000;
+        const auto nodes = std::size_t(rows * columns);
+
+        Shape::Shape_ptr hierarchy;
+        auto measurement = measure([&] {
+            hierarchy = gridScene(rows, columns);
+            hierarchy->get_width();
+        });
+        report("1M-node build+size hierarchy", measurement, nodes, 0);
+
+        flat::Scene scene;
+        flat::NodeId root{};
+        measurement = measure([&] {
+            scene.reserve(nodes + columns + 1);
+            root = flatGridScene(scene, rows, columns);
+        });
+        report("1M-node build+size flat", measurement, nodes, 0);
+
+        BufferSink plain;
+        measurement = measure([&] { hierarchy->emit(plain); });
+        report("1M-node emit hierarchy", measurement, nodes, plain.str().size());
+
+        BufferSink flattened;
+        measurement = measure([&] { scene.emit(root, flattened); });
+        report("1M-node emit flat", measurement, nodes, flattened.str().size());
+    }
+
+    void benchmarkParallelCompound()
+    {
+        if (!selected("parallel"))
+        {
+            return;
+        }
+        const auto children = 2000;
+        const auto buildings = 500;
+        const auto nodes = std::size_t(children) * buildings;
+        HorizontalShapes row;
+        for (auto child = 0; child < children; ++child)
+        {
+            row.pushShape(std::make_unique<Skyline>(buildings, std::uint64_t(child)));
+        }
+
+        BufferSink sequential;
+        auto measurement = measure([&] { row.emit(sequential); });
+        report("parallel off 2000 skylines", measurement, nodes, sequential.str().size());
+
+        ThreadPool pool(maxThreads);
+        row.set_threadPool(&pool);
+        BufferSink parallel;
+        measurement = measure([&] { row.emit(parallel); });
+        report("parallel on 2000 skylines", measurement, nodes, parallel.str().size());
+        if (!json)
+        {
+            std::printf("%-36s %10zu threads, output %s\n", "parallel", pool.get_numThreads(),
+                        parallel.str() == sequential.str() ? "identical" : "DIFFERS");
+        }
+    }
+
+    // A deliberately lopsided tree: every level pairs a lone circle with a
+    // branch holding the rest of the tree and a heavy column of skylines,
+    // so splitting only at the root would leave most workers idle.
+    Shape::Shape_ptr unbalancedScene(int levels, std::size_t &nodes)
+    {
+        Shape::Shape_ptr tree = std::make_unique<Circle>(1);
+        for (auto level = 0; level < levels; ++level)
+        {
+            auto column = std::make_unique<VerticalShapes>();
+            for (auto row = 0; row < 20 * (level + 1); ++row)
+            {
+                column->pushShape(std::make_unique<Skyline>(50, std::uint64_t(level * 1000 + row)));
+            }
+            auto next = std::make_unique<HorizontalShapes>();
+            next->pushShape(std::make_unique<Circle>(1));
+            next->pushShape(std::move(tree));
+            next->pushShape(std::move(column));
+            tree = std::move(next);
+        }
+        nodes = tree->get_nodeCount();
+        return tree;
+    }
+
+    void benchmarkUnbalanced()
+    {
+        if (!selected("unbalanced"))
+        {
+            return;
+        }
+        std::size_t nodes = 0;
+        auto tree = unbalancedScene(40, nodes);
+        auto root = dynamic_cast<CompoundShape *>(tree.get());
+
+        BufferSink sequential;
+        auto measurement = measure([&] { tree->emit(sequential); });
+        report("unbalanced sequential", measurement, nodes, sequential.str().size());
+        auto baseline = measurement.seconds;
+
+        auto limit = maxThreads != 0 ? maxThreads : std::max(1u, std::thread::hardware_concurrency());
+        for (std::size_t threads = 1; threads <= limit; threads *= 2)
+        {
+            ThreadPool pool(threads);
+            root->set_threadPool(&pool);
+            BufferSink parallel;
+            measurement = measure([&] { tree->emit(parallel); });
+            report("unbalanced " + std::to_string(threads) + " threads", measurement, nodes, parallel.str().size());
+            if (!json)
+            {
+                std::printf("%-36s %10.2fx speedup, output %s\n", "", baseline / measurement.seconds,
+                            parallel.str() == sequential.str() ? "identical" : "DIFFERS");
+            }
+            root->set_threadPool(nullptr);
+        }
+    }
+
+    void benchmarkCulling()
+    {
+        if (!selected("culling"))
+        {
+            return;
+        }
+        // A 100 by 100 grid of small skylines, about 4800 points on a side.
+        auto grid = std::make_unique<VerticalShapes>();
+        for (auto row = 0; row < 100; ++row)
+        {
+            auto line = std::make_unique<HorizontalShapes>();
+            for (auto column = 0; column < 100; ++column)
+            {
+                line->pushShape(std::make_unique<Skyline>(1, std::uint64_t(row * 100 + column)));
+            }
+            grid->pushShape(std::move(line));
+        }
+        auto nodes = grid->get_nodeCount();
+
+        BufferSink full;
+        auto measurement = measure([&] { grid->emit(full); });
+        report("culling whole grid", measurement, nodes, full.str().size());
+
+        auto bounds = grid->get_bounds();
+        for (auto fraction : {1.0, 0.1, 0.01})
+        {
+            auto width = (bounds.right - bounds.left) * fraction;
+            auto height = (bounds.top - bounds.bottom) * fraction;
+            BoundingBox clip{bounds.left, bounds.bottom, bounds.left + width, bounds.bottom + height};
+            BufferSink visible;
+            measurement = measure([&] { grid->emitVisible(visible, clip); });
+            char name[64];
+            std::snprintf(name, sizeof name, "culling %g of each side", fraction);
+            report(name, measurement, nodes, visible.str().size());
+        }
+    }
+
+    void benchmarkSpatialIndex()
+    {
+        if (!selected("spatial"))
+        {
+            return;
+        }
+        // 250000 circles and rectangles in 500 rows, every other row laid
+        // over its neighbour so there are overlaps to find.
+        auto grid = std::make_unique<VerticalShapes>();
+        Circle *grown = nullptr;
+        for (auto row = 0; row < 250; ++row)
+        {
+            auto layers = std::make_unique<LayeredShapes>();
+            for (auto copy = 0; copy < 2; ++copy)
+            {
+                auto line = std::make_unique<HorizontalShapes>();
+                for (auto column = 0; column < 500; ++column)
+                {
+                    if ((row + column + copy) % 2 == 0)
+                    {
+                        auto circle = std::make_unique<Circle>(5 + (column * 7 + row) % 11);
+                        grown = circle.get();
+                        line->pushShape(std::move(circle));
+                    }
+                    else
+                    {
+                        line->pushShape(std::make_unique<Rectangle>(12 + (column * 5 + row) % 9, 20));
+                    }
+                }
+                layers->pushShape(std::make_unique<Spacer>(copy * 7.0, 0));
+                layers->pushShape(std::move(line));
+            }
+            grid->pushShape(std::move(layers));
+        }
+        Layout layout(*grid);
+        auto items = layout.placements().size();
+
+        std::unique_ptr<SpatialIndex> index;
+        auto measurement = measure([&] { index = std::make_unique<SpatialIndex>(layout); });
+        report("spatial build", measurement, items, 0);
+
+        const auto queries = 10000;
+        auto bounds = index->get_bounds();
+        std::mt19937 engine(1);
+        std::uniform_real_distribution<> x(bounds.left, bounds.right);
+        std::uniform_real_distribution<> y(bounds.bottom, bounds.top);
+        std::vector<std::pair<double, double>> points(queries);
+        for (auto &point : points)
+        {
+            point = {x(engine), y(engine)};
+        }
+        std::size_t hits = 0;
+        measurement = measure([&] {
+            for (auto &point : points)
+            {
+                hits += index->query(point.first, point.second).size();
+            }
+        });
+        report("spatial 10000 point queries", measurement, queries, 0);
+
+        // The same points tested against every item, for comparison.
+        measurement = measure([&] {
+            for (auto i = 0; i < 100; ++i)
+            {
+                BoundingBox point{points[i].first, points[i].second, points[i].first, points[i].second};
+                for (std::size_t item = 0; item < items; ++item)
+                {
+                    hits += index->get_bounds(item).intersects(point);
+                }
+            }
+        });
+        report("spatial 100 linear point queries", measurement, 100, 0);
+
+        std::size_t pairs = 0;
+        measurement = measure([&] { pairs = index->overlaps().size(); });
+        report("spatial overlaps", measurement, items, 0);
+
+        grown->set_width(40);
+        measurement = measure([&] { index->refit(Layout(*grid)); });
+        report("spatial layout and refit", measurement, items, 0);
+        if (!json)
+        {
+            std::printf("%-36s %zu items, %zu overlapping pairs, %zu hits\n", "", items, pairs, hits);
+        }
+    }
+
+    void benchmarkLevelOfDetail()
+    {
+        if (!selected("detail"))
+        {
+            return;
+        }
+        // An overview page: 100 dense skylines and 100 fine polygons, each
+        // scaled down to a thumbnail.
+        std::vector<std::unique_ptr<Shape>> originals;
+        auto page = std::make_unique<VerticalShapes>();
+        for (auto row = 0; row < 10; ++row)
+        {
+            auto line = std::make_unique<HorizontalShapes>();
+            for (auto column = 0; column < 20; ++column)
+            {
+                if (column % 2 == 0)
+                {
+                    originals.push_back(std::make_unique<Skyline>(2000, std::uint64_t(row * 20 + column)));
+                }
+                else
+                {
+                    originals.push_back(std::make_unique<Polygon>(360, 2));
+                }
+                auto factor = 20 / originals.back()->get_width();
+                line->pushShape(std::make_unique<Scaled>(*originals.back(), std::make_pair(factor, factor)));
+            }
+            page->pushShape(std::move(line));
+        }
+        auto nodes = page->get_nodeCount();
+
+        for (auto resolution : {0.0, 1200.0, 300.0, 72.0})
+        {
+            BufferSink sink;
+            sink.set_resolution(resolution);
+            auto measurement = measure([&] {
+                sink.clear();
+                page->emit(sink);
+            });
+            char name[64];
+            std::snprintf(name, sizeof name, resolution == 0 ? "detail full" : "detail %g dpi", resolution);
+            report(name, measurement, nodes, sink.str().size());
+            if (!json)
+            {
+                std::printf("%-36s %10zu bytes\n", "", sink.str().size());
+            }
+        }
+    }
+
+    // Counts what it is given and throws it away, so document benchmarks
+    // measure generation rather than the disk.
+    class NullSink : public Sink
+    {
+    public:
+        void write(const char *, std::size_t size) override
+        {
+            bytes += size;
+        }
+
+        std::size_t bytes{0};
+    };
+
+    void benchmarkDocument()
+    {
+        if (!selected("document"))
+        {
+            return;
+        }
+        const auto pages = 100000;
+        auto makePage = [](int number) {
+            auto page = std::make_unique<HorizontalShapes>();
+            page->pushShape(std::make_unique<Skyline>(20, std::uint64_t(number)));
+            page->pushShape(std::make_unique<Circle>(36));
+            page->pushShape(std::make_unique<Rotated>(std::make_unique<Polygon>(6, 20), 90));
+            return page;
+        };
+
+        NullSink sink;
+        auto measurement = measure([&] {
+            Document document(sink);
+            for (auto i = 0; i < pages; ++i)
+            {
+                document.addPage(makePage(i));
+            }
+        });
+        report("document 100000 pages", measurement, pages, sink.bytes);
+        auto baseline = measurement.seconds;
+
+        // Pages are built as well as emitted on the pool.
+        auto limit = maxThreads != 0 ? maxThreads : std::max(1u, std::thread::hardware_concurrency());
+        for (std::size_t threads = 1; threads <= limit; threads *= 2)
+        {
+            ThreadPool pool(threads);
+            NullSink parallel;
+            measurement = measure([&] {
+                Document document(parallel);
+                document.set_threadPool(&pool);
+                for (auto i = 0; i < pages; ++i)
+                {
+                    document.generatePage([&makePage, i] { return makePage(i); });
+                }
+            });
+            report("document " + std::to_string(threads) + " threads", measurement, pages, parallel.bytes);
+            if (!json)
+            {
+                std::printf("%-36s %10.2fx speedup, output %s\n", "", baseline / measurement.seconds,
+                            parallel.bytes == sink.bytes ? "same size" : "DIFFERS");
+            }
+        }
+    }
+
+    void benchmarkPdf()
+    {
+        if (!selected("pdf"))
+        {
+            return;
+        }
+        // A page of 1000 instances of a 60-sided polygon beside the same
+        // page with every polygon its own shape.
+        const auto pages = 100;
+        auto definition = Instance::define(std::make_unique<Polygon>(60, 4));
+        auto instances = std::make_unique<VerticalShapes>();
+        auto polygons = std::make_unique<VerticalShapes>();
+        for (auto row = 0; row < 25; ++row)
+        {
+            auto called = std::make_unique<HorizontalShapes>();
+            auto drawn = std::make_unique<HorizontalShapes>();
+            for (auto column = 0; column < 40; ++column)
+            {
+                called->pushShape(std::make_unique<Instance>(definition));
+                drawn->pushShape(std::make_unique<Polygon>(60, 4));
+            }
+            instances->pushShape(std::move(called));
+            polygons->pushShape(std::move(drawn));
+        }
+        auto nodes = pages * instances->get_nodeCount();
+
+        NullSink postscript;
+        auto measurement = measure([&] {
+            Document document(postscript);
+            for (auto i = 0; i < pages; ++i)
+            {
+                document.addPage(*instances);
+            }
+        });
+        report("pdf postscript instances", measurement, nodes, postscript.bytes);
+        for (auto page : {instances.get(), polygons.get()})
+        {
+            NullSink pdf;
+            measurement = measure([&] {
+                PdfDocument document(pdf);
+                for (auto i = 0; i < pages; ++i)
+                {
+                    document.addPage(*page);
+                }
+            });
+            report(page == instances.get() ? "pdf forms" : "pdf expanded", measurement, nodes, pdf.bytes);
+        }
+    }
+
+    void benchmarkRaster()
+    {
+        if (!selected("raster"))
+        {
+            return;
+        }
+        // Thumbnails of small pages, each drawn into a fresh bitmap.
+        const auto thumbnails = 2000;
+        std::vector<std::unique_ptr<Shape>> pages;
+        for (auto i = 0; i < 50; ++i)
+        {
+            auto page = std::make_unique<HorizontalShapes>();
+            page->pushShape(std::make_unique<Skyline>(20, std::uint64_t(i)));
+            page->pushShape(std::make_unique<Circle>(36));
+            page->pushShape(std::make_unique<Rotated>(std::make_unique<Polygon>(6, 20), 90));
+            pages.push_back(std::move(page));
+        }
+        std::size_t bytes = 0;
+        auto measurement = measure([&] {
+            bytes = 0;
+            for (auto i = 0; i < thumbnails; ++i)
+            {
+                auto &page = *pages[i % pages.size()];
+                Bitmap bitmap(128, 128);
+                Rasterizer rasterizer(bitmap);
+                rasterizer.fit(page.get_bounds());
+                rasterizer.draw(page);
+                bytes += bitmap.pixels().size();
+            }
+        });
+        report("raster 2000 thumbnails", measurement, thumbnails, bytes);
+        if (!json)
+        {
+            std::printf("%-36s %10.0f thumbnails/s\n", "", thumbnails / measurement.seconds);
+        }
+
+        // One large, dense image, filled in tiles on the pool.
+        auto grid = std::make_unique<VerticalShapes>();
+        for (auto row = 0; row < 40; ++row)
+        {
+            auto line = std::make_unique<HorizontalShapes>();
+            for (auto column = 0; column < 40; ++column)
+            {
+                line->pushShape(std::make_unique<Circle>(4 + (row + column) % 7));
+                line->pushShape(std::make_unique<Polygon>(3 + column % 5, 8));
+            }
+            grid->pushShape(std::move(line));
+        }
+        auto nodes = grid->get_nodeCount();
+        Bitmap image(2048, 2048, Bitmap::Format::Rgba);
+        measurement = measure([&] {
+            Rasterizer rasterizer(image);
+            rasterizer.fit(grid->get_bounds());
+            rasterizer.draw(*grid);
+        });
+        report("raster 2048px", measurement, nodes, image.pixels().size());
+        auto baseline = measurement.seconds;
+        auto limit = maxThreads != 0 ? maxThreads : std::max(1u, std::thread::hardware_concurrency());
+        for (std::size_t threads = 1; threads <= limit; threads *= 2)
+        {
+            ThreadPool pool(threads);
+            measurement = measure([&] {
+                Rasterizer rasterizer(image);
+                rasterizer.set_threadPool(&pool);
+                rasterizer.fit(grid->get_bounds());
+                rasterizer.draw(*grid);
+            });
+            report("raster 2048px " + std::to_string(threads) + " threads", measurement, nodes,
+                   image.pixels().size());
+            if (!json)
+            {
+                std::printf("%-36s %10.2fx speedup\n", "", baseline / measurement.seconds);
+            }
+        }
+    }
+
+}
+
+int main(int argc, char *argv[])
+{
+    for (auto i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--json") == 0)
+        {
+            json = true;
+        }
+        else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            maxThreads = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else
+        {
+            filter = argv[i];
+        }
+    }
+
+    benchmarkShapes();
+    benchmarkCompounds();
+    benchmarkNumberFormatting();
+    benchmarkNestedFragments();
+    benchmarkPeephole();
+    benchmarkArena();
+    benchmarkFlatScene();
+    benchmarkParallelCompound();
+    benchmarkUnbalanced();
+    benchmarkCulling();
+    benchmarkSpatialIndex();
+    benchmarkLevelOfDetail();
+    benchmarkDocument();
+    benchmarkPdf();
+    benchmarkRaster();
+
+    if (json)
+    {
+        writeJson();
+    }
+    return 0;
+}
@@ -0,0 +1,41 @@
+// arena.cpp
+//
+
+#include "arena.hpp"
+
+namespace cps
+{
+
+    namespace
+    {
+        thread_local std::pmr::memory_resource *activeArena = nullptr;
+    }
+
+    // Arena Class
+    Arena::Arena(std::size_t initialSize, std::pmr::memory_resource *upstream)
+            : _resource(initialSize, upstream)
+    {}
+
+    std::pmr::memory_resource *Arena::resource()
+    {
+        return &_resource;
+    }
+
+    // ArenaScope Class
+    ArenaScope::ArenaScope(Arena &arena)
+            : _previous{activeArena}
+    {
+        activeArena = arena.resource();
+    }
+
+    ArenaScope::~ArenaScope()
+    {
+        activeArena = _previous;
+    }
+
+    std::pmr::memory_resource *currentResource()
+    {
+        return activeArena ? activeArena : std::pmr::get_default_resource();
+    }
+
+}
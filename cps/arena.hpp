@@ -0,0 +1,59 @@
+// arena.hpp
+//
+// Bump allocation for large scenes. While an ArenaScope is active on a
+// thread, every Shape created on that thread, along with its child list or
+// building array, is carved out of the Arena instead of the heap. Deleting
+// those shapes frees nothing; the memory is released all at once when the
+// Arena is destroyed. Shape_ptr and the rest of the API stay the same.
+//
+// An Arena must outlive every shape allocated from it, and may only be
+// used from one thread at a time.
+//
+
+#ifndef CS372_CPS_ARENA_H
+#define CS372_CPS_ARENA_H
+
+#include <cstddef>
+#include <memory_resource>
+
+namespace cps
+{
+
+    class Arena
+    {
+    public:
+        explicit Arena(std::size_t initialSize = 1 << 16,
+                       std::pmr::memory_resource *upstream = std::pmr::get_default_resource());
+
+        Arena(const Arena &) = delete;
+
+        Arena &operator=(const Arena &) = delete;
+
+        std::pmr::memory_resource *resource();
+
+    private:
+        std::pmr::monotonic_buffer_resource _resource;
+    };
+
+    class ArenaScope
+    {
+    public:
+        explicit ArenaScope(Arena &arena);
+
+        ArenaScope(const ArenaScope &) = delete;
+
+        ArenaScope &operator=(const ArenaScope &) = delete;
+
+        ~ArenaScope();
+
+    private:
+        std::pmr::memory_resource *_previous;
+    };
+
+    // The arena resource of the innermost ArenaScope on this thread, or the
+    // default resource when there is none.
+    std::pmr::memory_resource *currentResource();
+
+}
+
+#endif //CS372_CPS_ARENA_H
@@ -0,0 +1,261 @@
+// buildings.cpp
+//
+
+#include "buildings.hpp"
+
+#include <algorithm>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace cps
+{
+
+    // Buildings Class
+    Buildings::Buildings(std::pmr::memory_resource *resource)
+            : _spacings(resource), _heights(resource), _widths(resource)
+    {}
+
+    Buildings::Buildings(std::size_t count, std::pmr::memory_resource *resource)
+            : _spacings(count, resource), _heights(count, resource), _widths(count, resource)
+    {}
+
+    Buildings::Buildings(const std::vector<Building> &buildings, std::pmr::memory_resource *resource)
+            : Buildings(resource)
+    {
+        reserve(buildings.size());
+        for (const auto &building : buildings)
+        {
+            push_back(building);
+        }
+    }
+
+    std::size_t Buildings::size() const
+    {
+        return _heights.size();
+    }
+
+    bool Buildings::empty() const
+    {
+        return _heights.empty();
+    }
+
+    void Buildings::resize(std::size_t count)
+    {
+        _spacings.resize(count);
+        _heights.resize(count);
+        _widths.resize(count);
+    }
+
+    void Buildings::reserve(std::size_t count)
+    {
+        _spacings.reserve(count);
+        _heights.reserve(count);
+        _widths.reserve(count);
+    }
+
+    void Buildings::push_back(const Building &building)
+    {
+        _spacings.push_back(building.spacing);
+        _heights.push_back(building.height);
+        _widths.push_back(building.width);
+    }
+
+    Building Buildings::operator[](std::size_t index) const
+    {
+        return {_spacings[index], _heights[index], _widths[index]};
+    }
+
+    BuildingColumns Buildings::columns() const
+    {
+        return columns(0, size());
+    }
+
+    BuildingColumns Buildings::columns(std::size_t first, std::size_t count) const
+    {
+        return {_spacings.data() + first, _heights.data() + first, _widths.data() + first, count};
+    }
+
+    double *Buildings::spacings()
+    {
+        return _spacings.data();
+    }
+
+    double *Buildings::heights()
+    {
+        return _heights.data();
+    }
+
+    double *Buildings::widths()
+    {
+        return _widths.data();
+    }
+
+    std::vector<Building> buildingsFromFootprints(std::vector<Footprint> footprints)
+    {
+        std::stable_sort(footprints.begin(), footprints.end(),
+                         [](const auto &a, const auto &b) { return a.left < b.left; });
+        std::vector<Building> buildings;
+        buildings.reserve(footprints.size());
+        auto previousRight = 0.0;
+        for (const auto &footprint : footprints)
+        {
+            buildings.push_back({footprint.left - previousRight, footprint.height, footprint.width});
+            previousRight = footprint.left + footprint.width;
+        }
+        return buildings;
+    }
+
+    // Generation
+    namespace
+    {
+        // The SplitMix64 finalizer; a good enough mix that consecutive
+        // counters give independent-looking values.
+        std::uint64_t mix(std::uint64_t value)
+        {
+            value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+            return value ^ (value >> 31);
+        }
+
+        double uniform(std::uint64_t key, std::uint64_t counter, double low, double high)
+        {
+            auto bits = mix(key + (counter + 1) * 0x9e3779b97f4a7c15ULL);
+            return low + (high - low) * (static_cast<double>(bits >> 11) * 0x1.0p-53);
+        }
+    }
+
+    Building skylineBuilding(std::uint64_t seed, std::uint64_t index)
+    {
+        auto key = mix(seed);
+        return {uniform(key, index * 3 + 2, 5, 20),
+                uniform(key, index * 3, 10, 100),
+                uniform(key, index * 3 + 1, 20, 50)};
+    }
+
+    void generateBuildings(std::uint64_t seed, std::uint64_t firstIndex,
+                           Buildings &buildings, std::size_t first, std::size_t count)
+    {
+        auto key = mix(seed);
+        auto spacings = buildings.spacings() + first;
+        auto heights = buildings.heights() + first;
+        auto widths = buildings.widths() + first;
+        for (std::size_t offset = 0; offset < count; ++offset)
+        {
+            auto counter = (firstIndex + offset) * 3;
+            heights[offset] = uniform(key, counter, 10, 100);
+            widths[offset] = uniform(key, counter + 1, 20, 50);
+            spacings[offset] = uniform(key, counter + 2, 5, 20);
+        }
+    }
+
+    // Reductions
+    //
+    // Each keeps several independent accumulators so the loop is limited by
+    // loads rather than by the latency of one add or max chain.
+    double sumOf(const double *values, std::size_t count)
+    {
+        std::size_t index = 0;
+        double total = 0.0;
+#if defined(__AVX__)
+        auto first = _mm256_setzero_pd();
+        auto second = _mm256_setzero_pd();
+        for (; index + 8 <= count; index += 8)
+        {
+            first = _mm256_add_pd(first, _mm256_loadu_pd(values + index));
+            second = _mm256_add_pd(second, _mm256_loadu_pd(values + index + 4));
+        }
+        double lanes[4];
+        _mm256_storeu_pd(lanes, _mm256_add_pd(first, second));
+        total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(__SSE2__)
+        auto first = _mm_setzero_pd();
+        auto second = _mm_setzero_pd();
+        for (; index + 4 <= count; index += 4)
+        {
+            first = _mm_add_pd(first, _mm_loadu_pd(values + index));
+            second = _mm_add_pd(second, _mm_loadu_pd(values + index + 2));
+        }
+        double lanes[2];
+        _mm_storeu_pd(lanes, _mm_add_pd(first, second));
+        total = lanes[0] + lanes[1];
+#endif
+        for (; index < count; ++index)
+        {
+            total += values[index];
+        }
+        return total;
+    }
+
+    double maxOf(const double *values, std::size_t count)
+    {
+        std::size_t index = 0;
+        double result = values[0];
+#if defined(__AVX__)
+        auto first = _mm256_set1_pd(result);
+        auto second = first;
+        for (; index + 8 <= count; index += 8)
+        {
+            first = _mm256_max_pd(first, _mm256_loadu_pd(values + index));
+            second = _mm256_max_pd(second, _mm256_loadu_pd(values + index + 4));
+        }
+        double lanes[4];
+        _mm256_storeu_pd(lanes, _mm256_max_pd(first, second));
+        result = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#elif defined(__SSE2__)
+        auto first = _mm_set1_pd(result);
+        auto second = first;
+        for (; index + 4 <= count; index += 4)
+        {
+            first = _mm_max_pd(first, _mm_loadu_pd(values + index));
+            second = _mm_max_pd(second, _mm_loadu_pd(values + index + 2));
+        }
+        double lanes[2];
+        _mm_storeu_pd(lanes, _mm_max_pd(first, second));
+        result = std::max(lanes[0], lanes[1]);
+#endif
+        for (; index < count; ++index)
+        {
+            result = std::max(result, values[index]);
+        }
+        return result;
+    }
+
+    double minOf(const double *values, std::size_t count)
+    {
+        std::size_t index = 0;
+        double result = values[0];
+#if defined(__AVX__)
+        auto first = _mm256_set1_pd(result);
+        auto second = first;
+        for (; index + 8 <= count; index += 8)
+        {
+            first = _mm256_min_pd(first, _mm256_loadu_pd(values + index));
+            second = _mm256_min_pd(second, _mm256_loadu_pd(values + index + 4));
+        }
+        double lanes[4];
+        _mm256_storeu_pd(lanes, _mm256_min_pd(first, second));
+        result = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+#elif defined(__SSE2__)
+        auto first = _mm_set1_pd(result);
+        auto second = first;
+        for (; index + 4 <= count; index += 4)
+        {
+            first = _mm_min_pd(first, _mm_loadu_pd(values + index));
+            second = _mm_min_pd(second, _mm_loadu_pd(values + index + 2));
+        }
+        double lanes[2];
+        _mm_storeu_pd(lanes, _mm_min_pd(first, second));
+        result = std::min(lanes[0], lanes[1]);
+#endif
+        for (; index < count; ++index)
+        {
+            result = std::min(result, values[index]);
+        }
+        return result;
+    }
+
+}
@@ -0,0 +1,105 @@
+// buildings.hpp
+//
+// Skyline building data. Buildings are stored as separate spacing, height
+// and width arrays so measuring a skyline streams through exactly the
+// values it needs, and those passes are vectorized where the target CPU
+// allows (configure with -DCPS_NATIVE=ON to build for the host's AVX).
+//
+
+#ifndef CS372_CPS_BUILDINGS_H
+#define CS372_CPS_BUILDINGS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+namespace cps
+{
+
+    struct Building
+    {
+        double spacing;
+        double height;
+        double width;
+    };
+
+    // A building placed by its left edge, measured from the left of the
+    // skyline. Footprints may overlap.
+    struct Footprint
+    {
+        double left;
+        double width;
+        double height;
+    };
+
+    // A read-only view of count buildings held column by column.
+    struct BuildingColumns
+    {
+        const double *spacings;
+        const double *heights;
+        const double *widths;
+        std::size_t count;
+    };
+
+    class Buildings
+    {
+    public:
+        explicit Buildings(std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+        Buildings(std::size_t count, std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+        Buildings(const std::vector<Building> &buildings,
+                  std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+        std::size_t size() const;
+
+        bool empty() const;
+
+        void resize(std::size_t count);
+
+        void reserve(std::size_t count);
+
+        void push_back(const Building &building);
+
+        Building operator[](std::size_t index) const;
+
+        BuildingColumns columns() const;
+
+        BuildingColumns columns(std::size_t first, std::size_t count) const;
+
+        double *spacings();
+
+        double *heights();
+
+        double *widths();
+
+    private:
+        std::pmr::vector<double> _spacings;
+        std::pmr::vector<double> _heights;
+        std::pmr::vector<double> _widths;
+    };
+
+    // Orders footprints by left edge and expresses each as spacing from the
+    // previous building's right edge, which is negative where they overlap.
+    std::vector<Building> buildingsFromFootprints(std::vector<Footprint> footprints);
+
+    // Random buildings are derived from a seed and the building's index alone
+    // so any range of a skyline can be generated independently of the rest.
+    // Heights fall in [10, 100), widths in [20, 50) and spacings in [5, 20).
+    Building skylineBuilding(std::uint64_t seed, std::uint64_t index);
+
+    // Fills buildings [first, first + count), numbering them from firstIndex.
+    void generateBuildings(std::uint64_t seed, std::uint64_t firstIndex,
+                           Buildings &buildings, std::size_t first, std::size_t count);
+
+    // Reductions over a column; maxOf and minOf require count > 0.
+    double sumOf(const double *values, std::size_t count);
+
+    double maxOf(const double *values, std::size_t count);
+
+    double minOf(const double *values, std::size_t count);
+
+}
+
+#endif //CS372_CPS_BUILDINGS_H
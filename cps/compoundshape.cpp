@@ -2,25 +2,64 @@
 // Created by Mark, Bryant and Jacob on 3/20/2019.
 //
 
+#include <algorithm>
+#include <future>
 #include <numeric>
 #include "compoundshape.hpp"
+#include "arena.hpp"
+#include "layout.hpp"
 
 namespace cps
 {
 
     using std::vector;
-    using std::stringstream;
     using std::move;
-    using std::to_string;
     using std::pair;
 
     CompoundShape::CompoundShape(vector<Shape_ptr> shapes)
-            : _shapes(move(shapes))
-    {}
+            : _shapes(currentResource())
+    {
+        _shapes.reserve(shapes.size());
+        for (auto &shape : shapes)
+        {
+            adopt(*shape, this);
+            _shapes.push_back(move(shape));
+        }
+    }
+
+    CompoundShape::CompoundShape(CompoundShape &&other) noexcept
+            : Shape(other), _shapes(move(other._shapes)),
+              _threadPool{other._threadPool}, _parallelGrain{other._parallelGrain},
+              _cachedWidth{other._cachedWidth}, _cachedHeight{other._cachedHeight},
+              _cachedNodeCount{other._cachedNodeCount}, _cachedLargestChild{other._cachedLargestChild},
+              _cachedBounds{other._cachedBounds}, _cachedDrift{other._cachedDrift},
+              _metricsValid{other._metricsValid}, _boundsValid{other._boundsValid}
+    {
+        for (auto &shape : _shapes)
+        {
+            adopt(*shape, this);
+        }
+        if (other.invalidate())
+        {
+            other.invalidateParent();
+        }
+    }
+
+    CompoundShape::~CompoundShape()
+    {
+        vector<Shape_ptr> pending;
+        releaseChildren(pending);
+        destroyAll(pending);
+    }
 
     void CompoundShape::pushShape(Shape_ptr shape)
     {
+        adopt(*shape, this);
         _shapes.push_back(move(shape));
+        if (invalidate())
+        {
+            invalidateParent();
+        }
     }
 
     size_t CompoundShape::get_numShapes() const
@@ -48,57 +87,509 @@ namespace cps
         return _shapes.end();
     }
 
-    std::stringstream CompoundShape::generate()
+    ThreadPool *CompoundShape::get_threadPool() const
     {
-        stringstream postScriptFragment;
-        auto relativeCurrentPoint{0.0};
-        for (auto shape = begin(); shape != end(); ++shape)
+        return _threadPool;
+    }
+
+    void CompoundShape::set_threadPool(ThreadPool *pool)
+    {
+        _threadPool = pool;
+    }
+
+    std::size_t CompoundShape::get_parallelGrain() const
+    {
+        return _parallelGrain;
+    }
+
+    void CompoundShape::set_parallelGrain(std::size_t grain)
+    {
+        _parallelGrain = grain == 0 ? 1 : grain;
+    }
+
+    namespace
+    {
+        // The pool and grain of the innermost compound emitting in parallel
+        // on this thread, so compounds below it can split themselves too.
+        struct ParallelContext
+        {
+            ThreadPool *pool;
+            std::size_t grain;
+        };
+
+        thread_local ParallelContext parallelContext{nullptr, 0};
+
+        class ParallelScope
+        {
+        public:
+            explicit ParallelScope(ParallelContext context)
+                    : _saved{parallelContext}
+            {
+                parallelContext = context;
+            }
+
+            ParallelScope(const ParallelScope &) = delete;
+
+            ParallelScope &operator=(const ParallelScope &) = delete;
+
+            ~ParallelScope()
+            {
+                parallelContext = _saved;
+            }
+
+        private:
+            ParallelContext _saved;
+        };
+    }
+
+    ThreadPool *CompoundShape::parallelPool(std::size_t &grain)
+    {
+        auto context = _threadPool != nullptr ? ParallelContext{_threadPool, _parallelGrain} : parallelContext;
+        if (context.pool == nullptr || get_numShapes() < 2)
+        {
+            return nullptr;
+        }
+        // Splitting pays only when the children besides the largest hold a
+        // grain of work between them; otherwise the largest splits itself.
+        auto nodes = get_nodeCount();
+        if (nodes <= context.grain || nodes - 1 - _cachedLargestChild < context.grain)
+        {
+            return nullptr;
+        }
+        grain = context.grain;
+        return context.pool;
+    }
+
+    bool CompoundShape::emitsWhole()
+    {
+        std::size_t grain;
+        return parallelPool(grain) != nullptr;
+    }
+
+    void CompoundShape::emit(Sink &sink)
+    {
+        std::size_t grain;
+        if (auto pool = parallelPool(grain))
+        {
+            emitParallel(sink, *pool, grain);
+            return;
+        }
+        emitTree(sink);
+    }
+
+    std::size_t CompoundShape::get_numChildren()
+    {
+        return _shapes.size();
+    }
+
+    Shape &CompoundShape::childAt(std::size_t index)
+    {
+        return *_shapes[index];
+    }
+
+    void CompoundShape::beforeChild(std::size_t index, double &cursor, Sink &sink)
+    {
+        if (index != 0 && moveToNextShape(*_shapes[index], cursor, sink))
+        {
+            sink << '\n';
+        }
+    }
+
+    void CompoundShape::beforeChild(std::size_t index, double &cursor, LayoutBuilder &builder)
+    {
+        if (index != 0)
+        {
+            moveToNextShape(*_shapes[index], cursor, builder);
+        }
+    }
+
+    void CompoundShape::afterChild(std::size_t index, double &cursor, Sink &sink)
+    {
+        sink << '\n';
+        if (index + 1 != _shapes.size())
+        {
+            moveToNextShape(*_shapes[index], cursor, sink);
+        }
+    }
+
+    void CompoundShape::afterChild(std::size_t index, double &cursor, LayoutBuilder &builder)
+    {
+        if (index + 1 != _shapes.size())
+        {
+            moveToNextShape(*_shapes[index], cursor, builder);
+        }
+    }
+
+    void CompoundShape::closeChildren(double &cursor, Sink &sink)
+    {
+        if (_shapes.size() > 1)
+        {
+            moveBackToOrigin(cursor, sink);
+        }
+    }
+
+    void CompoundShape::closeChildren(double &cursor, LayoutBuilder &builder)
+    {
+        if (_shapes.size() > 1)
+        {
+            moveBackToOrigin(cursor, builder);
+        }
+    }
+
+    void CompoundShape::releaseChildren(std::vector<Shape_ptr> &pending)
+    {
+        for (auto &shape : _shapes)
+        {
+            pending.push_back(move(shape));
+        }
+        _shapes.clear();
+    }
+
+    namespace
+    {
+        // Collects a run's text as a list of buffers. Runs nested inside a
+        // parallel run hand over their buffers rather than copying them, so
+        // each byte is copied once however deeply the split recurses.
+        class RunSink : public Sink
+        {
+        public:
+            explicit RunSink(const Settings &settings)
+            {
+                set_settings(settings);
+            }
+
+            void write(const char *data, std::size_t size) override
+            {
+                if (_pieces.empty())
+                {
+                    _pieces.emplace_back();
+                }
+                _pieces.back().append(data, size);
+            }
+
+            void append(std::vector<std::string> pieces)
+            {
+                for (auto &piece : pieces)
+                {
+                    _pieces.push_back(std::move(piece));
+                }
+                // Later writes start a fresh buffer instead of growing the
+                // last one handed over.
+                _pieces.emplace_back();
+            }
+
+            std::vector<std::string> release()
+            {
+                return std::move(_pieces);
+            }
+
+        private:
+            std::vector<std::string> _pieces;
+        };
+
+        void writeRun(Sink &sink, std::vector<std::string> pieces)
+        {
+            if (auto run = dynamic_cast<RunSink *>(&sink))
+            {
+                run->append(std::move(pieces));
+                return;
+            }
+            for (const auto &piece : pieces)
+            {
+                sink << piece;
+            }
+        }
+
+        // Keeps workers from outliving the data they reference if emission
+        // is abandoned part way.
+        struct WaitForAll
         {
-            if (shape != begin())
+            ThreadPool &pool;
+            std::vector<std::future<std::vector<std::string>>> &futures;
+
+            ~WaitForAll()
             {
-                std::string amountToMove = moveToNextShape(**shape, relativeCurrentPoint);
-                postScriptFragment << amountToMove;
-                if (!amountToMove.empty())
+                for (auto &future : futures)
                 {
-                    postScriptFragment << std::endl;
+                    if (future.valid())
+                    {
+                        try
+                        {
+                            pool.wait(future);
+                        }
+                        catch (...)
+                        {
+                            // Only the first failure is reported.
+                        }
+                    }
                 }
             }
-            postScriptFragment << (*shape)->generate().str() << std::endl;
-            if (shape + 1 != end())
+        };
+    }
+
+    void CompoundShape::emitParallel(Sink &sink, ThreadPool &pool, std::size_t grain)
+    {
+        // Fill every size cache below here now so workers only read them.
+        get_width();
+        get_height();
+
+        // Replay the moves through the layout overloads, which advance the
+        // current point with the same arithmetic but format nothing, to find
+        // where the point stands when each run of children starts.
+        const auto count = get_numShapes();
+        std::vector<double> startPoints(count);
+        std::vector<Placement> scratch;
+        LayoutBuilder builder(scratch);
+        auto relativeCurrentPoint{0.0};
+        for (std::size_t index = 0; index < count; ++index)
+        {
+            if (index > 1)
+            {
+                moveToNextShape(*_shapes[index - 1], relativeCurrentPoint, builder);
+            }
+            if (index > 0)
             {
-                postScriptFragment << moveToNextShape(**shape, relativeCurrentPoint);
+                moveToNextShape(*_shapes[index - 1], relativeCurrentPoint, builder);
             }
+            startPoints[index] = relativeCurrentPoint;
         }
-        if (get_numShapes() > 1)
+        moveToNextShape(*_shapes[count - 1], relativeCurrentPoint, builder);
+        scratch.clear();
+
+        // Cut runs of about grain nodes. A child at least that big stands
+        // alone; it splits itself when emitted.
+        std::vector<std::size_t> runStarts{0};
+        std::size_t runNodes = 0;
+        for (std::size_t index = 0; index < count; ++index)
         {
-            postScriptFragment << moveBackToOrigin(relativeCurrentPoint);
+            auto nodes = _shapes[index]->get_nodeCount();
+            if (nodes >= grain && runStarts.back() != index)
+            {
+                runStarts.push_back(index);
+                runNodes = 0;
+            }
+            runNodes += nodes;
+            if (runNodes >= grain && index + 1 < count)
+            {
+                runStarts.push_back(index + 1);
+                runNodes = 0;
+            }
         }
-        return postScriptFragment;
+        runStarts.push_back(count);
+
+        const ParallelContext context{&pool, grain};
+        const auto settings = sink.get_settings();
+        std::vector<std::future<std::vector<std::string>>> futures;
+        WaitForAll guard{pool, futures};
+        for (std::size_t run = 1; run + 1 < runStarts.size(); ++run)
+        {
+            auto first = runStarts[run];
+            auto last = runStarts[run + 1];
+            auto start = startPoints[first];
+            futures.push_back(pool.submit([this, first, last, start, settings, context] {
+                ParallelScope scope(context);
+                return emitChildren(first, last, start, settings);
+            }));
+        }
+
+        {
+            ParallelScope scope(context);
+            writeRun(sink, emitChildren(0, runStarts[1], 0.0, settings));
+        }
+        for (auto &future : futures)
+        {
+            writeRun(sink, pool.wait(future));
+        }
+        moveBackToOrigin(relativeCurrentPoint, sink);
+    }
+
+    std::vector<std::string> CompoundShape::emitChildren(std::size_t first, std::size_t last,
+                                                         double relativeCurrentPoint,
+                                                         const Sink::Settings &settings)
+    {
+        RunSink sink(settings);
+        for (auto index = first; index < last; ++index)
+        {
+            beforeChild(index, relativeCurrentPoint, sink);
+            _shapes[index]->emit(sink);
+            afterChild(index, relativeCurrentPoint, sink);
+        }
+        return sink.release();
+    }
+
+    void CompoundShape::visitChildren(const std::function<void(Shape &)> &visitor)
+    {
+        for (auto &shape : _shapes)
+        {
+            visitor(*shape);
+        }
+    }
+
+    std::size_t CompoundShape::get_nodeCount()
+    {
+        updateMetrics();
+        return _cachedNodeCount;
+    }
+
+    BoundingBox CompoundShape::get_bounds()
+    {
+        updateBounds();
+        return _cachedBounds;
+    }
+
+    std::pair<double, double> CompoundShape::get_drift()
+    {
+        updateBounds();
+        return _cachedDrift;
     }
 
     double CompoundShape::get_width()
     {
-        return std::accumulate(this->begin(), this->end(), 0.0, lambdaWidth());
+        updateMetrics();
+        return _cachedWidth;
     }
 
     double CompoundShape::get_height()
     {
-        return std::accumulate(this->begin(), this->end(), 0.0, lambdaHeight());
+        updateMetrics();
+        return _cachedHeight;
+    }
+
+    // Once invalid, everything above is already invalid too.
+    bool CompoundShape::invalidate()
+    {
+        if (!_metricsValid)
+        {
+            return false;
+        }
+        _metricsValid = false;
+        _boundsValid = false;
+        return true;
+    }
+
+    CompoundShape *CompoundShape::pendingMetrics()
+    {
+        return _metricsValid ? nullptr : this;
+    }
+
+    void CompoundShape::updateMetrics()
+    {
+        if (_metricsValid)
+        {
+            return;
+        }
+        // A compound is measured once none of its children is pending; each
+        // is scanned at most twice, before and after its children.
+        vector<CompoundShape *> pending{this};
+        while (!pending.empty())
+        {
+            auto compound = pending.back();
+            auto ready = true;
+            for (auto &shape : compound->_shapes)
+            {
+                if (auto child = shape->pendingMetrics())
+                {
+                    pending.push_back(child);
+                    ready = false;
+                }
+            }
+            if (ready)
+            {
+                compound->computeMetrics();
+                pending.pop_back();
+            }
+        }
+    }
+
+    void CompoundShape::computeMetrics()
+    {
+        _cachedWidth = std::accumulate(this->begin(), this->end(), 0.0, lambdaWidth());
+        _cachedHeight = std::accumulate(this->begin(), this->end(), 0.0, lambdaHeight());
+        _cachedNodeCount = 1;
+        _cachedLargestChild = 0;
+        for (auto &shape : _shapes)
+        {
+            auto nodes = shape->get_nodeCount();
+            _cachedNodeCount += nodes;
+            _cachedLargestChild = std::max(_cachedLargestChild, nodes);
+        }
+        _metricsValid = true;
+    }
+
+    CompoundShape *CompoundShape::pendingBounds()
+    {
+        return _boundsValid ? nullptr : this;
+    }
+
+    // The same walk as updateMetrics; sizes come first since placing a
+    // child depends on the sizes of those before it.
+    void CompoundShape::updateBounds()
+    {
+        if (_boundsValid)
+        {
+            return;
+        }
+        updateMetrics();
+        vector<CompoundShape *> pending{this};
+        while (!pending.empty())
+        {
+            auto compound = pending.back();
+            auto ready = true;
+            for (auto &shape : compound->_shapes)
+            {
+                if (auto child = shape->pendingBounds())
+                {
+                    pending.push_back(child);
+                    ready = false;
+                }
+            }
+            if (ready)
+            {
+                compound->computeBounds();
+                pending.pop_back();
+            }
+        }
+    }
+
+    // Children are placed by replaying the moves emit makes. A compound only
+    // ever translates, so each child's bounds just shift.
+    void CompoundShape::computeBounds()
+    {
+        _cachedBounds = BoundingBox::none();
+        std::vector<Placement> unused;
+        LayoutBuilder builder(unused);
+        auto relativeCurrentPoint{0.0};
+        for (std::size_t index = 0; index < _shapes.size(); ++index)
+        {
+            auto &shape = *_shapes[index];
+            beforeChild(index, relativeCurrentPoint, builder);
+            _cachedBounds.include(transformed(shape.get_bounds(), builder.current()));
+            auto drift = shape.get_drift();
+            builder.translate(drift.first, drift.second);
+            afterChild(index, relativeCurrentPoint, builder);
+        }
+        closeChildren(relativeCurrentPoint, builder);
+        _cachedDrift = {builder.current().e, builder.current().f};
+        _boundsValid = true;
     }
 
     LayeredShapes::LayeredShapes(std::vector<Shape_ptr> shapes)
             : CompoundShape(move(shapes))
     {}
 
-    std::string LayeredShapes::moveToNextShape(Shape &, double &)
+    bool LayeredShapes::moveToNextShape(Shape &, double &, Sink &)
     {
-        return std::string();
+        return false;
     }
 
-    std::string LayeredShapes::moveBackToOrigin(double &)
-    {
-        return std::string();
-    }
+    void LayeredShapes::moveBackToOrigin(double &, Sink &)
+    {}
+
+    void LayeredShapes::moveToNextShape(Shape &, double &, LayoutBuilder &)
+    {}
+
+    void LayeredShapes::moveBackToOrigin(double &, LayoutBuilder &)
+    {}
 
     HorizontalShapes::HorizontalShapes(std::vector<Shape_ptr> shapes)
             : CompoundShape(move(shapes))
@@ -132,19 +623,27 @@ namespace cps
         };
     }
 
-    std::string HorizontalShapes::moveToNextShape(Shape &shape, double &relativeCurrentPoint)
+    bool HorizontalShapes::moveToNextShape(Shape &shape, double &relativeCurrentPoint, Sink &sink)
     {
-        stringstream postScriptFragment;
         relativeCurrentPoint += shape.get_width() / 2;
-        postScriptFragment << std::to_string(shape.get_width() / 2) << " " << "0 translate\n";
-        return postScriptFragment.str();
+        sink << shape.get_width() / 2 << " " << "0 translate\n";
+        return true;
     }
 
-    std::string HorizontalShapes::moveBackToOrigin(double &relativeCurrentPoint)
+    void HorizontalShapes::moveBackToOrigin(double &relativeCurrentPoint, Sink &sink)
     {
-        stringstream postScriptFragment;
-        postScriptFragment << to_string(-relativeCurrentPoint) << " 0 translate\n";
-        return postScriptFragment.str();
+        sink << -relativeCurrentPoint << " 0 translate\n";
+    }
+
+    void HorizontalShapes::moveToNextShape(Shape &shape, double &relativeCurrentPoint, LayoutBuilder &builder)
+    {
+        relativeCurrentPoint += shape.get_width() / 2;
+        builder.translate(shape.get_width() / 2, 0);
+    }
+
+    void HorizontalShapes::moveBackToOrigin(double &relativeCurrentPoint, LayoutBuilder &builder)
+    {
+        builder.translate(-relativeCurrentPoint, 0);
     }
 
     std::function<double(double, Shape::Shape_ptr &)> HorizontalShapes::lambdaWidth()
@@ -170,19 +669,27 @@ namespace cps
             : CompoundShape(move(shapes))
     {}
 
-    std::string VerticalShapes::moveToNextShape(Shape &shape, double &relativeCurrentPoint)
+    bool VerticalShapes::moveToNextShape(Shape &shape, double &relativeCurrentPoint, Sink &sink)
+    {
+        relativeCurrentPoint += shape.get_height() / 2;
+        sink << "0 " << shape.get_height() / 2 << " translate\n";
+        return true;
+    }
+
+    void VerticalShapes::moveBackToOrigin(double &relativeCurrentPoint, Sink &sink)
+    {
+        sink << "0 " << -relativeCurrentPoint << " translate\n";
+    }
+
+    void VerticalShapes::moveToNextShape(Shape &shape, double &relativeCurrentPoint, LayoutBuilder &builder)
     {
-        stringstream postScriptFragment;
         relativeCurrentPoint += shape.get_height() / 2;
-        postScriptFragment << 0 << " " << to_string(shape.get_height() / 2) << " translate\n";
-        return postScriptFragment.str();
+        builder.translate(0, shape.get_height() / 2);
     }
 
-    std::string VerticalShapes::moveBackToOrigin(double &relativeCurrentPoint)
+    void VerticalShapes::moveBackToOrigin(double &relativeCurrentPoint, LayoutBuilder &builder)
     {
-        stringstream postScriptFragment;
-        postScriptFragment << "0 " << to_string(-relativeCurrentPoint) << " translate\n";
-        return postScriptFragment.str();
+        builder.translate(0, -relativeCurrentPoint);
     }
 
     std::function<double(double, Shape::Shape_ptr &)> VerticalShapes::lambdaWidth()
@@ -206,7 +713,35 @@ namespace cps
 
     Scaled::Scaled(Shape &shape, pair<double, double> scaleFactor)
             : _originalShape(&shape), _scaleFactor(move(scaleFactor))
-    {}
+    {
+        observe();
+    }
+
+    Scaled::Scaled(const Scaled &other)
+            : Shape(other), _originalShape(other._originalShape), _scaleFactor(other._scaleFactor)
+    {
+        observe();
+    }
+
+    Scaled::~Scaled()
+    {
+        if (!_originalShape)
+        {
+            return;
+        }
+        auto link = &_originalShape->_observers;
+        while (*link != this)
+        {
+            link = &(*link)->_nextObserver;
+        }
+        *link = _nextObserver;
+    }
+
+    void Scaled::observe()
+    {
+        _nextObserver = _originalShape->_observers;
+        _originalShape->_observers = this;
+    }
 
     double Scaled::get_width()
     {
@@ -219,18 +754,70 @@ namespace cps
     }
 
 
-    std::stringstream Scaled::generate()
+    void Scaled::emit(Sink &sink)
     {
-        std::stringstream output;
-        output << "gsave" << std::endl;
-        output << std::to_string(_scaleFactor.first) << " " << std::to_string(_scaleFactor.second) << " scale"
-               << std::endl;
-        output << _originalShape->generate().str();
-        output << "grestore" << std::endl;
+        emitTree(sink);
+    }
 
-        return output;
+    std::size_t Scaled::get_numChildren()
+    {
+        return 1;
     }
 
-}
+    Shape &Scaled::childAt(std::size_t)
+    {
+        return *_originalShape;
+    }
+
+    void Scaled::openChildren(Sink &sink)
+    {
+        sink << "gsave\n";
+        sink << _scaleFactor.first << " " << _scaleFactor.second << " scale\n";
+        sink.pushScale(_scaleFactor.first, _scaleFactor.second);
+    }
 
+    void Scaled::openChildren(LayoutBuilder &builder)
+    {
+        builder.save();
+        builder.scale(_scaleFactor.first, _scaleFactor.second);
+    }
 
+    void Scaled::closeChildren(double &, Sink &sink)
+    {
+        sink.popScale();
+        sink << "grestore\n";
+    }
+
+    void Scaled::closeChildren(double &, LayoutBuilder &builder)
+    {
+        builder.restore();
+    }
+
+    BoundingBox Scaled::get_bounds()
+    {
+        Transform scale;
+        scale.scale(_scaleFactor.first, _scaleFactor.second);
+        return transformed(_originalShape->get_bounds(), scale);
+    }
+
+    CompoundShape *Scaled::pendingMetrics()
+    {
+        return _originalShape->pendingMetrics();
+    }
+
+    CompoundShape *Scaled::pendingBounds()
+    {
+        return _originalShape->pendingBounds();
+    }
+
+    void Scaled::visitChildren(const std::function<void(Shape &)> &visitor)
+    {
+        visitor(*_originalShape);
+    }
+
+    std::size_t Scaled::get_nodeCount()
+    {
+        return 1 + _originalShape->get_nodeCount();
+    }
+
+}
@@ -7,10 +7,13 @@
 #define CS372_CPS_COMPOUNDSHAPE_H
 
 #include <vector>
+#include <memory_resource>
 #include <utility> // pair
 #include <functional>
+#include <string>
 
 #include "shape.hpp"
+#include "threadpool.hpp"
 
 namespace cps
 {
@@ -18,22 +21,60 @@ namespace cps
     class CompoundShape : public Shape
     {
     public:
-        using iterator = std::vector<Shape_ptr>::iterator;
-        using const_iterator = std::vector<Shape_ptr>::const_iterator;
+        using iterator = std::pmr::vector<Shape_ptr>::iterator;
+        using const_iterator = std::pmr::vector<Shape_ptr>::const_iterator;
 
         explicit CompoundShape(std::vector<Shape_ptr> shapes);
 
+        CompoundShape(CompoundShape &&other) noexcept;
+
+        ~CompoundShape() override;
+
         void set_width(double) override
         {}
 
         void set_height(double) override
         {}
 
-        std::stringstream generate() override;
+        void emit(Sink &sink) override;
+
+        void visitChildren(const std::function<void(Shape &)> &visitor) override;
+
+        // With a pool set, emit() splits its children into runs of about
+        // get_parallelGrain() nodes and generates the runs concurrently into
+        // private buffers, writing them out in order; the text is the same
+        // as sequential emission. A child bigger than the grain gets a run
+        // of its own, and compounds inside it split themselves the same way
+        // on the same pool, so deep or lopsided trees still spread across
+        // every worker. Children must not share mutable state, and the pool
+        // must outlive any emit() that uses it. Null (the default) emits
+        // sequentially unless an enclosing compound is emitting in parallel.
+        // A compound whose children are all in one heavy branch leaves the
+        // split to that branch.
+        ThreadPool *get_threadPool() const;
+
+        void set_threadPool(ThreadPool *pool);
+
+        static constexpr std::size_t DEFAULT_PARALLEL_GRAIN = 2048;
+
+        std::size_t get_parallelGrain() const;
+
+        void set_parallelGrain(std::size_t grain);
+
+        std::size_t get_nodeCount() override;
+
+        BoundingBox get_bounds() override;
+
+        std::pair<double, double> get_drift() override;
+
+        // Returns false when this layout never moves between shapes.
+        virtual bool moveToNextShape(Shape &, double &, Sink &) = 0;
 
-        virtual std::string moveToNextShape(Shape &, double &) = 0;
+        virtual void moveBackToOrigin(double &, Sink &) = 0;
 
-        virtual std::string moveBackToOrigin(double &) = 0;
+        virtual void moveToNextShape(Shape &, double &, LayoutBuilder &) = 0;
+
+        virtual void moveBackToOrigin(double &, LayoutBuilder &) = 0;
 
         double get_width() override;
 
@@ -55,8 +96,67 @@ namespace cps
 
         const_iterator end() const;
 
+    protected:
+        bool invalidate() override;
+
+        std::size_t get_numChildren() override;
+
+        Shape &childAt(std::size_t index) override;
+
+        void beforeChild(std::size_t index, double &cursor, Sink &sink) override;
+
+        void beforeChild(std::size_t index, double &cursor, LayoutBuilder &builder) override;
+
+        void afterChild(std::size_t index, double &cursor, Sink &sink) override;
+
+        void afterChild(std::size_t index, double &cursor, LayoutBuilder &builder) override;
+
+        void closeChildren(double &cursor, Sink &sink) override;
+
+        void closeChildren(double &cursor, LayoutBuilder &builder) override;
+
+        bool emitsWhole() override;
+
+        CompoundShape *pendingMetrics() override;
+
+        CompoundShape *pendingBounds() override;
+
+        void releaseChildren(std::vector<Shape_ptr> &pending) override;
+
     private:
-        std::vector<Shape_ptr> _shapes{};
+        // Measures this compound and every out-of-date compound below it,
+        // deepest first, from an explicit stack.
+        void updateMetrics();
+
+        void computeMetrics();
+
+        void updateBounds();
+
+        void computeBounds();
+
+        // The pool to split this compound's emission across, or null to
+        // emit it in place.
+        ThreadPool *parallelPool(std::size_t &grain);
+
+        void emitParallel(Sink &sink, ThreadPool &pool, std::size_t grain);
+
+        std::vector<std::string> emitChildren(std::size_t first, std::size_t last, double relativeCurrentPoint,
+                                              const Sink::Settings &settings);
+
+        std::pmr::vector<Shape_ptr> _shapes;
+        ThreadPool *_threadPool{nullptr};
+        std::size_t _parallelGrain{DEFAULT_PARALLEL_GRAIN};
+        // Sizes are computed on first use and kept until this compound or
+        // anything below it changes. Replacing a child through an iterator
+        // bypasses this; use pushShape to add children.
+        double _cachedWidth{0};
+        double _cachedHeight{0};
+        std::size_t _cachedNodeCount{0};
+        std::size_t _cachedLargestChild{0};
+        BoundingBox _cachedBounds{};
+        std::pair<double, double> _cachedDrift{0, 0};
+        bool _metricsValid{false};
+        bool _boundsValid{false};
     };
 
     class LayeredShapes : public CompoundShape
@@ -68,9 +168,13 @@ namespace cps
 
         std::function<double (double, Shape_ptr&)> lambdaHeight() override;
 
-        std::string moveToNextShape(Shape &, double &) override;
+        bool moveToNextShape(Shape &, double &, Sink &) override;
+
+        void moveBackToOrigin(double &, Sink &) override;
 
-        std::string moveBackToOrigin(double &) override;
+        void moveToNextShape(Shape &, double &, LayoutBuilder &) override;
+
+        void moveBackToOrigin(double &, LayoutBuilder &) override;
 
     private:
     };
@@ -84,9 +188,13 @@ namespace cps
 
         std::function<double (double, Shape_ptr&)> lambdaHeight() override;
 
-        std::string moveToNextShape(Shape &, double &) override;
+        bool moveToNextShape(Shape &, double &, Sink &) override;
+
+        void moveBackToOrigin(double &, Sink &) override;
+
+        void moveToNextShape(Shape &, double &, LayoutBuilder &) override;
 
-        std::string moveBackToOrigin(double &) override;
+        void moveBackToOrigin(double &, LayoutBuilder &) override;
 
     private:
 
@@ -101,9 +209,13 @@ namespace cps
 
         std::function<double (double, Shape_ptr&)> lambdaHeight() override;
 
-        std::string moveToNextShape(Shape &, double &) override;
+        bool moveToNextShape(Shape &, double &, Sink &) override;
 
-        std::string moveBackToOrigin(double &) override;
+        void moveBackToOrigin(double &, Sink &) override;
+
+        void moveToNextShape(Shape &, double &, LayoutBuilder &) override;
+
+        void moveBackToOrigin(double &, LayoutBuilder &) override;
 
     private:
 
@@ -112,8 +224,15 @@ namespace cps
     class Scaled : public Shape
     {
     public:
+        // Refers to shape without owning it; shape must outlive this.
         Scaled(Shape &shape, std::pair<double, double> scaleFactor);
 
+        Scaled(const Scaled &other);
+
+        Scaled &operator=(const Scaled &) = delete;
+
+        ~Scaled() override;
+
         double get_width() override;
 
         double get_height() override;
@@ -124,11 +243,40 @@ namespace cps
         void set_height(double) override
         {}
 
-        std::stringstream generate() override;
+        void emit(Sink &sink) override;
+
+        void visitChildren(const std::function<void(Shape &)> &visitor) override;
+
+        std::size_t get_nodeCount() override;
+
+        BoundingBox get_bounds() override;
+
+    protected:
+        std::size_t get_numChildren() override;
+
+        Shape &childAt(std::size_t index) override;
+
+        void openChildren(Sink &sink) override;
+
+        void openChildren(LayoutBuilder &builder) override;
+
+        void closeChildren(double &cursor, Sink &sink) override;
+
+        void closeChildren(double &cursor, LayoutBuilder &builder) override;
+
+        CompoundShape *pendingMetrics() override;
+
+        CompoundShape *pendingBounds() override;
 
     private:
+        friend class Shape;
+
+        // Joins the list of shapes told when the original changes.
+        void observe();
+
         Shape *_originalShape;
         std::pair<double, double> _scaleFactor;
+        Scaled *_nextObserver{nullptr};
     };
 
 }
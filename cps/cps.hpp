@@ -6,11 +6,22 @@
 
 #include <string>
 
+#include "arena.hpp"
 #include "shape.hpp"
 #include "compoundshape.hpp"
+#include "document.hpp"
+#include "flatscene.hpp"
+#include "instance.hpp"
+#include "layout.hpp"
+#include "ops.hpp"
+#include "prolog.hpp"
+#include "spatialindex.hpp"
+#include "pdf.hpp"
+#include "raster.hpp"
+#include "threadpool.hpp"
 
 namespace cps {
-    const std::string START_FILE("%!PS\n");
+    const std::string START_FILE("%!PS\n" + PROLOG);
     const std::string SHOWPAGE("showpage\n");
     const double INCH{72.0};
 }
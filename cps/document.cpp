@@ -0,0 +1,337 @@
+// document.cpp
+//
+
+#include "document.hpp"
+#include "prolog.hpp"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <system_error>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace cps
+{
+
+    namespace
+    {
+        // DSC bounding boxes are whole points that enclose every mark.
+        void writeBoundingBox(Sink &sink, const char *comment, const BoundingBox &box)
+        {
+            sink << comment << ' '
+                 << static_cast<long long>(std::floor(box.left)) << ' '
+                 << static_cast<long long>(std::floor(box.bottom)) << ' '
+                 << static_cast<long long>(std::ceil(box.right)) << ' '
+                 << static_cast<long long>(std::ceil(box.top)) << '\n';
+        }
+    }
+
+    // OutputFile Class
+    OutputFile::OutputFile(const std::string &path)
+            : _fd{::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666)}, _sink(_fd)
+    {
+        if (_fd < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "cps::OutputFile " + path);
+        }
+    }
+
+    OutputFile::~OutputFile()
+    {
+        if (_fd >= 0)
+        {
+            try
+            {
+                _sink.flush();
+            }
+            catch (const std::system_error &)
+            {
+                // Reported by close() when it is called explicitly.
+            }
+            ::close(_fd);
+        }
+    }
+
+    Sink &OutputFile::sink()
+    {
+        return _sink;
+    }
+
+    void OutputFile::close()
+    {
+        if (_fd < 0)
+        {
+            return;
+        }
+        _sink.flush();
+        auto fd = _fd;
+        _fd = -1;
+        if (::close(fd) != 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "cps::OutputFile");
+        }
+    }
+
+    // Document Class
+    Document::Document(const std::string &path)
+            : _file(std::make_unique<OutputFile>(path)), _output(_file->sink())
+    {
+        writeHeader();
+    }
+
+    Document::Document(Sink &sink)
+            : _output(sink)
+    {
+        writeHeader();
+    }
+
+    Document::~Document()
+    {
+        try
+        {
+            close();
+        }
+        catch (const std::exception &)
+        {
+            // See close().
+        }
+    }
+
+    void Document::writeHeader()
+    {
+        _output << "%!PS-Adobe-3.0\n"
+                   "%%BoundingBox: (atend)\n"
+                   "%%Pages: (atend)\n"
+                   "%%EndComments\n"
+                   "%%BeginProlog\n"
+                << PROLOG
+                << "%%EndProlog\n";
+    }
+
+    void Document::set_pageIndex(Sink &index)
+    {
+        _index = &index;
+    }
+
+    void Document::set_pageIndex(const std::string &path)
+    {
+        _indexFile = std::make_unique<OutputFile>(path);
+        _index = &_indexFile->sink();
+    }
+
+    ThreadPool *Document::get_threadPool() const
+    {
+        return _threadPool;
+    }
+
+    void Document::set_threadPool(ThreadPool *pool)
+    {
+        writePages(0);
+        _threadPool = pool;
+    }
+
+    std::size_t Document::get_pageWindow() const
+    {
+        return _pageWindow;
+    }
+
+    void Document::set_pageWindow(std::size_t window)
+    {
+        _pageWindow = window == 0 ? 1 : window;
+    }
+
+    double Document::get_resolution() const
+    {
+        return _output.get_resolution();
+    }
+
+    void Document::set_resolution(double dotsPerInch)
+    {
+        _output.set_resolution(dotsPerInch);
+    }
+
+    Sink &Document::beginPage()
+    {
+        writePages(0);
+        return openPage(nullptr);
+    }
+
+    Sink &Document::beginPage(const BoundingBox &bounds)
+    {
+        writePages(0);
+        return openPage(&bounds);
+    }
+
+    Sink &Document::openPage(const BoundingBox *bounds)
+    {
+        endPage();
+        _pageOpen = true;
+        ++_numPages;
+        _lastPage.offset = _output.get_count();
+        _output << "%%Page: " << _numPages << ' ' << _numPages << '\n';
+        if (bounds && !bounds->empty())
+        {
+            writeBoundingBox(_output, "%%PageBoundingBox:", *bounds);
+            if (_hasBounds)
+            {
+                _bounds.include(*bounds);
+            }
+            else
+            {
+                _bounds = *bounds;
+                _hasBounds = true;
+            }
+        }
+        // Each page runs inside save and restore, so the instance procedures
+        // it defines and the VM it uses do not carry over to the next page.
+        _output << "save\n";
+        return _output;
+    }
+
+    void Document::endPage()
+    {
+        if (!_pageOpen)
+        {
+            return;
+        }
+        _pageOpen = false;
+        _output << "restore\nshowpage\n";
+        _lastPage.length = _output.get_count() - _lastPage.offset;
+        if (_index)
+        {
+            writePageIndex(_lastPage);
+        }
+        _output.flush();
+    }
+
+    void Document::writePageIndex(PageOffset page)
+    {
+        char record[PAGE_INDEX_RECORD + 1];
+        std::snprintf(record, sizeof record, "%020llu %020llu\n",
+                      static_cast<unsigned long long>(page.offset), static_cast<unsigned long long>(page.length));
+        _index->write(record, PAGE_INDEX_RECORD);
+    }
+
+    void Document::addPage(Shape &shape)
+    {
+        auto bounds = shape.get_bounds();
+        auto &sink = beginPage(placeShape(bounds));
+        writeShape(shape, bounds, sink);
+        endPage();
+    }
+
+    void Document::addPage(Shape::Shape_ptr shape)
+    {
+        if (!_threadPool)
+        {
+            addPage(*shape);
+            return;
+        }
+        std::shared_ptr<Shape> page(std::move(shape));
+        auto settings = _output.get_settings();
+        queuePage([page, settings] { return renderPage(*page, settings); });
+    }
+
+    void Document::generatePage(std::function<Shape::Shape_ptr()> build)
+    {
+        if (!_threadPool)
+        {
+            addPage(*build());
+            return;
+        }
+        auto settings = _output.get_settings();
+        queuePage([build = std::move(build), settings] { return renderPage(*build(), settings); });
+    }
+
+    Document::RenderedPage Document::renderPage(Shape &shape, const Sink::Settings &settings)
+    {
+        BufferSink sink;
+        sink.set_settings(settings);
+        auto bounds = shape.get_bounds();
+        writeShape(shape, bounds, sink);
+        return {sink.release(), placeShape(bounds)};
+    }
+
+    void Document::writeShape(Shape &shape, const BoundingBox &bounds, Sink &sink)
+    {
+        InstanceDefinitions definitions;
+        definitions.write(shape, sink);
+        if (!bounds.empty())
+        {
+            auto padded = bounds;
+            padded.expand(LINE_WIDTH / 2);
+            sink << -padded.left << ' ' << -padded.bottom << " translate\n";
+        }
+        shape.emit(sink);
+    }
+
+    BoundingBox Document::placeShape(const BoundingBox &bounds)
+    {
+        if (bounds.empty())
+        {
+            return bounds;
+        }
+        auto padded = bounds;
+        padded.expand(LINE_WIDTH / 2);
+        return {0, 0, padded.right - padded.left, padded.top - padded.bottom};
+    }
+
+    void Document::queuePage(std::function<RenderedPage()> render)
+    {
+        writePages(_pageWindow - 1);
+        _pending.push_back(_threadPool->submit(std::move(render)));
+    }
+
+    void Document::writePages(std::size_t limit)
+    {
+        while (_pending.size() > limit)
+        {
+            auto result = std::move(_pending.front());
+            _pending.pop_front();
+            auto page = _threadPool->wait(result);
+            openPage(&page.bounds) << page.text;
+            endPage();
+        }
+    }
+
+    std::size_t Document::get_numPages() const
+    {
+        return _numPages;
+    }
+
+    Document::PageOffset Document::get_lastPage() const
+    {
+        return _lastPage;
+    }
+
+    void Document::close()
+    {
+        if (_closed)
+        {
+            return;
+        }
+        writePages(0);
+        _closed = true;
+        endPage();
+        _output << "%%Trailer\n";
+        // The header promised a bounding box here, so one is always given.
+        writeBoundingBox(_output, "%%BoundingBox:", _hasBounds ? _bounds : BoundingBox{});
+        _output << "%%Pages: " << _numPages << '\n'
+                << "%%EOF\n";
+        _output.flush();
+        if (_index)
+        {
+            _index->flush();
+        }
+        if (_indexFile)
+        {
+            _indexFile->close();
+        }
+        if (_file)
+        {
+            _file->close();
+        }
+    }
+
+}
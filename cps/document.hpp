@@ -0,0 +1,222 @@
+// document.hpp
+//
+// A multi-page PostScript document. The header and prolog are written once
+// when the document opens, and each page goes out to the sink and is
+// flushed as soon as it ends, so memory stays bounded by one page however
+// many pages the document has.
+//
+// Output follows the Document Structuring Conventions: the prolog is
+// bracketed, every page starts with a %%Page comment and defines whatever
+// it uses, and the trailer gives the page count and overall bounding box.
+// A spooler can therefore print any page from the prolog and that page
+// alone, and the optional page index says where each page is.
+//
+// Because pages are independent they can also be generated concurrently:
+// with a thread pool set, pages given by owning pointer or by a builder
+// are emitted on the pool into buffers of their own and stitched into the
+// output in the order they were added.
+//
+
+#ifndef CS372_CPS_DOCUMENT_H
+#define CS372_CPS_DOCUMENT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+
+#include "instance.hpp"
+#include "layout.hpp"
+#include "shape.hpp"
+#include "sink.hpp"
+#include "threadpool.hpp"
+
+namespace cps
+{
+
+    // A file a document opened itself, written through a buffered sink.
+    // Creates or truncates the file, throwing std::system_error if it
+    // cannot be opened.
+    class OutputFile
+    {
+    public:
+        explicit OutputFile(const std::string &path);
+
+        OutputFile(const OutputFile &) = delete;
+
+        OutputFile &operator=(const OutputFile &) = delete;
+
+        // Flushes and closes the file if close() has not been called,
+        // ignoring errors.
+        ~OutputFile();
+
+        Sink &sink();
+
+        // Flushes and closes the file, reporting errors as
+        // std::system_error.
+        void close();
+
+    private:
+        int _fd;
+        FileDescriptorSink _sink;
+    };
+
+    class Document
+    {
+    public:
+        // Where a page lies in the output: the offset of its %%Page comment
+        // and its length through showpage.
+        struct PageOffset
+        {
+            std::uint64_t offset;
+            std::uint64_t length;
+        };
+
+        // Each page index record is its offset and length as zero-padded
+        // 20-digit decimals separated by a space and ended by a newline, so
+        // page n (counting from 1) starts at byte (n - 1) * PAGE_INDEX_RECORD
+        // of the index.
+        static constexpr std::size_t PAGE_INDEX_RECORD = 42;
+
+        // Creates or truncates the file at path. Throws std::system_error if
+        // it cannot be opened.
+        explicit Document(const std::string &path);
+
+        // Writes into sink, which must outlive the document.
+        explicit Document(Sink &sink);
+
+        Document(const Document &) = delete;
+
+        Document &operator=(const Document &) = delete;
+
+        // Closes the document if close() has not been called.
+        ~Document();
+
+        // Writes a page index record for each page from here on to index,
+        // which must outlive the document. Call before the first page.
+        void set_pageIndex(Sink &index);
+
+        // As above, into a file the document creates and closes.
+        void set_pageIndex(const std::string &path);
+
+        // With a pool set, addPage(Shape_ptr) and generatePage() emit pages
+        // on the pool. At most get_pageWindow() of them are in flight at
+        // once, which bounds memory; adding another first writes out the
+        // oldest, helping the pool while it waits. Exceptions from a page
+        // surface when that page is written. The pool must outlive the
+        // document. Null (the default) emits every page as it is added.
+        // Pages on the pool may share instance definitions, which are
+        // only read, but no other shape: shapes fill their caches on
+        // first use.
+        ThreadPool *get_threadPool() const;
+
+        // Writes out every page in flight first.
+        void set_threadPool(ThreadPool *pool);
+
+        static constexpr std::size_t DEFAULT_PAGE_WINDOW = 64;
+
+        std::size_t get_pageWindow() const;
+
+        void set_pageWindow(std::size_t window);
+
+        // The device resolution pages from here on are simplified for; see
+        // Sink::set_resolution. Starts out as the resolution of the sink
+        // the document writes into, or zero for a file.
+        double get_resolution() const;
+
+        void set_resolution(double dotsPerInch);
+
+        // Starts a page, ending the current one if any, and returns the sink
+        // its contents go to, which run between save and restore and must
+        // leave the operand stack as they found it. Pages in flight are
+        // written first.
+        Sink &beginPage();
+
+        // As above, for a page whose marks fall within bounds. Only pages
+        // begun with bounds count towards the document's bounding box.
+        Sink &beginPage(const BoundingBox &bounds);
+
+        // Ends the current page with restore and showpage and flushes it.
+        void endPage();
+
+        // Emits shape as a page of its own, moved up and right so its marks,
+        // strokes included, start at the corner of its %%PageBoundingBox
+        // rather than around the origin. Instance procedures the shape calls
+        // are defined at the top of the page. Pages in flight are written
+        // first.
+        void addPage(Shape &shape);
+
+        // As above, taking the shape over so it can be emitted on the pool.
+        void addPage(Shape::Shape_ptr shape);
+
+        // Adds the page build returns. With a pool, build runs on the pool
+        // too, so building pages is spread across it along with emitting
+        // them.
+        void generatePage(std::function<Shape::Shape_ptr()> build);
+
+        // The pages written so far, not counting pages in flight.
+        std::size_t get_numPages() const;
+
+        // Where the most recently ended page lies in the output.
+        PageOffset get_lastPage() const;
+
+        // Ends any open page, writes the trailer, flushes the output and
+        // closes any files the document opened; errors are reported as
+        // std::system_error. Nothing may be added afterwards. The trailer
+        // bounding box is 0 0 0 0 when no page had bounds.
+        //
+        // The destructor closes too, but cannot report errors, so call
+        // close() to see them. The same goes for every other writer here
+        // that closes or flushes on destruction.
+        void close();
+
+    private:
+        // A page emitted on the pool, waiting to be written.
+        struct RenderedPage
+        {
+            std::string text;
+            BoundingBox bounds;
+        };
+
+        static RenderedPage renderPage(Shape &shape, const Sink::Settings &settings);
+
+        // Writes shape's instance definitions and the shape itself, moved to
+        // sit in the page box placeShape returns for it.
+        static void writeShape(Shape &shape, const BoundingBox &bounds, Sink &sink);
+
+        // The page box for a shape with the given bounds, once moved into
+        // place.
+        static BoundingBox placeShape(const BoundingBox &bounds);
+
+        void writeHeader();
+
+        void writePageIndex(PageOffset page);
+
+        Sink &openPage(const BoundingBox *bounds);
+
+        void queuePage(std::function<RenderedPage()> render);
+
+        // Writes the oldest pages in flight until at most limit remain.
+        void writePages(std::size_t limit);
+
+        std::unique_ptr<OutputFile> _file;
+        CountingSink _output;
+        std::unique_ptr<OutputFile> _indexFile;
+        Sink *_index{nullptr};
+        ThreadPool *_threadPool{nullptr};
+        std::size_t _pageWindow{DEFAULT_PAGE_WINDOW};
+        std::deque<std::future<RenderedPage>> _pending{};
+        std::size_t _numPages{0};
+        PageOffset _lastPage{0, 0};
+        BoundingBox _bounds{};
+        bool _hasBounds{false};
+        bool _pageOpen{false};
+        bool _closed{false};
+    };
+
+}
+
+#endif //CS372_CPS_DOCUMENT_H
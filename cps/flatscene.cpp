@@ -0,0 +1,250 @@
+// flatscene.cpp
+//
+
+#include "flatscene.hpp"
+
+#include <algorithm>
+#include <type_traits>
+
+namespace cps::flat
+{
+
+    NodeId Scene::add(Node node, std::pair<double, double> size)
+    {
+        auto id = static_cast<NodeId>(_nodes.size());
+        _nodes.push_back(node);
+        _widths.push_back(size.first);
+        _heights.push_back(size.second);
+        return id;
+    }
+
+    NodeId Scene::circle(double radius)
+    {
+        return add(Circle{radius}, {radius * 2, radius * 2});
+    }
+
+    NodeId Scene::rectangle(double width, double height)
+    {
+        return add(Rectangle{width, height}, {width, height});
+    }
+
+    NodeId Scene::polygon(int numSides, double sideLength)
+    {
+        return add(Polygon{numSides, sideLength}, polygonSize(numSides, sideLength));
+    }
+
+    NodeId Scene::square(double sideLength)
+    {
+        return polygon(4, sideLength);
+    }
+
+    NodeId Scene::triangle(double sideLength)
+    {
+        return polygon(3, sideLength);
+    }
+
+    NodeId Scene::spacer(double width, double height)
+    {
+        return add(Spacer{width, height}, {width, height});
+    }
+
+    NodeId Scene::skyline(const std::vector<Building> &buildings, bool outline)
+    {
+        auto first = _buildings.size();
+        for (const auto &building : buildings)
+        {
+            _buildings.push_back(building);
+        }
+        return addSkyline(first, buildings.size(), outline);
+    }
+
+    NodeId Scene::skyline(std::size_t numBuildings, std::uint64_t seed, bool outline)
+    {
+        auto first = _buildings.size();
+        _buildings.resize(first + numBuildings);
+        generateBuildings(seed, 0, _buildings, first, numBuildings);
+        return addSkyline(first, numBuildings, outline);
+    }
+
+    NodeId Scene::addSkyline(std::size_t first, std::size_t numBuildings, bool outline)
+    {
+        auto buildings = _buildings.columns(first, numBuildings);
+        auto outlineIndex = static_cast<std::uint32_t>(_outlines.size());
+        if (outline)
+        {
+            _outlines.push_back(skylineOutline(buildings));
+        }
+        return add(Skyline{static_cast<std::uint32_t>(first), static_cast<std::uint32_t>(numBuildings), outline,
+                           outlineIndex},
+                   skylineSize(buildings));
+    }
+
+    NodeId Scene::rotated(NodeId child, int degrees)
+    {
+        auto size = std::make_pair(_widths[child], _heights[child]);
+        if (degrees == 90 || degrees == 270)
+        {
+            std::swap(size.first, size.second);
+        }
+        return add(Rotated{child, degrees}, size);
+    }
+
+    NodeId Scene::scaled(NodeId child, std::pair<double, double> scaleFactor)
+    {
+        return add(Scaled{child, scaleFactor.first, scaleFactor.second}, {_widths[child], _heights[child]});
+    }
+
+    NodeId Scene::layered(const std::vector<NodeId> &children)
+    {
+        return compound(Stacking::Layered, children);
+    }
+
+    NodeId Scene::horizontal(const std::vector<NodeId> &children)
+    {
+        return compound(Stacking::Horizontal, children);
+    }
+
+    NodeId Scene::vertical(const std::vector<NodeId> &children)
+    {
+        return compound(Stacking::Vertical, children);
+    }
+
+    NodeId Scene::compound(Stacking stacking, const std::vector<NodeId> &children)
+    {
+        auto width = 0.0;
+        auto height = 0.0;
+        for (auto child : children)
+        {
+            auto childWidth = _widths[child];
+            auto childHeight = _heights[child];
+            width = stacking == Stacking::Horizontal ? width + childWidth : std::max(width, childWidth);
+            height = stacking == Stacking::Vertical ? height + childHeight : std::max(height, childHeight);
+        }
+        auto first = static_cast<std::uint32_t>(_children.size());
+        _children.insert(_children.end(), children.begin(), children.end());
+        return add(Compound{stacking, first, static_cast<std::uint32_t>(children.size())}, {width, height});
+    }
+
+    const Node &Scene::node(NodeId id) const
+    {
+        return _nodes[id];
+    }
+
+    std::size_t Scene::size() const
+    {
+        return _nodes.size();
+    }
+
+    double Scene::get_width(NodeId id) const
+    {
+        return _widths[id];
+    }
+
+    double Scene::get_height(NodeId id) const
+    {
+        return _heights[id];
+    }
+
+    void Scene::reserve(std::size_t nodes)
+    {
+        _nodes.reserve(nodes);
+        _widths.reserve(nodes);
+        _heights.reserve(nodes);
+        _children.reserve(nodes);
+    }
+
+    void Scene::emit(NodeId root, Sink &sink) const
+    {
+        std::visit([&](const auto &node) {
+            using Kind = std::decay_t<decltype(node)>;
+            if constexpr (std::is_same_v<Kind, Circle>)
+            {
+                writeCircle(sink, node.radius);
+            }
+            else if constexpr (std::is_same_v<Kind, Rectangle>)
+            {
+                writeRectangle(sink, node.width, node.height);
+            }
+            else if constexpr (std::is_same_v<Kind, Polygon>)
+            {
+                writePolygon(sink, node.numSides, node.sideLength, _widths[root], _heights[root]);
+            }
+            else if constexpr (std::is_same_v<Kind, Spacer>)
+            {
+                writeSpacer(sink, node.width, node.height);
+            }
+            else if constexpr (std::is_same_v<Kind, Skyline>)
+            {
+                if (node.outline)
+                {
+                    writeSkylineOutline(sink, _widths[root], _heights[root], _outlines[node.outlineIndex]);
+                }
+                else
+                {
+                    writeSkyline(sink, _widths[root], _heights[root],
+                                 _buildings.columns(node.firstBuilding, node.numBuildings));
+                }
+            }
+            else if constexpr (std::is_same_v<Kind, Rotated>)
+            {
+                sink << "gsave\n" << node.degrees << " rotate\n";
+                emit(node.child, sink);
+                sink << "grestore\n";
+            }
+            else if constexpr (std::is_same_v<Kind, Scaled>)
+            {
+                sink << "gsave\n" << node.x << " " << node.y << " scale\n";
+                sink.pushScale(node.x, node.y);
+                emit(node.child, sink);
+                sink.popScale();
+                sink << "grestore\n";
+            }
+            else
+            {
+                // Mirrors CompoundShape::emit and the moveToNextShape and
+                // moveBackToOrigin overrides.
+                auto relativeCurrentPoint = 0.0;
+                auto moveToNextShape = [&](NodeId child) {
+                    if (node.stacking == Stacking::Horizontal)
+                    {
+                        relativeCurrentPoint += _widths[child] / 2;
+                        sink << _widths[child] / 2 << " 0 translate\n";
+                    }
+                    else if (node.stacking == Stacking::Vertical)
+                    {
+                        relativeCurrentPoint += _heights[child] / 2;
+                        sink << "0 " << _heights[child] / 2 << " translate\n";
+                    }
+                };
+                auto first = _children.data() + node.firstChild;
+                auto last = first + node.numChildren;
+                for (auto child = first; child != last; ++child)
+                {
+                    if (child != first && node.stacking != Stacking::Layered)
+                    {
+                        moveToNextShape(*child);
+                        sink << '\n';
+                    }
+                    emit(*child, sink);
+                    sink << '\n';
+                    if (child + 1 != last)
+                    {
+                        moveToNextShape(*child);
+                    }
+                }
+                if (node.numChildren > 1)
+                {
+                    if (node.stacking == Stacking::Horizontal)
+                    {
+                        sink << -relativeCurrentPoint << " 0 translate\n";
+                    }
+                    else if (node.stacking == Stacking::Vertical)
+                    {
+                        sink << "0 " << -relativeCurrentPoint << " translate\n";
+                    }
+                }
+            }
+        }, _nodes[root]);
+    }
+
+}
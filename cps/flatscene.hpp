@@ -0,0 +1,154 @@
+// flatscene.hpp
+//
+// A value-semantic alternative to the Shape class hierarchy. Every node
+// kind is a plain struct in one std::variant, nodes live contiguously in a
+// single vector and are processed with std::visit, so sizing and emission
+// involve no virtual calls and no per-node heap allocation. Output is the
+// same text the equivalent Shape tree generates.
+//
+// Nodes are created children first, so a parent always has a larger id
+// than its children and sizes are computed once, as nodes are added.
+//
+
+#ifndef CS372_CPS_FLATSCENE_H
+#define CS372_CPS_FLATSCENE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <utility> // pair
+#include <variant>
+#include <vector>
+
+#include "primitives.hpp"
+#include "sink.hpp"
+
+namespace cps::flat
+{
+
+    using NodeId = std::uint32_t;
+
+    struct Circle
+    {
+        double radius;
+    };
+
+    struct Rectangle
+    {
+        double width;
+        double height;
+    };
+
+    struct Polygon
+    {
+        int numSides;
+        double sideLength;
+    };
+
+    struct Spacer
+    {
+        double width;
+        double height;
+    };
+
+    struct Skyline
+    {
+        std::uint32_t firstBuilding;
+        std::uint32_t numBuildings;
+        bool outline;
+        // The scene's merged envelope for this skyline, when outline is set.
+        std::uint32_t outlineIndex;
+    };
+
+    struct Rotated
+    {
+        NodeId child;
+        int degrees;
+    };
+
+    struct Scaled
+    {
+        NodeId child;
+        double x;
+        double y;
+    };
+
+    enum class Stacking
+    {
+        Layered,
+        Horizontal,
+        Vertical
+    };
+
+    struct Compound
+    {
+        Stacking stacking;
+        std::uint32_t firstChild;
+        std::uint32_t numChildren;
+    };
+
+    using Node = std::variant<Circle, Rectangle, Polygon, Spacer, Skyline, Rotated, Scaled, Compound>;
+
+    class Scene
+    {
+    public:
+        NodeId circle(double radius);
+
+        NodeId rectangle(double width, double height);
+
+        NodeId polygon(int numSides, double sideLength);
+
+        NodeId square(double sideLength);
+
+        NodeId triangle(double sideLength);
+
+        NodeId spacer(double width, double height);
+
+        NodeId skyline(const std::vector<Building> &buildings, bool outline = false);
+
+        // Generates the buildings in place; matches cps::Skyline with the
+        // same seed.
+        NodeId skyline(std::size_t numBuildings, std::uint64_t seed, bool outline = false);
+
+        NodeId rotated(NodeId child, int degrees);
+
+        NodeId scaled(NodeId child, std::pair<double, double> scaleFactor);
+
+        NodeId layered(const std::vector<NodeId> &children);
+
+        NodeId horizontal(const std::vector<NodeId> &children);
+
+        NodeId vertical(const std::vector<NodeId> &children);
+
+        const Node &node(NodeId id) const;
+
+        std::size_t size() const;
+
+        double get_width(NodeId id) const;
+
+        double get_height(NodeId id) const;
+
+        void emit(NodeId root, Sink &sink) const;
+
+        void reserve(std::size_t nodes);
+
+    private:
+        NodeId add(Node node, std::pair<double, double> size);
+
+        NodeId compound(Stacking stacking, const std::vector<NodeId> &children);
+
+        // Adds the skyline over buildings already in _buildings, merging its
+        // outline once here rather than on every emit.
+        NodeId addSkyline(std::size_t first, std::size_t numBuildings, bool outline);
+
+        std::vector<Node> _nodes{};
+        std::vector<double> _widths{};
+        std::vector<double> _heights{};
+        std::vector<NodeId> _children{};
+        Buildings _buildings{};
+        std::vector<std::vector<OutlinePoint>> _outlines{};
+    };
+
+}
+
+#endif //CS372_CPS_FLATSCENE_H
@@ -0,0 +1,29 @@
+// format.cpp
+//
+
+#include "format.hpp"
+
+#include <charconv>
+
+namespace cps
+{
+
+    char *formatNumber(char *first, char *last, double value, NumberFormat format)
+    {
+        auto result = format == NumberFormat::Fixed
+                      ? std::to_chars(first, last, value, std::chars_format::fixed, 6)
+                      : std::to_chars(first, last, value);
+        return result.ptr;
+    }
+
+    char *formatInteger(char *first, char *last, long long value)
+    {
+        return std::to_chars(first, last, value).ptr;
+    }
+
+    char *formatInteger(char *first, char *last, unsigned long long value)
+    {
+        return std::to_chars(first, last, value).ptr;
+    }
+
+}
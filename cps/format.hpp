@@ -0,0 +1,36 @@
+// format.hpp
+//
+// Locale-independent number formatting for PostScript operands. Numbers are
+// written with std::to_chars straight into a caller-provided buffer, so no
+// strings are allocated and a comma decimal separator can never leak into
+// the output.
+//
+
+#ifndef CS372_CPS_FORMAT_H
+#define CS372_CPS_FORMAT_H
+
+#include <cstddef>
+
+namespace cps
+{
+
+    enum class NumberFormat
+    {
+        Fixed,   // six decimal places, the same text std::to_string produces
+        Shortest // shortest text that reads back to the same double
+    };
+
+    // Large enough for any finite double in either format.
+    constexpr std::size_t MAX_NUMBER_LENGTH = 328;
+
+    // Writes value into [first, last) and returns one past the last character
+    // written. The range must hold at least MAX_NUMBER_LENGTH characters.
+    char *formatNumber(char *first, char *last, double value, NumberFormat format = NumberFormat::Fixed);
+
+    char *formatInteger(char *first, char *last, long long value);
+
+    char *formatInteger(char *first, char *last, unsigned long long value);
+
+}
+
+#endif //CS372_CPS_FORMAT_H
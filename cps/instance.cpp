@@ -0,0 +1,116 @@
+// instance.cpp
+//
+
+#include "instance.hpp"
+#include "layout.hpp"
+
+#include <atomic>
+#include <vector>
+
+namespace cps
+{
+
+    // Instance Class
+    Instance::Definition_ptr Instance::define(Shape_ptr shape)
+    {
+        static std::atomic<unsigned long> definitionCount{0};
+        auto number = ++definitionCount;
+        // Compounds fill their caches on first use. Filling them here, before
+        // the definition is shared, leaves instances on different threads
+        // only reading it.
+        shape->get_width();
+        shape->get_height();
+        shape->get_bounds();
+        return std::make_shared<const Definition>(Definition{"cpsInstance" + std::to_string(number), std::move(shape)});
+    }
+
+    Instance::Instance(Definition_ptr definition)
+            : _definition{std::move(definition)}
+    {}
+
+    double Instance::get_width()
+    {
+        return _definition->shape->get_width();
+    }
+
+    double Instance::get_height()
+    {
+        return _definition->shape->get_height();
+    }
+
+    BoundingBox Instance::get_bounds()
+    {
+        return _definition->shape->get_bounds();
+    }
+
+    std::pair<double, double> Instance::get_drift()
+    {
+        return _definition->shape->get_drift();
+    }
+
+    void Instance::emit(Sink &sink)
+    {
+        sink << _definition->name << "\n";
+    }
+
+    void Instance::layout(LayoutBuilder &builder)
+    {
+        if (!builder.get_expandInstances())
+        {
+            builder.place(*this);
+            return;
+        }
+        _definition->shape->layout(builder);
+    }
+
+    void Instance::visitChildren(const std::function<void(Shape &)> &visitor)
+    {
+        visitor(*_definition->shape);
+    }
+
+    const Instance::Definition_ptr &Instance::get_definition() const
+    {
+        return _definition;
+    }
+
+    // InstanceDefinitions Class
+    // Walks the tree from an explicit stack so depth is not limited by the
+    // call stack. Children go on in reverse so they come off in order.
+    void InstanceDefinitions::write(Shape &root, Sink &sink)
+    {
+        std::vector<Shape *> pending{&root};
+        std::vector<Shape *> children;
+        while (!pending.empty())
+        {
+            auto shape = pending.back();
+            pending.pop_back();
+            if (auto instance = dynamic_cast<Instance *>(shape))
+            {
+                write(instance->get_definition(), sink);
+                continue;
+            }
+            children.clear();
+            shape->visitChildren([&](Shape &child) { children.push_back(&child); });
+            pending.insert(pending.end(), children.rbegin(), children.rend());
+        }
+    }
+
+    void InstanceDefinitions::write(const Instance::Definition_ptr &definition, Sink &sink)
+    {
+        if (contains(definition))
+        {
+            return;
+        }
+        write(*definition->shape, sink);
+        sink << "/" << definition->name << " {\n";
+        definition->shape->emit(sink);
+        sink << "} bind def\n";
+        _written.insert(definition);
+    }
+
+    bool InstanceDefinitions::contains(const Instance::Definition_ptr &definition) const
+    {
+        return _written.count(definition) != 0;
+    }
+
+}
@@ -0,0 +1,85 @@
+// instance.hpp
+//
+// Subtree instancing. A subtree that appears many times is defined once as
+// a named PostScript procedure, and every Instance of it emits only a call
+// to that procedure.
+//
+
+#ifndef CS372_CPS_INSTANCE_H
+#define CS372_CPS_INSTANCE_H
+
+#include <memory>
+#include <string>
+#include <unordered_set>
+
+#include "shape.hpp"
+
+namespace cps
+{
+
+    class Instance : public Shape
+    {
+    public:
+        struct Definition
+        {
+            std::string name;
+            Shape_ptr shape;
+        };
+
+        using Definition_ptr = std::shared_ptr<const Definition>;
+
+        // Takes ownership of shape and gives it a procedure name unique
+        // within the program. The shape should not change after this; its
+        // sizes and bounds are worked out here, so the definition can be
+        // read from several threads at once.
+        static Definition_ptr define(Shape_ptr shape);
+
+        explicit Instance(Definition_ptr definition);
+
+        double get_width() override;
+
+        double get_height() override;
+
+        BoundingBox get_bounds() override;
+
+        std::pair<double, double> get_drift() override;
+
+        void set_width(double) override
+        {}
+
+        void set_height(double) override
+        {}
+
+        void emit(Sink &sink) override;
+
+        void layout(LayoutBuilder &builder) override;
+
+        void visitChildren(const std::function<void(Shape &)> &visitor) override;
+
+        const Definition_ptr &get_definition() const;
+
+    private:
+        Definition_ptr _definition;
+    };
+
+    // Writes the procedure for each definition once, before anything that
+    // calls it. Definitions used inside other definitions are written
+    // first. A procedure is a PostScript array, so a single definition is
+    // limited to the interpreter's array size (65535 objects on Level 2).
+    class InstanceDefinitions
+    {
+    public:
+        // Writes every definition reachable from root not written yet.
+        void write(Shape &root, Sink &sink);
+
+        void write(const Instance::Definition_ptr &definition, Sink &sink);
+
+        bool contains(const Instance::Definition_ptr &definition) const;
+
+    private:
+        std::unordered_set<Instance::Definition_ptr> _written{};
+    };
+
+}
+
+#endif //CS372_CPS_INSTANCE_H
@@ -0,0 +1,224 @@
+// layout.cpp
+//
+
+#include "layout.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace cps
+{
+
+    // Transform
+    void Transform::concat(const Transform &m)
+    {
+        Transform result;
+        result.a = m.a * a + m.b * c;
+        result.b = m.a * b + m.b * d;
+        result.c = m.c * a + m.d * c;
+        result.d = m.c * b + m.d * d;
+        result.e = m.e * a + m.f * c + e;
+        result.f = m.e * b + m.f * d + f;
+        *this = result;
+    }
+
+    void Transform::translate(double x, double y)
+    {
+        e += x * a + y * c;
+        f += x * b + y * d;
+    }
+
+    void Transform::rotate(double degrees)
+    {
+        double cosine;
+        double sine;
+        auto turns = std::fmod(degrees, 360.0);
+        if (turns < 0)
+        {
+            turns += 360.0;
+        }
+        // Keep quarter turns exact so they stay recognisable as such.
+        if (turns == 0)
+        {
+            return;
+        }
+        else if (turns == 90)
+        {
+            cosine = 0;
+            sine = 1;
+        }
+        else if (turns == 180)
+        {
+            cosine = -1;
+            sine = 0;
+        }
+        else if (turns == 270)
+        {
+            cosine = 0;
+            sine = -1;
+        }
+        else
+        {
+            auto radians = turns * std::acos(-1) / 180;
+            cosine = std::cos(radians);
+            sine = std::sin(radians);
+        }
+        concat({cosine, sine, -sine, cosine, 0, 0});
+    }
+
+    void Transform::scale(double x, double y)
+    {
+        a *= x;
+        b *= x;
+        c *= y;
+        d *= y;
+    }
+
+    bool Transform::isTranslation() const
+    {
+        return a == 1 && b == 0 && c == 0 && d == 1;
+    }
+
+    bool Transform::isIdentity() const
+    {
+        return isTranslation() && e == 0 && f == 0;
+    }
+
+    std::pair<double, double> Transform::apply(double x, double y) const
+    {
+        return {a * x + c * y + e, b * x + d * y + f};
+    }
+
+    void writeTransform(Sink &sink, const Transform &transform)
+    {
+        if (transform.isTranslation())
+        {
+            sink << transform.e << " " << transform.f << " translate\n";
+        }
+        else
+        {
+            sink << "[" << transform.a << " " << transform.b << " " << transform.c << " "
+                 << transform.d << " " << transform.e << " " << transform.f << "] concat\n";
+        }
+    }
+
+    // LayoutBuilder
+    BoundingBox transformed(const BoundingBox &box, const Transform &transform)
+    {
+        if (box.empty())
+        {
+            return box;
+        }
+        if (transform.isTranslation())
+        {
+            return {box.left + transform.e, box.bottom + transform.f, box.right + transform.e, box.top + transform.f};
+        }
+        auto corner = transform.apply(box.left, box.bottom);
+        BoundingBox result{corner.first, corner.second, corner.first, corner.second};
+        for (auto point : {transform.apply(box.right, box.bottom), transform.apply(box.left, box.top),
+                           transform.apply(box.right, box.top)})
+        {
+            result.include({point.first, point.second, point.first, point.second});
+        }
+        return result;
+    }
+
+    LayoutBuilder::LayoutBuilder(std::vector<Placement> &placements, bool expandInstances)
+            : _placements(placements), _expandInstances{expandInstances}
+    {}
+
+    bool LayoutBuilder::get_expandInstances() const
+    {
+        return _expandInstances;
+    }
+
+    void LayoutBuilder::place(Shape &leaf)
+    {
+        _placements.push_back({&leaf, _current});
+    }
+
+    void LayoutBuilder::translate(double x, double y)
+    {
+        _current.translate(x, y);
+    }
+
+    void LayoutBuilder::rotate(double degrees)
+    {
+        _current.rotate(degrees);
+    }
+
+    void LayoutBuilder::scale(double x, double y)
+    {
+        _current.scale(x, y);
+    }
+
+    void LayoutBuilder::save()
+    {
+        _saved.push_back(_current);
+    }
+
+    void LayoutBuilder::restore()
+    {
+        _current = _saved.back();
+        _saved.pop_back();
+    }
+
+    const Transform &LayoutBuilder::current() const
+    {
+        return _current;
+    }
+
+    // Layout
+    Layout::Layout(Shape &root, bool expandInstances)
+    {
+        // Bottom-up: fill every size cache before offsets are assigned.
+        root.get_width();
+        root.get_height();
+
+        // Top-down: resolve every leaf to its absolute transform.
+        LayoutBuilder builder(_placements, expandInstances);
+        root.layout(builder);
+        _finalTransform = builder.current();
+    }
+
+    const std::vector<Placement> &Layout::placements() const
+    {
+        return _placements;
+    }
+
+    const Transform &Layout::finalTransform() const
+    {
+        return _finalTransform;
+    }
+
+    void Layout::emit(Sink &sink) const
+    {
+        for (const auto &placement : _placements)
+        {
+            sink << "gsave\n";
+            if (!placement.transform.isIdentity())
+            {
+                writeTransform(sink, placement.transform);
+            }
+            // How far the transform stretches each axis, for the level of
+            // detail.
+            const auto &transform = placement.transform;
+            auto scaled = !transform.isTranslation();
+            if (scaled)
+            {
+                sink.pushScale(std::hypot(transform.a, transform.b), std::hypot(transform.c, transform.d));
+            }
+            placement.shape->emit(sink);
+            if (scaled)
+            {
+                sink.popScale();
+            }
+            sink << "grestore\n";
+        }
+        if (!_finalTransform.isIdentity())
+        {
+            writeTransform(sink, _finalTransform);
+        }
+    }
+
+}
@@ -0,0 +1,113 @@
+// layout.hpp
+//
+// Two-phase generation: a layout pass resolves every leaf shape to an
+// absolute transform in a flat table, and a separate loop emits that
+// table. Because the table is plain data it can be filtered, reordered or
+// split before anything is written.
+//
+
+#ifndef CS372_CPS_LAYOUT_H
+#define CS372_CPS_LAYOUT_H
+
+#include <utility> // pair
+#include <vector>
+
+#include "shape.hpp"
+
+namespace cps
+{
+
+    // An affine transform in PostScript matrix order [a b c d e f]:
+    // x' = a x + c y + e, y' = b x + d y + f.
+    struct Transform
+    {
+        double a{1};
+        double b{0};
+        double c{0};
+        double d{1};
+        double e{0};
+        double f{0};
+
+        // Each of these behaves like the PostScript operator of the same
+        // name applied to a current transformation matrix.
+        void concat(const Transform &m);
+
+        void translate(double x, double y);
+
+        void rotate(double degrees);
+
+        void scale(double x, double y);
+
+        bool isTranslation() const;
+
+        bool isIdentity() const;
+
+        std::pair<double, double> apply(double x, double y) const;
+    };
+
+    void writeTransform(Sink &sink, const Transform &transform);
+
+    // The smallest axis-aligned box holding box once transformed.
+    BoundingBox transformed(const BoundingBox &box, const Transform &transform);
+
+    struct Placement
+    {
+        Shape *shape;
+        Transform transform;
+    };
+
+    // Receives the layout walk. Shapes describe themselves to it through
+    // Shape::layout in the same order they would emit PostScript.
+    class LayoutBuilder
+    {
+    public:
+        explicit LayoutBuilder(std::vector<Placement> &placements, bool expandInstances = true);
+
+        // False when each Instance is to be placed as a leaf of its own
+        // rather than replaced by the leaves of its definition.
+        bool get_expandInstances() const;
+
+        void place(Shape &leaf);
+
+        void translate(double x, double y);
+
+        void rotate(double degrees);
+
+        void scale(double x, double y);
+
+        void save();
+
+        void restore();
+
+        const Transform &current() const;
+
+    private:
+        std::vector<Placement> &_placements;
+        bool _expandInstances;
+        Transform _current{};
+        std::vector<Transform> _saved{};
+    };
+
+    class Layout
+    {
+    public:
+        // Unless expandInstances is true, Instances are placed whole, for
+        // output formats that can draw them by reference.
+        explicit Layout(Shape &root, bool expandInstances = true);
+
+        const std::vector<Placement> &placements() const;
+
+        // The transform left in effect after the scene, which is not the
+        // identity when Spacers sit outside any gsave.
+        const Transform &finalTransform() const;
+
+        void emit(Sink &sink) const;
+
+    private:
+        std::vector<Placement> _placements{};
+        Transform _finalTransform{};
+    };
+
+}
+
+#endif //CS372_CPS_LAYOUT_H
@@ -0,0 +1,402 @@
+// ops.cpp
+//
+
+#include "ops.hpp"
+
+#include <charconv>
+#include <cmath>
+
+namespace cps
+{
+
+    namespace
+    {
+
+        struct Operator
+        {
+            const char *name;
+            OpCode code;
+            std::size_t operandCount;
+        };
+
+        const Operator OPERATORS[] = {
+                {"translate", OpCode::Translate, 2},
+                {"rotate",    OpCode::Rotate,    1},
+                {"scale",     OpCode::Scale,     2},
+                {"moveto",    OpCode::MoveTo,    2},
+                {"lineto",    OpCode::LineTo,    2},
+                {"rlineto",   OpCode::RLineTo,   2},
+                {"arc",       OpCode::Arc,       5},
+                {"newpath",   OpCode::NewPath,   0},
+                {"closepath", OpCode::ClosePath, 0},
+                {"stroke",    OpCode::Stroke,    0},
+                {"gsave",     OpCode::GSave,     0},
+                {"grestore",  OpCode::GRestore,  0},
+        };
+
+        const Operator *findOperator(std::string_view name)
+        {
+            for (const auto &op : OPERATORS)
+            {
+                if (name == op.name)
+                {
+                    return &op;
+                }
+            }
+            return nullptr;
+        }
+
+        const char *operatorName(const Op &op)
+        {
+            for (const auto &known : OPERATORS)
+            {
+                if (known.code == op.code)
+                {
+                    return known.name;
+                }
+            }
+            return op.name.c_str();
+        }
+
+        bool isDelimiter(char c)
+        {
+            return c == '{' || c == '}' || c == '[' || c == ']';
+        }
+
+        bool isSpace(char c)
+        {
+            return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' || c == '\0';
+        }
+
+    }
+
+    // OpStream Class
+    void OpStream::push(OpCode code, const double *operands, std::size_t count, std::string name)
+    {
+        auto first = static_cast<std::uint32_t>(_operands.size());
+        _operands.insert(_operands.end(), operands, operands + count);
+        _ops.push_back({code, first, static_cast<std::uint32_t>(count), std::move(name)});
+    }
+
+    const std::vector<Op> &OpStream::ops() const
+    {
+        return _ops;
+    }
+
+    double OpStream::operand(const Op &op, std::size_t index) const
+    {
+        return _operands[op.firstOperand + index];
+    }
+
+    bool OpStream::isNoOp(const Op &op) const
+    {
+        switch (op.code)
+        {
+            case OpCode::Translate:
+                return operand(op, 0) == 0 && operand(op, 1) == 0;
+            case OpCode::Rotate:
+                return std::fmod(operand(op, 0), 360.0) == 0;
+            case OpCode::Scale:
+                return operand(op, 0) == 1 && operand(op, 1) == 1;
+            default:
+                return false;
+        }
+    }
+
+    bool OpStream::merge(Op &into, const Op &op)
+    {
+        if (into.code != op.code)
+        {
+            return false;
+        }
+        auto target = _operands.begin() + into.firstOperand;
+        switch (op.code)
+        {
+            case OpCode::Translate:
+                // Two translates with no rotate or scale between them add up.
+                target[0] += operand(op, 0);
+                target[1] += operand(op, 1);
+                return true;
+            case OpCode::Rotate:
+                target[0] += operand(op, 0);
+                return true;
+            case OpCode::Scale:
+                target[0] *= operand(op, 0);
+                target[1] *= operand(op, 1);
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    void OpStream::optimize()
+    {
+        std::vector<Op> output;
+        output.reserve(_ops.size());
+        for (auto &op : _ops)
+        {
+            switch (op.code)
+            {
+                case OpCode::Translate:
+                case OpCode::Rotate:
+                case OpCode::Scale:
+                    if (isNoOp(op))
+                    {
+                        continue;
+                    }
+                    if (!output.empty() && merge(output.back(), op))
+                    {
+                        if (isNoOp(output.back()))
+                        {
+                            output.pop_back();
+                        }
+                        continue;
+                    }
+                    break;
+                case OpCode::MoveTo:
+                    // A moveto followed by another moveto starts nothing.
+                    if (!output.empty() && output.back().code == OpCode::MoveTo)
+                    {
+                        output.pop_back();
+                    }
+                    break;
+                case OpCode::NewPath:
+                case OpCode::Stroke:
+                    // A trailing lone moveto is a degenerate subpath: stroke
+                    // paints nothing for it and newpath discards it.
+                    while (!output.empty() && output.back().code == OpCode::MoveTo)
+                    {
+                        output.pop_back();
+                    }
+                    if (op.code == OpCode::NewPath && !output.empty() && output.back().code == OpCode::NewPath)
+                    {
+                        continue;
+                    }
+                    break;
+                case OpCode::GRestore:
+                    // grestore undoes any transform or current point set just
+                    // before it, and an empty gsave/grestore pair does nothing.
+                    while (!output.empty() && (output.back().code == OpCode::Translate
+                                               || output.back().code == OpCode::Rotate
+                                               || output.back().code == OpCode::Scale
+                                               || output.back().code == OpCode::MoveTo))
+                    {
+                        output.pop_back();
+                    }
+                    if (!output.empty() && output.back().code == OpCode::GSave)
+                    {
+                        output.pop_back();
+                        continue;
+                    }
+                    break;
+                default:
+                    break;
+            }
+            output.push_back(std::move(op));
+        }
+        _ops.swap(output);
+    }
+
+    void OpStream::writeTo(Sink &sink) const
+    {
+        for (const auto &op : _ops)
+        {
+            for (std::size_t index = 0; index < op.operandCount; ++index)
+            {
+                auto value = operand(op, index);
+                // Whole numbers, including every literal operand, print
+                // without a fraction.
+                if (value == std::trunc(value) && std::fabs(value) < 1e15)
+                {
+                    sink << static_cast<long long>(value);
+                }
+                else
+                {
+                    sink << value;
+                }
+                if (index + 1 < op.operandCount || op.code != OpCode::Other || !op.name.empty())
+                {
+                    sink << ' ';
+                }
+            }
+            sink << operatorName(op) << '\n';
+        }
+    }
+
+    void OpStream::clear()
+    {
+        _ops.clear();
+        _operands.clear();
+    }
+
+    // OpSink Class
+    void OpSink::write(const char *data, std::size_t size)
+    {
+        for (std::size_t index = 0; index < size; ++index)
+        {
+            auto c = data[index];
+            if (_inComment)
+            {
+                if (c == '\n' || c == '\r')
+                {
+                    endToken();
+                    _inComment = false;
+                }
+                else
+                {
+                    _token += c;
+                }
+            }
+            else if (_stringDepth > 0)
+            {
+                _token += c;
+                if (_escaped)
+                {
+                    _escaped = false;
+                }
+                else if (c == '\\')
+                {
+                    _escaped = true;
+                }
+                else if (c == '(')
+                {
+                    ++_stringDepth;
+                }
+                else if (c == ')' && --_stringDepth == 0)
+                {
+                    endToken();
+                }
+            }
+            else if (isSpace(c))
+            {
+                endToken();
+            }
+            else if (isDelimiter(c))
+            {
+                endToken();
+                addToken(std::string_view(&c, 1));
+            }
+            else if (c == '%' || c == '(' || c == '/')
+            {
+                endToken();
+                _token += c;
+                _inComment = c == '%';
+                _stringDepth = c == '(' ? 1 : 0;
+            }
+            else
+            {
+                _token += c;
+            }
+        }
+    }
+
+    void OpSink::writeNumber(double value)
+    {
+        endToken();
+        _pendingOperands.push_back(value);
+    }
+
+    void OpSink::flush()
+    {
+        endToken();
+        _inComment = false;
+        _stringDepth = 0;
+        if (!_pendingOperands.empty())
+        {
+            _stream.push(OpCode::Other, _pendingOperands.data(), _pendingOperands.size());
+            _pendingOperands.clear();
+        }
+    }
+
+    OpStream &OpSink::get_ops()
+    {
+        return _stream;
+    }
+
+    void OpSink::endToken()
+    {
+        if (!_token.empty())
+        {
+            addToken(_token);
+            _token.clear();
+        }
+    }
+
+    void OpSink::addToken(std::string_view token)
+    {
+        double value;
+        auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+        if (result.ec == std::errc() && result.ptr == token.data() + token.size())
+        {
+            _pendingOperands.push_back(value);
+            return;
+        }
+
+        auto pending = _pendingOperands.data();
+        auto count = _pendingOperands.size();
+        if (token.front() == '%')
+        {
+            // Comments take no operands; keep the numbers before them apart.
+            if (count > 0)
+            {
+                _stream.push(OpCode::Other, pending, count);
+                _pendingOperands.clear();
+            }
+            _stream.push(OpCode::Other, nullptr, 0, std::string(token));
+            return;
+        }
+        auto known = findOperator(token);
+        if (known && count >= known->operandCount)
+        {
+            auto extra = count - known->operandCount;
+            if (extra > 0)
+            {
+                _stream.push(OpCode::Other, pending, extra);
+            }
+            _stream.push(known->code, pending + extra, known->operandCount);
+        }
+        else
+        {
+            _stream.push(OpCode::Other, pending, count, std::string(token));
+        }
+        _pendingOperands.clear();
+    }
+
+    // PeepholeSink Class
+    PeepholeSink::PeepholeSink(Sink &target)
+            : _target(target)
+    {}
+
+    PeepholeSink::~PeepholeSink()
+    {
+        try
+        {
+            finish();
+        }
+        catch (...)
+        {
+            // Reported by finish() when it is called explicitly.
+        }
+    }
+
+    void PeepholeSink::flush()
+    {
+        writeOps();
+        _target.flush();
+    }
+
+    void PeepholeSink::finish()
+    {
+        OpSink::flush();
+        flush();
+    }
+
+    void PeepholeSink::writeOps()
+    {
+        auto &stream = get_ops();
+        stream.optimize();
+        stream.writeTo(_target);
+        stream.clear();
+    }
+
+}
@@ -0,0 +1,129 @@
+// ops.hpp
+//
+// A typed PostScript operation stream. OpSink turns whatever shapes write
+// into Ops, with numbers kept as doubles, so a peephole pass can rewrite
+// the stream before it is serialized.
+//
+
+#ifndef CS372_CPS_OPS_H
+#define CS372_CPS_OPS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "sink.hpp"
+
+namespace cps
+{
+
+    enum class OpCode
+    {
+        Translate,
+        Rotate,
+        Scale,
+        MoveTo,
+        LineTo,
+        RLineTo,
+        Arc,
+        NewPath,
+        ClosePath,
+        Stroke,
+        GSave,
+        GRestore,
+        Other // any other token, kept as text together with its operands
+    };
+
+    struct Op
+    {
+        OpCode code;
+        std::uint32_t firstOperand;
+        std::uint32_t operandCount;
+        std::string name;
+    };
+
+    class OpStream
+    {
+    public:
+        // Appends an operator together with the operands that precede it.
+        void push(OpCode code, const double *operands, std::size_t count, std::string name = {});
+
+        const std::vector<Op> &ops() const;
+
+        double operand(const Op &op, std::size_t index) const;
+
+        // Merges adjacent translates, rotates and scales, drops ones with
+        // no effect, drops movetos that start no drawing, and removes
+        // gsave/grestore pairs with nothing between them.
+        void optimize();
+
+        void writeTo(Sink &sink) const;
+
+        void clear();
+
+    private:
+        bool isNoOp(const Op &op) const;
+
+        bool merge(Op &into, const Op &op);
+
+        std::vector<Op> _ops{};
+        std::vector<double> _operands{};
+    };
+
+    // Builds an OpStream from the text and numbers written into it.
+    class OpSink : public Sink
+    {
+    public:
+        void write(const char *data, std::size_t size) override;
+
+        void writeNumber(double value) override;
+
+        // Completes any token still being read.
+        void flush() override;
+
+        OpStream &get_ops();
+
+    private:
+        void endToken();
+
+        void addToken(std::string_view token);
+
+        OpStream _stream{};
+        std::vector<double> _pendingOperands{};
+        std::string _token{};
+        int _stringDepth{0};
+        bool _escaped{false};
+        bool _inComment{false};
+    };
+
+    // Optimizes everything written into it and passes the result to target.
+    // A flush optimizes and passes on every operator written so far, and
+    // holds back only a token, or operands, still waiting for the rest of
+    // an operator. Optimizations never span a flush: translates on either
+    // side of one are not merged. Finish before target goes away.
+    class PeepholeSink : public OpSink
+    {
+    public:
+        explicit PeepholeSink(Sink &target);
+
+        PeepholeSink(const PeepholeSink &) = delete;
+
+        PeepholeSink &operator=(const PeepholeSink &) = delete;
+
+        ~PeepholeSink() override;
+
+        void flush() override;
+
+        // Completes whatever is held back, then flushes.
+        void finish();
+
+    private:
+        void writeOps();
+
+        Sink &_target;
+    };
+
+}
+
+#endif //CS372_CPS_OPS_H
@@ -0,0 +1,98 @@
+// path.cpp
+//
+
+#include "path.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace cps
+{
+
+    namespace
+    {
+        // Bounds on the segments in a flattened circle. Without a pixel size
+        // circles get the most, which looks smooth at any size.
+        constexpr int MIN_CIRCLE_SEGMENTS = 8;
+        constexpr int MAX_CIRCLE_SEGMENTS = 256;
+    }
+
+    // Path Class
+    double Path::get_pixelSize() const
+    {
+        return _pixelSize;
+    }
+
+    void Path::set_pixelSize(double size)
+    {
+        _pixelSize = size;
+    }
+
+    void Path::moveTo(double x, double y)
+    {
+        _subpaths.push_back({_points.size(), 1, false});
+        _points.push_back({x, y});
+    }
+
+    void Path::lineTo(double x, double y)
+    {
+        if (_subpaths.empty() || _subpaths.back().closed)
+        {
+            moveTo(x, y);
+            return;
+        }
+        _points.push_back({x, y});
+        ++_subpaths.back().count;
+    }
+
+    void Path::closePath()
+    {
+        if (!_subpaths.empty())
+        {
+            _subpaths.back().closed = true;
+        }
+    }
+
+    // A chord of angle t misses the arc by r (1 - cos(t / 2)), which sets
+    // the largest angle that stays within a quarter pixel.
+    void Path::circle(double x, double y, double radius)
+    {
+        const double pi = std::acos(-1);
+        auto segments = MAX_CIRCLE_SEGMENTS;
+        auto tolerance = _pixelSize / 4;
+        if (tolerance > 0 && tolerance < radius)
+        {
+            auto angle = 2 * std::acos(1 - tolerance / radius);
+            segments = std::clamp(static_cast<int>(std::ceil(2 * pi / angle)), MIN_CIRCLE_SEGMENTS,
+                                  MAX_CIRCLE_SEGMENTS);
+        }
+        else if (tolerance > 0)
+        {
+            segments = MIN_CIRCLE_SEGMENTS;
+        }
+        moveTo(x + radius, y);
+        for (auto segment = 1; segment < segments; ++segment)
+        {
+            auto angle = 2 * pi * segment / segments;
+            lineTo(x + radius * std::cos(angle), y + radius * std::sin(angle));
+        }
+        closePath();
+    }
+
+    void Path::clear()
+    {
+        _points.clear();
+        _subpaths.clear();
+    }
+
+    const std::vector<Path::Point> &Path::points() const
+    {
+        return _points;
+    }
+
+    const std::vector<Path::Subpath> &Path::subpaths() const
+    {
+        return _subpaths;
+    }
+
+}
@@ -0,0 +1,66 @@
+// path.hpp
+//
+// Leaf outlines as plain polylines, for drawing shapes without any page
+// description language in between (see raster.hpp). Curves are flattened
+// as they are added, finely enough that the error stays under a quarter
+// of the pixel size the path is traced for.
+//
+
+#ifndef CS372_CPS_PATH_H
+#define CS372_CPS_PATH_H
+
+#include <cstddef>
+#include <vector>
+
+namespace cps
+{
+
+    class Path
+    {
+    public:
+        struct Point
+        {
+            double x;
+            double y;
+        };
+
+        // A run of points drawn as one connected line; a closed subpath
+        // joins its last point back to its first.
+        struct Subpath
+        {
+            std::size_t first;
+            std::size_t count;
+            bool closed;
+        };
+
+        // The size of a device pixel in the units the path is traced in, or
+        // 0 for no device. Leaves simplify detail below it as they do when
+        // emitting (see Sink::get_pixelSize).
+        double get_pixelSize() const;
+
+        void set_pixelSize(double size);
+
+        void moveTo(double x, double y);
+
+        void lineTo(double x, double y);
+
+        void closePath();
+
+        // A full circle as its own closed subpath.
+        void circle(double x, double y, double radius);
+
+        void clear();
+
+        const std::vector<Point> &points() const;
+
+        const std::vector<Subpath> &subpaths() const;
+
+    private:
+        std::vector<Point> _points{};
+        std::vector<Subpath> _subpaths{};
+        double _pixelSize{0};
+    };
+
+}
+
+#endif //CS372_CPS_PATH_H
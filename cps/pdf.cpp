@@ -0,0 +1,278 @@
+// pdf.cpp
+//
+
+#include "pdf.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace cps
+{
+
+    namespace
+    {
+        void writeBox(Sink &sink, const BoundingBox &box)
+        {
+            sink << "[" << box.left << " " << box.bottom << " " << box.right << " " << box.top << "]";
+        }
+
+        std::string reference(std::uint32_t object)
+        {
+            return std::to_string(object) + " 0 R";
+        }
+    }
+
+    // PdfDocument Class
+    PdfDocument::PdfDocument(const std::string &path)
+            : _file(std::make_unique<OutputFile>(path)), _output(_file->sink())
+    {
+        writeHeader();
+    }
+
+    PdfDocument::PdfDocument(Sink &sink)
+            : _output(sink)
+    {
+        writeHeader();
+    }
+
+    void PdfDocument::writeHeader()
+    {
+        _output.set_numberFormat(NumberFormat::Fixed);
+        // The comment of high bytes marks the file as binary for transfer
+        // programs.
+        _output << "%PDF-1.4\n%\xE2\xE3\xCF\xD3\n";
+        _offsets.resize(PAGE_TREE, 0);
+    }
+
+    PdfDocument::~PdfDocument()
+    {
+        try
+        {
+            close();
+        }
+        catch (const std::exception &)
+        {
+            // See Document::close().
+        }
+    }
+
+    double PdfDocument::get_resolution() const
+    {
+        return _output.get_resolution();
+    }
+
+    void PdfDocument::set_resolution(double dotsPerInch)
+    {
+        _output.set_resolution(dotsPerInch);
+    }
+
+    std::uint32_t PdfDocument::reserveObject()
+    {
+        _offsets.push_back(0);
+        return static_cast<std::uint32_t>(_offsets.size());
+    }
+
+    void PdfDocument::beginObject(std::uint32_t object)
+    {
+        _offsets[object - 1] = _output.get_count();
+        _output << object << " 0 obj\n";
+    }
+
+    void PdfDocument::writeStream(std::uint32_t object, const std::string &dictionary, const std::string &content)
+    {
+        beginObject(object);
+        _output << "<< " << dictionary << "/Length " << content.size() << " >>\n"
+                << "stream\n" << content << "\nendstream\n"
+                << "endobj\n";
+    }
+
+    // Every leaf is drawn under its own transform and graphics state, just
+    // as Layout::emit does for PostScript.
+    void PdfDocument::writeContent(Shape &root, Sink &sink, Forms &forms)
+    {
+        Layout layout(root, false);
+        for (const auto &placement : layout.placements())
+        {
+            const auto &transform = placement.transform;
+            sink << "q\n";
+            auto scaled = !transform.isTranslation();
+            if (!scaled && !transform.isIdentity())
+            {
+                sink << "1 0 0 1 " << transform.e << " " << transform.f << " cm\n";
+            }
+            else if (scaled)
+            {
+                sink << transform.a << " " << transform.b << " " << transform.c << " " << transform.d << " "
+                     << transform.e << " " << transform.f << " cm\n";
+            }
+            if (scaled)
+            {
+                sink.pushScale(std::hypot(transform.a, transform.b), std::hypot(transform.c, transform.d));
+            }
+            if (auto instance = dynamic_cast<Instance *>(placement.shape))
+            {
+                const auto &definition = instance->get_definition();
+                sink << "/" << definition->name << " Do\n";
+                if (std::find(forms.begin(), forms.end(), definition) == forms.end())
+                {
+                    forms.push_back(definition);
+                }
+            }
+            else
+            {
+                placement.shape->emitPdf(sink);
+            }
+            if (scaled)
+            {
+                sink.popScale();
+            }
+            sink << "Q\n";
+        }
+    }
+
+    std::string PdfDocument::resources(const Forms &forms) const
+    {
+        if (forms.empty())
+        {
+            return "/Resources << >> ";
+        }
+        std::string text = "/Resources << /XObject << ";
+        for (const auto &definition : forms)
+        {
+            text += "/" + definition->name + " " + reference(_forms.at(definition)) + " ";
+        }
+        return text + ">> >> ";
+    }
+
+    // Forms come out after the forms they draw, which is how a depth-first
+    // walk over the definitions finishes them. A definition whose forms are
+    // not written yet waits on the stack until they are.
+    void PdfDocument::writeForms(const Forms &forms)
+    {
+        Forms pending(forms.rbegin(), forms.rend());
+        while (!pending.empty())
+        {
+            auto definition = pending.back();
+            if (_forms.count(definition) != 0)
+            {
+                pending.pop_back();
+                continue;
+            }
+            BufferSink content;
+            content.set_settings(_output.get_settings());
+            Forms drawn;
+            writeContent(*definition->shape, content, drawn);
+            auto ready = true;
+            for (auto form = drawn.rbegin(); form != drawn.rend(); ++form)
+            {
+                if (_forms.count(*form) == 0)
+                {
+                    pending.push_back(*form);
+                    ready = false;
+                }
+            }
+            if (!ready)
+            {
+                continue;
+            }
+            pending.pop_back();
+
+            // Forms clip to their box, so it takes in the outer half of the
+            // strokes along the edges.
+            auto bounds = definition->shape->get_bounds();
+            if (bounds.empty())
+            {
+                bounds = {0, 0, 0, 0};
+            }
+            bounds.expand(LINE_WIDTH / 2);
+            BufferSink dictionary;
+            dictionary << "/Type /XObject /Subtype /Form /BBox ";
+            writeBox(dictionary, bounds);
+            dictionary << " " << resources(drawn);
+            auto object = reserveObject();
+            writeStream(object, dictionary.str(), content.str());
+            _forms.emplace(definition, object);
+        }
+    }
+
+    void PdfDocument::addPage(Shape &shape)
+    {
+        auto bounds = shape.get_bounds();
+        if (bounds.empty())
+        {
+            bounds = {0, 0, DEFAULT_PAGE_WIDTH, DEFAULT_PAGE_HEIGHT};
+        }
+        else
+        {
+            bounds.expand(LINE_WIDTH / 2);
+        }
+        addPage(shape, bounds);
+    }
+
+    void PdfDocument::addPage(Shape &shape, const BoundingBox &mediaBox)
+    {
+        BufferSink content;
+        content.set_settings(_output.get_settings());
+        Forms forms;
+        writeContent(shape, content, forms);
+        writeForms(forms);
+
+        auto contents = reserveObject();
+        writeStream(contents, "", content.str());
+        auto page = reserveObject();
+        beginObject(page);
+        _output << "<< /Type /Page /Parent " << reference(PAGE_TREE) << " /MediaBox ";
+        writeBox(_output, mediaBox);
+        _output << " " << resources(forms) << "/Contents " << reference(contents) << " >>\n"
+                << "endobj\n";
+        _pages.push_back(page);
+        _output.flush();
+    }
+
+    std::size_t PdfDocument::get_numPages() const
+    {
+        return _pages.size();
+    }
+
+    void PdfDocument::close()
+    {
+        if (_closed)
+        {
+            return;
+        }
+        _closed = true;
+        beginObject(PAGE_TREE);
+        _output << "<< /Type /Pages /Kids [";
+        for (auto page : _pages)
+        {
+            _output << " " << reference(page);
+        }
+        _output << " ] /Count " << _pages.size() << " >>\n"
+                << "endobj\n";
+        beginObject(CATALOG);
+        _output << "<< /Type /Catalog /Pages " << reference(PAGE_TREE) << " >>\n"
+                << "endobj\n";
+
+        // Every entry is exactly 20 bytes, so entry n sits at a known place.
+        auto table = _output.get_count();
+        _output << "xref\n0 " << _offsets.size() + 1 << "\n"
+                << "0000000000 65535 f \n";
+        for (auto offset : _offsets)
+        {
+            char entry[21];
+            std::snprintf(entry, sizeof entry, "%010llu 00000 n \n", static_cast<unsigned long long>(offset));
+            _output.write(entry, 20);
+        }
+        _output << "trailer\n"
+                << "<< /Size " << _offsets.size() + 1 << " /Root " << reference(CATALOG) << " >>\n"
+                << "startxref\n" << table << "\n"
+                << "%%EOF\n";
+        _output.flush();
+        if (_file)
+        {
+            _file->close();
+        }
+    }
+
+}
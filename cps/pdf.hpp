@@ -0,0 +1,111 @@
+// pdf.hpp
+//
+// Writes shape trees straight to PDF, with no PostScript in between. Each
+// page is laid out (see layout.hpp) and every leaf draws itself with PDF
+// operators under its absolute transform. Instances are not expanded:
+// each definition becomes a Form XObject, written once per document and
+// drawn by reference wherever it is used, inside other definitions too.
+//
+// Objects go out as each page is added, so memory stays bounded by one
+// page, and the cross-reference table at the end gives the offset of
+// every object so a reader can go straight to any page.
+//
+
+#ifndef CS372_CPS_PDF_H
+#define CS372_CPS_PDF_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "document.hpp"
+#include "instance.hpp"
+#include "layout.hpp"
+#include "shape.hpp"
+#include "sink.hpp"
+
+namespace cps
+{
+
+    class PdfDocument
+    {
+    public:
+        // The page size used for shapes that mark nothing: US Letter.
+        static constexpr double DEFAULT_PAGE_WIDTH = 612;
+        static constexpr double DEFAULT_PAGE_HEIGHT = 792;
+
+        // Creates or truncates the file at path. Throws std::system_error if
+        // it cannot be opened.
+        explicit PdfDocument(const std::string &path);
+
+        // Writes into sink, which must outlive the document. Numbers are
+        // always written in fixed notation, which is all PDF accepts.
+        explicit PdfDocument(Sink &sink);
+
+        PdfDocument(const PdfDocument &) = delete;
+
+        PdfDocument &operator=(const PdfDocument &) = delete;
+
+        // Closes the document if close() has not been called.
+        ~PdfDocument();
+
+        // The device resolution pages from here on are simplified for; see
+        // Sink::set_resolution. Form XObjects are simplified as drawn at
+        // their own scale.
+        double get_resolution() const;
+
+        void set_resolution(double dotsPerInch);
+
+        // Adds shape as a page just large enough to hold it, strokes
+        // included.
+        void addPage(Shape &shape);
+
+        // As above, on a page covering mediaBox in the shape's coordinates.
+        void addPage(Shape &shape, const BoundingBox &mediaBox);
+
+        std::size_t get_numPages() const;
+
+        // Writes the page tree, cross-reference table and trailer, flushes
+        // the output and closes any file the document opened; errors are
+        // reported as std::system_error. Nothing may be added afterwards.
+        void close();
+
+    private:
+        using Forms = std::vector<Instance::Definition_ptr>;
+
+        // Objects 1 and 2 are the catalog and the page tree, written last.
+        static constexpr std::uint32_t CATALOG = 1;
+        static constexpr std::uint32_t PAGE_TREE = 2;
+
+        void writeHeader();
+
+        std::uint32_t reserveObject();
+
+        void beginObject(std::uint32_t object);
+
+        void writeStream(std::uint32_t object, const std::string &dictionary, const std::string &content);
+
+        // Writes root's content into sink, noting the definitions it draws.
+        void writeContent(Shape &root, Sink &sink, Forms &forms);
+
+        // The resource dictionary naming each form in forms.
+        std::string resources(const Forms &forms) const;
+
+        // Writes each definition in forms, and any definitions those draw,
+        // as a form unless it has been already.
+        void writeForms(const Forms &forms);
+
+        std::unique_ptr<OutputFile> _file;
+        CountingSink _output;
+        std::vector<std::uint64_t> _offsets{};
+        std::vector<std::uint32_t> _pages{};
+        std::unordered_map<Instance::Definition_ptr, std::uint32_t> _forms{};
+        bool _closed{false};
+    };
+
+}
+
+#endif //CS372_CPS_PDF_H
@@ -0,0 +1,629 @@
+// primitives.cpp
+//
+
+#include "primitives.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "prolog.hpp"
+
+namespace cps
+{
+
+    std::pair<double, double> polygonSize(int numSides, double sideLength)
+    {
+        const double pi = std::acos(-1);
+        if (numSides % 2 == 1)
+        {
+            return {(sideLength * std::sin(pi * (numSides - 1) / (2 * numSides))) / std::sin(pi / numSides),
+                    sideLength * (1.0 + std::cos(pi / numSides)) / (2.0 * std::sin(pi / numSides))};
+        }
+        auto height = sideLength * (std::cos(pi / numSides)) / (std::sin(pi / numSides));
+        if (numSides % 4 == 0)
+        {
+            return {height, height};
+        }
+        return {sideLength / std::sin(pi / numSides), height};
+    }
+
+    std::pair<double, double> skylineSize(BuildingColumns buildings)
+    {
+        auto count = buildings.count;
+        if (count == 0)
+        {
+            return {0, 0};
+        }
+        auto maxHeight = maxOf(buildings.heights, count);
+        if (minOf(buildings.spacings, count) >= 0)
+        {
+            auto width = sumOf(buildings.widths, count) + sumOf(buildings.spacings, count);
+            return {width + buildings.spacings[0], maxHeight};
+        }
+
+        // With overlapping buildings an earlier one can reach past the end.
+        double right = 0.0;
+        double rightmost = 0.0;
+        for (std::size_t index = 0; index < count; ++index)
+        {
+            right += buildings.spacings[index] + buildings.widths[index];
+            rightmost = std::max(rightmost, right);
+        }
+        return {rightmost + buildings.spacings[0], maxHeight};
+    }
+
+    namespace
+    {
+        void appendPoint(std::vector<OutlinePoint> &outline, double x, double height)
+        {
+            if (!outline.empty() && outline.back().x == x)
+            {
+                outline.pop_back();
+            }
+            if (outline.empty() ? height != 0 : outline.back().height != height)
+            {
+                outline.push_back({x, height});
+            }
+        }
+
+        std::vector<OutlinePoint> mergeOutlines(const std::vector<OutlinePoint> &left,
+                                                const std::vector<OutlinePoint> &right)
+        {
+            std::vector<OutlinePoint> merged;
+            merged.reserve(left.size() + right.size());
+            std::size_t i = 0;
+            std::size_t j = 0;
+            auto leftHeight = 0.0;
+            auto rightHeight = 0.0;
+            while (i < left.size() || j < right.size())
+            {
+                double x;
+                if (j == right.size() || (i < left.size() && left[i].x < right[j].x))
+                {
+                    x = left[i].x;
+                    leftHeight = left[i++].height;
+                }
+                else if (i == left.size() || right[j].x < left[i].x)
+                {
+                    x = right[j].x;
+                    rightHeight = right[j++].height;
+                }
+                else
+                {
+                    x = left[i].x;
+                    leftHeight = left[i++].height;
+                    rightHeight = right[j++].height;
+                }
+                appendPoint(merged, x, std::max(leftHeight, rightHeight));
+            }
+            return merged;
+        }
+
+        std::vector<OutlinePoint> outlineOf(const double *lefts, const double *heights, const double *widths,
+                                            std::size_t count)
+        {
+            if (count == 1)
+            {
+                std::vector<OutlinePoint> outline;
+                appendPoint(outline, lefts[0], heights[0]);
+                appendPoint(outline, lefts[0] + widths[0], 0);
+                return outline;
+            }
+            auto half = count / 2;
+            return mergeOutlines(outlineOf(lefts, heights, widths, half),
+                                 outlineOf(lefts + half, heights + half, widths + half, count - half));
+        }
+    }
+
+    std::vector<OutlinePoint> skylineOutline(BuildingColumns buildings)
+    {
+        auto count = buildings.count;
+        if (count == 0)
+        {
+            return {};
+        }
+        std::vector<double> lefts(count);
+        auto x = 0.0;
+        for (std::size_t index = 0; index < count; ++index)
+        {
+            x += buildings.spacings[index];
+            lefts[index] = x;
+            x += buildings.widths[index];
+        }
+        return outlineOf(lefts.data(), buildings.heights, buildings.widths, count);
+    }
+
+    // Cells are numbered from zero at the left edge. Each cell holding
+    // changes steps to the tallest height in it, and the height the last
+    // change leaves takes over at the next cell boundary.
+    std::vector<OutlinePoint> decimateOutline(const std::vector<OutlinePoint> &outline, double cell)
+    {
+        std::vector<OutlinePoint> decimated;
+        auto height = 0.0;
+        std::size_t index = 0;
+        while (index < outline.size())
+        {
+            auto number = std::floor(outline[index].x / cell);
+            auto peak = height;
+            while (index < outline.size() && std::floor(outline[index].x / cell) == number)
+            {
+                height = outline[index++].height;
+                peak = std::max(peak, height);
+            }
+            appendPoint(decimated, number * cell, peak);
+            appendPoint(decimated, index < outline.size() ? (number + 1) * cell : outline.back().x, height);
+        }
+        return decimated;
+    }
+
+    std::vector<OutlinePoint> skylineEnvelope(BuildingColumns buildings, double width, double cell)
+    {
+        auto cells = static_cast<std::size_t>(std::ceil(width / cell));
+        std::vector<double> peaks(std::max<std::size_t>(cells, 1), 0.0);
+        auto last = static_cast<double>(peaks.size() - 1);
+        auto x = 0.0;
+        auto right = 0.0;
+        for (std::size_t index = 0; index < buildings.count; ++index)
+        {
+            x += buildings.spacings[index];
+            auto first = std::clamp(std::floor(x / cell), 0.0, last);
+            x += buildings.widths[index];
+            right = std::max(right, x);
+            // A building ending on a cell boundary stays out of the next cell.
+            auto end = std::clamp(std::ceil(x / cell) - 1, first, last);
+            for (auto number = static_cast<std::size_t>(first); number <= static_cast<std::size_t>(end); ++number)
+            {
+                peaks[number] = std::max(peaks[number], buildings.heights[index]);
+            }
+        }
+        std::vector<OutlinePoint> envelope;
+        for (std::size_t number = 0; number < peaks.size(); ++number)
+        {
+            appendPoint(envelope, number * cell, peaks[number]);
+        }
+        if (!envelope.empty())
+        {
+            appendPoint(envelope, std::max(right, envelope.back().x), 0);
+        }
+        return envelope;
+    }
+
+    namespace
+    {
+        // True when the sink's level of detail makes a shape this size a
+        // dot.
+        bool belowPixel(double pixel, double width, double height)
+        {
+            return width < pixel && height < pixel;
+        }
+    }
+
+    void writeDot(Sink &sink, double size)
+    {
+        sink << -size / 2 << " " << -size / 2 << " " << size << " " << size << " rectfill\n";
+    }
+
+    void writeCircle(Sink &sink, double radius)
+    {
+        auto pixel = sink.get_pixelSize();
+        if (belowPixel(pixel, 2 * radius, 2 * radius))
+        {
+            writeDot(sink, pixel);
+            return;
+        }
+        sink << "0 0 " << radius << " 0 360 arc stroke\n";
+    }
+
+    void writeRectangle(Sink &sink, double width, double height)
+    {
+        auto pixel = sink.get_pixelSize();
+        if (belowPixel(pixel, width, height))
+        {
+            writeDot(sink, pixel);
+            return;
+        }
+        sink << "newpath\n"
+             << -1 * width / 2 << " " << -1 * height / 2 << " moveto\n"
+             << width << " 0 rlineto\n"
+             << "0 " << height << " rlineto\n"
+             << -1 * width << " 0 rlineto\n"
+             << "closepath\n"
+                "0 0 moveto\n"
+                "stroke\n";
+    }
+
+    void writePolygon(Sink &sink, int numSides, double sideLength, double width, double height)
+    {
+        auto pixel = sink.get_pixelSize();
+        if (belowPixel(pixel, width, height))
+        {
+            writeDot(sink, pixel);
+            return;
+        }
+        if (sideLength < pixel)
+        {
+            // The polygon's first side starts at the bottom left corner of
+            // its box, so its center is half a side along and an apothem up.
+            const double pi = std::acos(-1);
+            auto radius = sideLength / (2 * std::sin(pi / numSides));
+            auto apothem = sideLength / (2 * std::tan(pi / numSides));
+            sink << -width / 2 + sideLength / 2 << " " << -height / 2 + apothem << " "
+                 << radius << " 0 360 arc stroke\n";
+            return;
+        }
+        sink << "gsave\n";
+        sink << -width / 2 << " " << -height / 2 << " translate\n";
+        sink << numSides << " " << sideLength << " " << POLYGON_PROCEDURE << "\n";
+        sink << "grestore\n";
+    }
+
+    void writeSpacer(Sink &sink, double width, double height)
+    {
+        sink << width << " " << height << " translate\n";
+    }
+
+    namespace
+    {
+        char *append(char *out, const char *text, std::size_t size)
+        {
+            std::memcpy(out, text, size);
+            return out + size;
+        }
+    }
+
+    // Each building's four moves are formatted into one buffer and handed
+    // to the sink with a single write.
+    void writeSkyline(Sink &sink, double width, double height, BuildingColumns buildings)
+    {
+        auto pixel = sink.get_pixelSize();
+        if (pixel > 0 && buildings.count > width / pixel)
+        {
+            writeSkylineOutline(sink, width, height, skylineEnvelope(buildings, width, pixel));
+            return;
+        }
+        sink << "gsave\n";
+        sink << -(width / 2) << " " << -(height / 2) << " moveto\n";
+
+        const auto format = sink.get_numberFormat();
+        char text[4 * MAX_NUMBER_LENGTH + 48];
+        auto end = text + sizeof text;
+        for (std::size_t index = 0; index < buildings.count; ++index)
+        {
+            auto out = formatNumber(text, end, buildings.spacings[index], format);
+            out = append(out, " 0 rlineto\n0 ", 13);
+            out = formatNumber(out, end, buildings.heights[index], format);
+            out = append(out, " rlineto\n", 9);
+            out = formatNumber(out, end, buildings.widths[index], format);
+            out = append(out, " 0 rlineto\n0 ", 13);
+            out = formatNumber(out, end, -buildings.heights[index], format);
+            out = append(out, " rlineto\n", 9);
+            sink.write(text, static_cast<std::size_t>(out - text));
+        }
+
+        if (buildings.count > 0)
+        {
+            sink << buildings.spacings[0] << " 0 rlineto\n";
+        }
+        sink << "0 0 moveto\n";
+        sink << "stroke\n";
+        sink << "grestore\n";
+    }
+
+    void writeSkylineOutline(Sink &sink, double width, double height, const std::vector<OutlinePoint> &outline)
+    {
+        auto pixel = sink.get_pixelSize();
+        if (belowPixel(pixel, width, height))
+        {
+            writeDot(sink, pixel);
+            return;
+        }
+        // Two points per pixel column is as much as can show.
+        std::vector<OutlinePoint> decimated;
+        auto points = &outline;
+        if (pixel > 0 && outline.size() > 2 * (width / pixel + 1))
+        {
+            decimated = decimateOutline(outline, pixel);
+            points = &decimated;
+        }
+        sink << "gsave\n";
+        sink << -(width / 2) << " " << -(height / 2) << " moveto\n";
+        auto x = 0.0;
+        auto y = 0.0;
+        for (const auto &point : *points)
+        {
+            if (point.x != x)
+            {
+                sink << point.x - x << " 0 rlineto\n";
+                x = point.x;
+            }
+            sink << "0 " << point.height - y << " rlineto\n";
+            y = point.height;
+        }
+        if (width != x)
+        {
+            sink << width - x << " 0 rlineto\n";
+        }
+        sink << "0 0 moveto\n";
+        sink << "stroke\n";
+        sink << "grestore\n";
+    }
+
+    namespace
+    {
+        // A full circle as four Bezier curves, counterclockwise from the
+        // positive x axis like PostScript's arc.
+        void writePdfArc(Sink &sink, double x, double y, double radius)
+        {
+            const auto k = 0.5522847498307936 * radius;
+            sink << x + radius << " " << y << " m\n"
+                 << x + radius << " " << y + k << " " << x + k << " " << y + radius << " "
+                 << x << " " << y + radius << " c\n"
+                 << x - k << " " << y + radius << " " << x - radius << " " << y + k << " "
+                 << x - radius << " " << y << " c\n"
+                 << x - radius << " " << y - k << " " << x - k << " " << y - radius << " "
+                 << x << " " << y - radius << " c\n"
+                 << x + k << " " << y - radius << " " << x + radius << " " << y - k << " "
+                 << x + radius << " " << y << " c\n"
+                 << "S\n";
+        }
+
+        // Writes "x y l" without going through the stream operators, since
+        // skylines write millions of them.
+        void writeLineTo(Sink &sink, double x, double y)
+        {
+            const auto format = sink.get_numberFormat();
+            char text[2 * MAX_NUMBER_LENGTH + 8];
+            auto end = text + sizeof text;
+            auto out = formatNumber(text, end, x, format);
+            out = append(out, " ", 1);
+            out = formatNumber(out, end, y, format);
+            out = append(out, " l\n", 3);
+            sink.write(text, static_cast<std::size_t>(out - text));
+        }
+    }
+
+    void writePdfDot(Sink &sink, double size)
+    {
+        sink << -size / 2 << " " << -size / 2 << " " << size << " " << size << " re f\n";
+    }
+
+    void writePdfCircle(Sink &sink, double radius)
+    {
+        auto pixel = sink.get_pixelSize();
+        if (belowPixel(pixel, 2 * radius, 2 * radius))
+        {
+            writePdfDot(sink, pixel);
+            return;
+        }
+        writePdfArc(sink, 0, 0, radius);
+    }
+
+    void writePdfRectangle(Sink &sink, double width, double height)
+    {
+        auto pixel = sink.get_pixelSize();
+        if (belowPixel(pixel, width, height))
+        {
+            writePdfDot(sink, pixel);
+            return;
+        }
+        sink << -width / 2 << " " << -height / 2 << " " << width << " " << height << " re S\n";
+    }
+
+    // Traces the path the polygon procedure in the prolog draws.
+    void writePdfPolygon(Sink &sink, int numSides, double sideLength, double width, double height)
+    {
+        auto pixel = sink.get_pixelSize();
+        if (belowPixel(pixel, width, height))
+        {
+            writePdfDot(sink, pixel);
+            return;
+        }
+        const double pi = std::acos(-1);
+        if (sideLength < pixel)
+        {
+            writePdfArc(sink, -width / 2 + sideLength / 2, -height / 2 + sideLength / (2 * std::tan(pi / numSides)),
+                        sideLength / (2 * std::sin(pi / numSides)));
+            return;
+        }
+        auto x = -width / 2;
+        auto y = -height / 2;
+        sink << x << " " << y << " m\n";
+        for (auto side = 0; side + 1 < numSides; ++side)
+        {
+            x += sideLength * std::cos(2 * pi * side / numSides);
+            y += sideLength * std::sin(2 * pi * side / numSides);
+            writeLineTo(sink, x, y);
+        }
+        sink << "h S\n";
+    }
+
+    void writePdfSkyline(Sink &sink, double width, double height, BuildingColumns buildings)
+    {
+        auto pixel = sink.get_pixelSize();
+        if (pixel > 0 && buildings.count > width / pixel)
+        {
+            writePdfSkylineOutline(sink, width, height, skylineEnvelope(buildings, width, pixel));
+            return;
+        }
+        auto x = -(width / 2);
+        auto bottom = -(height / 2);
+        sink << x << " " << bottom << " m\n";
+        for (std::size_t index = 0; index < buildings.count; ++index)
+        {
+            x += buildings.spacings[index];
+            writeLineTo(sink, x, bottom);
+            writeLineTo(sink, x, bottom + buildings.heights[index]);
+            x += buildings.widths[index];
+            writeLineTo(sink, x, bottom + buildings.heights[index]);
+            writeLineTo(sink, x, bottom);
+        }
+        if (buildings.count > 0)
+        {
+            writeLineTo(sink, x + buildings.spacings[0], bottom);
+        }
+        sink << "S\n";
+    }
+
+    void writePdfSkylineOutline(Sink &sink, double width, double height, const std::vector<OutlinePoint> &outline)
+    {
+        auto pixel = sink.get_pixelSize();
+        if (belowPixel(pixel, width, height))
+        {
+            writePdfDot(sink, pixel);
+            return;
+        }
+        std::vector<OutlinePoint> decimated;
+        auto points = &outline;
+        if (pixel > 0 && outline.size() > 2 * (width / pixel + 1))
+        {
+            decimated = decimateOutline(outline, pixel);
+            points = &decimated;
+        }
+        auto left = -(width / 2);
+        auto bottom = -(height / 2);
+        sink << left << " " << bottom << " m\n";
+        auto x = 0.0;
+        auto y = 0.0;
+        for (const auto &point : *points)
+        {
+            if (point.x != x)
+            {
+                writeLineTo(sink, left + point.x, bottom + y);
+                x = point.x;
+            }
+            writeLineTo(sink, left + x, bottom + point.height);
+            y = point.height;
+        }
+        if (width != x)
+        {
+            writeLineTo(sink, left + width, bottom + y);
+        }
+        sink << "S\n";
+    }
+
+    void traceDot(Path &path, double size)
+    {
+        path.moveTo(-size / 2, -size / 2);
+        path.lineTo(size / 2, -size / 2);
+        path.lineTo(size / 2, size / 2);
+        path.lineTo(-size / 2, size / 2);
+        path.closePath();
+    }
+
+    void traceCircle(Path &path, double radius)
+    {
+        auto pixel = path.get_pixelSize();
+        if (belowPixel(pixel, 2 * radius, 2 * radius))
+        {
+            traceDot(path, pixel);
+            return;
+        }
+        path.circle(0, 0, radius);
+    }
+
+    void traceRectangle(Path &path, double width, double height)
+    {
+        auto pixel = path.get_pixelSize();
+        if (belowPixel(pixel, width, height))
+        {
+            traceDot(path, pixel);
+            return;
+        }
+        path.moveTo(-width / 2, -height / 2);
+        path.lineTo(width / 2, -height / 2);
+        path.lineTo(width / 2, height / 2);
+        path.lineTo(-width / 2, height / 2);
+        path.closePath();
+    }
+
+    void tracePolygon(Path &path, int numSides, double sideLength, double width, double height)
+    {
+        auto pixel = path.get_pixelSize();
+        if (belowPixel(pixel, width, height))
+        {
+            traceDot(path, pixel);
+            return;
+        }
+        const double pi = std::acos(-1);
+        if (sideLength < pixel)
+        {
+            path.circle(-width / 2 + sideLength / 2, -height / 2 + sideLength / (2 * std::tan(pi / numSides)),
+                        sideLength / (2 * std::sin(pi / numSides)));
+            return;
+        }
+        auto x = -width / 2;
+        auto y = -height / 2;
+        path.moveTo(x, y);
+        for (auto side = 0; side + 1 < numSides; ++side)
+        {
+            x += sideLength * std::cos(2 * pi * side / numSides);
+            y += sideLength * std::sin(2 * pi * side / numSides);
+            path.lineTo(x, y);
+        }
+        path.closePath();
+    }
+
+    void traceSkyline(Path &path, double width, double height, BuildingColumns buildings)
+    {
+        auto pixel = path.get_pixelSize();
+        if (pixel > 0 && buildings.count > width / pixel)
+        {
+            traceSkylineOutline(path, width, height, skylineEnvelope(buildings, width, pixel));
+            return;
+        }
+        auto x = -(width / 2);
+        auto bottom = -(height / 2);
+        path.moveTo(x, bottom);
+        for (std::size_t index = 0; index < buildings.count; ++index)
+        {
+            x += buildings.spacings[index];
+            path.lineTo(x, bottom);
+            path.lineTo(x, bottom + buildings.heights[index]);
+            x += buildings.widths[index];
+            path.lineTo(x, bottom + buildings.heights[index]);
+            path.lineTo(x, bottom);
+        }
+        if (buildings.count > 0)
+        {
+            path.lineTo(x + buildings.spacings[0], bottom);
+        }
+    }
+
+    void traceSkylineOutline(Path &path, double width, double height, const std::vector<OutlinePoint> &outline)
+    {
+        auto pixel = path.get_pixelSize();
+        if (belowPixel(pixel, width, height))
+        {
+            traceDot(path, pixel);
+            return;
+        }
+        std::vector<OutlinePoint> decimated;
+        auto points = &outline;
+        if (pixel > 0 && outline.size() > 2 * (width / pixel + 1))
+        {
+            decimated = decimateOutline(outline, pixel);
+            points = &decimated;
+        }
+        auto left = -(width / 2);
+        auto bottom = -(height / 2);
+        path.moveTo(left, bottom);
+        auto x = 0.0;
+        auto y = 0.0;
+        for (const auto &point : *points)
+        {
+            if (point.x != x)
+            {
+                path.lineTo(left + point.x, bottom + y);
+                x = point.x;
+            }
+            path.lineTo(left + x, bottom + point.height);
+            y = point.height;
+        }
+        if (width != x)
+        {
+            path.lineTo(left + width, bottom + y);
+        }
+    }
+
+}
@@ -0,0 +1,101 @@
+// primitives.hpp
+//
+// Geometry and PostScript text for the leaf shapes, shared by the Shape
+// classes and the flat scene representation so both produce the same
+// output.
+//
+
+#ifndef CS372_CPS_PRIMITIVES_H
+#define CS372_CPS_PRIMITIVES_H
+
+#include <cstddef>
+#include <utility> // pair
+#include <vector>
+
+#include "buildings.hpp"
+#include "path.hpp"
+#include "sink.hpp"
+
+namespace cps
+{
+
+    // A point where the outline changes height; the height holds until the
+    // next point. The last point is always at height 0.
+    struct OutlinePoint
+    {
+        double x;
+        double height;
+    };
+
+    // Merges the buildings into the upper envelope of their footprints.
+    std::vector<OutlinePoint> skylineOutline(BuildingColumns buildings);
+
+    // Reduces an outline to one step per cell of the given width, taking
+    // the tallest height in each cell so the envelope only ever grows.
+    std::vector<OutlinePoint> decimateOutline(const std::vector<OutlinePoint> &outline, double cell);
+
+    // The same straight from the buildings, without merging the full
+    // outline first; linear in the buildings plus the cells.
+    std::vector<OutlinePoint> skylineEnvelope(BuildingColumns buildings, double width, double cell);
+
+    // Width and height of a regular polygon.
+    std::pair<double, double> polygonSize(int numSides, double sideLength);
+
+    std::pair<double, double> skylineSize(BuildingColumns buildings);
+
+    // Level of detail: when the sink has a pixel size (see
+    // Sink::get_pixelSize) the writers below leave out what a device pixel
+    // cannot show. A shape smaller than a pixel both ways becomes a dot, a
+    // polygon with sides shorter than a pixel becomes the circle through
+    // its corners, and a skyline with more buildings than pixel columns is
+    // drawn as its decimated envelope.
+
+    // Fills a square size across, centered on the origin.
+    void writeDot(Sink &sink, double size);
+
+    void writeCircle(Sink &sink, double radius);
+
+    void writeRectangle(Sink &sink, double width, double height);
+
+    void writePolygon(Sink &sink, int numSides, double sideLength, double width, double height);
+
+    void writeSpacer(Sink &sink, double width, double height);
+
+    void writeSkyline(Sink &sink, double width, double height, BuildingColumns buildings);
+
+    // Strokes just the envelope from skylineOutline as one polyline.
+    void writeSkylineOutline(Sink &sink, double width, double height, const std::vector<OutlinePoint> &outline);
+
+    // The same leaves as PDF content stream operators. PDF has no arcs,
+    // procedures or relative moves, so circles are four Bezier curves and
+    // every point is written out in full. Level of detail works as above.
+    void writePdfDot(Sink &sink, double size);
+
+    void writePdfCircle(Sink &sink, double radius);
+
+    void writePdfRectangle(Sink &sink, double width, double height);
+
+    void writePdfPolygon(Sink &sink, int numSides, double sideLength, double width, double height);
+
+    void writePdfSkyline(Sink &sink, double width, double height, BuildingColumns buildings);
+
+    void writePdfSkylineOutline(Sink &sink, double width, double height, const std::vector<OutlinePoint> &outline);
+
+    // The same leaves traced into a path, for drawing without a page
+    // description language; a dot is a closed square. Level of detail
+    // works as above, with the path's pixel size.
+    void traceDot(Path &path, double size);
+
+    void traceCircle(Path &path, double radius);
+
+    void traceRectangle(Path &path, double width, double height);
+
+    void tracePolygon(Path &path, int numSides, double sideLength, double width, double height);
+
+    void traceSkyline(Path &path, double width, double height, BuildingColumns buildings);
+
+    void traceSkylineOutline(Path &path, double width, double height, const std::vector<OutlinePoint> &outline);
+
+}
+
+#endif //CS372_CPS_PRIMITIVES_H
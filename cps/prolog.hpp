@@ -0,0 +1,28 @@
+// prolog.hpp
+//
+// Procedures defined once at the top of every document and called by the
+// shapes that need them.
+//
+
+#ifndef CS372_CPS_PROLOG_H
+#define CS372_CPS_PROLOG_H
+
+#include <string>
+
+namespace cps {
+    // nSides length cpsPolygon -
+    // Strokes a regular polygon whose first side runs from the origin along
+    // the x axis. Works on the operand stack only, so no names are defined
+    // per call.
+    const std::string POLYGON_PROCEDURE("cpsPolygon");
+
+    const std::string PROLOG(
+            "/" + POLYGON_PROCEDURE + " {\n"
+            "newpath 0 0 moveto\n"
+            "exch 360 1 index div exch\n"
+            "{ 1 index 0 rlineto dup rotate } repeat\n"
+            "pop pop closepath stroke\n"
+            "} bind def\n");
+}
+
+#endif //CS372_CPS_PROLOG_H
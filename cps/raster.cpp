@@ -0,0 +1,562 @@
+// raster.cpp
+//
+
+#include "raster.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <future>
+#include <string>
+#include <utility>
+
+namespace cps
+{
+
+    namespace
+    {
+        std::uint8_t luminance(const Color &color)
+        {
+            return static_cast<std::uint8_t>((299 * color.red + 587 * color.green + 114 * color.blue + 500) / 1000);
+        }
+
+        void appendUint32(std::string &out, std::uint32_t value)
+        {
+            out.push_back(static_cast<char>(value >> 24));
+            out.push_back(static_cast<char>(value >> 16));
+            out.push_back(static_cast<char>(value >> 8));
+            out.push_back(static_cast<char>(value));
+        }
+
+        std::uint32_t crc32(const std::string &data, std::size_t first)
+        {
+            static const auto table = [] {
+                std::array<std::uint32_t, 256> entries{};
+                for (std::uint32_t n = 0; n < 256; ++n)
+                {
+                    auto c = n;
+                    for (auto bit = 0; bit < 8; ++bit)
+                    {
+                        c = (c & 1) != 0 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                    }
+                    entries[n] = c;
+                }
+                return entries;
+            }();
+            std::uint32_t crc = 0xFFFFFFFFu;
+            for (auto index = first; index < data.size(); ++index)
+            {
+                crc = table[(crc ^ static_cast<std::uint8_t>(data[index])) & 0xFF] ^ (crc >> 8);
+            }
+            return crc ^ 0xFFFFFFFFu;
+        }
+
+        // Length, type, data and a CRC over the type and data.
+        void writeChunk(Sink &sink, const char *type, const std::string &data)
+        {
+            std::string chunk;
+            chunk.reserve(data.size() + 12);
+            appendUint32(chunk, static_cast<std::uint32_t>(data.size()));
+            chunk.append(type, 4);
+            chunk.append(data);
+            appendUint32(chunk, crc32(chunk, 4));
+            sink.write(chunk.data(), chunk.size());
+        }
+
+        // Adds weight for the part of each pixel column in [from, to) to
+        // cover, which holds the columns from left on, and widens [low,
+        // high) to the entries it touched. Fractions are taken from the
+        // absolute columns so every tile agrees on them.
+        void addSpan(std::vector<float> &cover, std::size_t left, double from, double to, float weight,
+                     std::size_t &low, std::size_t &high)
+        {
+            from = std::max(from, static_cast<double>(left));
+            to = std::min(to, static_cast<double>(left + cover.size()));
+            if (to <= from)
+            {
+                return;
+            }
+            auto first = static_cast<std::size_t>(from);
+            auto last = static_cast<std::size_t>(to);
+            low = std::min(low, first - left);
+            high = std::max(high, std::min(last + 1 - left, cover.size()));
+            if (first == last)
+            {
+                cover[first - left] += static_cast<float>(to - from) * weight;
+                return;
+            }
+            cover[first - left] += static_cast<float>(first + 1 - from) * weight;
+            for (auto column = first + 1; column < last; ++column)
+            {
+                cover[column - left] += weight;
+            }
+            if (last - left < cover.size())
+            {
+                cover[last - left] += static_cast<float>(to - last) * weight;
+            }
+        }
+    }
+
+    // Bitmap Class
+    Bitmap::Bitmap(std::size_t width, std::size_t height, Format format)
+            : _width(width), _height(height), _format(format),
+              _pixels(width * height * (format == Format::Gray ? 1 : 4), 255)
+    {}
+
+    std::size_t Bitmap::get_width() const
+    {
+        return _width;
+    }
+
+    std::size_t Bitmap::get_height() const
+    {
+        return _height;
+    }
+
+    Bitmap::Format Bitmap::get_format() const
+    {
+        return _format;
+    }
+
+    std::size_t Bitmap::get_channels() const
+    {
+        return _format == Format::Gray ? 1 : 4;
+    }
+
+    std::uint8_t *Bitmap::row(std::size_t y)
+    {
+        return _pixels.data() + y * _width * get_channels();
+    }
+
+    const std::uint8_t *Bitmap::row(std::size_t y) const
+    {
+        return _pixels.data() + y * _width * get_channels();
+    }
+
+    const std::vector<std::uint8_t> &Bitmap::pixels() const
+    {
+        return _pixels;
+    }
+
+    Color Bitmap::get_pixel(std::size_t x, std::size_t y) const
+    {
+        auto pixel = row(y) + x * get_channels();
+        if (_format == Format::Gray)
+        {
+            return {pixel[0], pixel[0], pixel[0], 255};
+        }
+        return {pixel[0], pixel[1], pixel[2], pixel[3]};
+    }
+
+    void Bitmap::fill(const Color &color)
+    {
+        if (_format == Format::Gray)
+        {
+            std::fill(_pixels.begin(), _pixels.end(), luminance(color));
+            return;
+        }
+        for (std::size_t index = 0; index < _pixels.size(); index += 4)
+        {
+            _pixels[index] = color.red;
+            _pixels[index + 1] = color.green;
+            _pixels[index + 2] = color.blue;
+            _pixels[index + 3] = color.alpha;
+        }
+    }
+
+    void Bitmap::writePpm(Sink &sink) const
+    {
+        auto header = std::string(_format == Format::Gray ? "P5\n" : "P6\n") +
+                      std::to_string(_width) + " " + std::to_string(_height) + "\n255\n";
+        sink.write(header.data(), header.size());
+        if (_format == Format::Gray)
+        {
+            sink.write(reinterpret_cast<const char *>(_pixels.data()), _pixels.size());
+            return;
+        }
+        std::string line(3 * _width, '\0');
+        for (std::size_t y = 0; y < _height; ++y)
+        {
+            auto pixels = row(y);
+            for (std::size_t x = 0; x < _width; ++x)
+            {
+                line[3 * x] = static_cast<char>(pixels[4 * x]);
+                line[3 * x + 1] = static_cast<char>(pixels[4 * x + 1]);
+                line[3 * x + 2] = static_cast<char>(pixels[4 * x + 2]);
+            }
+            sink.write(line.data(), line.size());
+        }
+    }
+
+    // The zlib stream holds each row behind a filter byte of 0 (none), in
+    // stored deflate blocks of at most 65535 bytes, then an Adler-32 sum.
+    void Bitmap::writePng(Sink &sink) const
+    {
+        static const char SIGNATURE[] = "\x89PNG\r\n\x1A\n";
+        sink.write(SIGNATURE, 8);
+
+        std::string header;
+        appendUint32(header, static_cast<std::uint32_t>(_width));
+        appendUint32(header, static_cast<std::uint32_t>(_height));
+        header.push_back(8);
+        header.push_back(_format == Format::Gray ? 0 : 6);
+        header.append(3, '\0');
+        writeChunk(sink, "IHDR", header);
+
+        const auto stride = _width * get_channels();
+        std::string raw;
+        raw.reserve(_height * (stride + 1));
+        for (std::size_t y = 0; y < _height; ++y)
+        {
+            raw.push_back('\0');
+            raw.append(reinterpret_cast<const char *>(row(y)), stride);
+        }
+        const std::size_t BLOCK = 65535;
+        std::string data{"\x78\x01", 2};
+        data.reserve(raw.size() + raw.size() / BLOCK * 5 + 16);
+        std::size_t offset = 0;
+        do
+        {
+            auto size = std::min(BLOCK, raw.size() - offset);
+            auto last = offset + size == raw.size();
+            data.push_back(last ? 1 : 0);
+            data.push_back(static_cast<char>(size & 0xFF));
+            data.push_back(static_cast<char>(size >> 8));
+            data.push_back(static_cast<char>(~size & 0xFF));
+            data.push_back(static_cast<char>((~size >> 8) & 0xFF));
+            data.append(raw, offset, size);
+            offset += size;
+        } while (offset < raw.size());
+        std::uint32_t a = 1;
+        std::uint32_t b = 0;
+        for (auto byte : raw)
+        {
+            a = (a + static_cast<std::uint8_t>(byte)) % 65521;
+            b = (b + a) % 65521;
+        }
+        appendUint32(data, (b << 16) | a);
+        writeChunk(sink, "IDAT", data);
+        writeChunk(sink, "IEND", "");
+    }
+
+    // Rasterizer Class
+    Rasterizer::Rasterizer(Bitmap &bitmap)
+            : _bitmap(bitmap), _transform{1, 0, 0, -1, 0, static_cast<double>(bitmap.get_height())}
+    {}
+
+    const Transform &Rasterizer::get_transform() const
+    {
+        return _transform;
+    }
+
+    void Rasterizer::set_transform(const Transform &transform)
+    {
+        _transform = transform;
+    }
+
+    void Rasterizer::fit(const BoundingBox &box)
+    {
+        auto width = box.right - box.left;
+        auto height = box.top - box.bottom;
+        if (box.empty() || (width == 0 && height == 0))
+        {
+            return;
+        }
+        auto scale = std::min(width == 0 ? INFINITY : _bitmap.get_width() / width,
+                              height == 0 ? INFINITY : _bitmap.get_height() / height);
+        _transform = {scale, 0, 0, -scale,
+                      _bitmap.get_width() / 2.0 - scale * (box.left + box.right) / 2,
+                      _bitmap.get_height() / 2.0 + scale * (box.bottom + box.top) / 2};
+    }
+
+    Color Rasterizer::get_color() const
+    {
+        return _color;
+    }
+
+    void Rasterizer::set_color(const Color &color)
+    {
+        _color = color;
+    }
+
+    double Rasterizer::get_lineWidth() const
+    {
+        return _lineWidth;
+    }
+
+    void Rasterizer::set_lineWidth(double width)
+    {
+        _lineWidth = width;
+    }
+
+    ThreadPool *Rasterizer::get_threadPool() const
+    {
+        return _threadPool;
+    }
+
+    void Rasterizer::set_threadPool(ThreadPool *threadPool)
+    {
+        _threadPool = threadPool;
+    }
+
+    std::size_t Rasterizer::get_tileSize() const
+    {
+        return _tileSize;
+    }
+
+    void Rasterizer::set_tileSize(std::size_t size)
+    {
+        _tileSize = std::max<std::size_t>(size, 1);
+    }
+
+    void Rasterizer::draw(Shape &shape)
+    {
+        const BoundingBox page{0, 0, static_cast<double>(_bitmap.get_width()),
+                               static_cast<double>(_bitmap.get_height())};
+        _edges.clear();
+        Layout layout(shape);
+        for (const auto &placement : layout.placements())
+        {
+            auto device = _transform;
+            device.concat(placement.transform);
+            auto scale = std::max(std::hypot(device.a, device.b), std::hypot(device.c, device.d));
+            auto area = std::abs(device.a * device.d - device.b * device.c);
+            if (scale == 0)
+            {
+                continue;
+            }
+            auto halfWidth = std::max(_lineWidth * std::sqrt(area), 1.0) / 2;
+            auto box = transformed(placement.shape->get_bounds(), device);
+            if (box.empty() || !BoundingBox{box.left - halfWidth, box.bottom - halfWidth, box.right + halfWidth,
+                                            box.top + halfWidth}.intersects(page))
+            {
+                continue;
+            }
+            _path.clear();
+            _path.set_pixelSize(1 / scale);
+            placement.shape->trace(_path);
+            strokePath(device, halfWidth);
+        }
+        if (_edges.empty() || _bitmap.get_width() == 0 || _bitmap.get_height() == 0)
+        {
+            return;
+        }
+        std::sort(_edges.begin(), _edges.end(), [](const Edge &a, const Edge &b) { return a.y0 < b.y0; });
+
+        // Edges are handed to each row of tiles they reach, so a tile only
+        // looks through the edges near it. Tiles pay even on one thread:
+        // each sorts the crossings of fewer edges per scanline.
+        auto numBands = (_bitmap.get_height() + _tileSize - 1) / _tileSize;
+        std::vector<std::vector<const Edge *>> bands(numBands);
+        for (const auto &edge : _edges)
+        {
+            if (edge.y1 <= 0 || edge.y0 >= _bitmap.get_height())
+            {
+                continue;
+            }
+            auto first = static_cast<std::size_t>(std::max(edge.y0, 0.0)) / _tileSize;
+            auto last = std::min(static_cast<std::size_t>(edge.y1) / _tileSize, numBands - 1);
+            for (auto band = first; band <= last; ++band)
+            {
+                bands[band].push_back(&edge);
+            }
+        }
+        std::vector<std::future<void>> tiles;
+        for (std::size_t band = 0; band < numBands; ++band)
+        {
+            auto top = band * _tileSize;
+            auto bottom = std::min(top + _tileSize, _bitmap.get_height());
+            for (std::size_t left = 0; left < _bitmap.get_width(); left += _tileSize)
+            {
+                auto right = std::min(left + _tileSize, _bitmap.get_width());
+                const auto &candidates = bands[band];
+                if (_threadPool == nullptr)
+                {
+                    fillTile(candidates, left, top, right, bottom);
+                    continue;
+                }
+                tiles.push_back(_threadPool->submit([=, &candidates] {
+                    fillTile(candidates, left, top, right, bottom);
+                }));
+            }
+        }
+        for (auto &tile : tiles)
+        {
+            _threadPool->wait(tile);
+        }
+    }
+
+    // Each segment becomes a rectangle half a line width to either side,
+    // extended by as much past both ends to cover the joins. The corners
+    // always go round the same way, so the rectangles' windings add up and
+    // the nonzero rule fills their union.
+    void Rasterizer::strokePath(const Transform &device, double halfWidth)
+    {
+        const auto &points = _path.points();
+        auto toDevice = [&](std::size_t index) {
+            auto [x, y] = device.apply(points[index].x, points[index].y);
+            return Path::Point{x, y};
+        };
+        auto strokeSegment = [&](const Path::Point &from, const Path::Point &to) {
+            auto dx = to.x - from.x;
+            auto dy = to.y - from.y;
+            auto length = std::hypot(dx, dy);
+            auto ux = length == 0 ? halfWidth : dx / length * halfWidth;
+            auto uy = length == 0 ? 0 : dy / length * halfWidth;
+            Path::Point corners[4] = {{from.x - ux - uy, from.y - uy + ux},
+                                      {to.x + ux - uy, to.y + uy + ux},
+                                      {to.x + ux + uy, to.y + uy - ux},
+                                      {from.x - ux + uy, from.y - uy - ux}};
+            auto [minX, maxX] = std::minmax({corners[0].x, corners[1].x, corners[2].x, corners[3].x});
+            for (auto corner = 0; corner < 4; ++corner)
+            {
+                addEdge(corners[corner], corners[(corner + 1) % 4], minX, maxX);
+            }
+        };
+        for (const auto &subpath : _path.subpaths())
+        {
+            auto first = toDevice(subpath.first);
+            auto previous = first;
+            if (subpath.count == 1)
+            {
+                strokeSegment(first, first);
+            }
+            for (auto index = subpath.first + 1; index < subpath.first + subpath.count; ++index)
+            {
+                auto current = toDevice(index);
+                strokeSegment(previous, current);
+                previous = current;
+            }
+            if (subpath.closed && subpath.count > 2)
+            {
+                strokeSegment(previous, first);
+            }
+        }
+    }
+
+    void Rasterizer::addEdge(const Path::Point &from, const Path::Point &to, double minX, double maxX)
+    {
+        if (from.y == to.y)
+        {
+            return;
+        }
+        if (from.y < to.y)
+        {
+            _edges.push_back({from.x, from.y, to.x, to.y, (to.x - from.x) / (to.y - from.y), minX, maxX, 1});
+            return;
+        }
+        _edges.push_back({to.x, to.y, from.x, from.y, (from.x - to.x) / (from.y - to.y), minX, maxX, -1});
+    }
+
+    // A quadrilateral is closed, so one wholly to either side of the tile
+    // adds nothing to the winding inside it, and its edges can be dropped.
+    // Without that, every tile would sort the crossings of everything to
+    // its left.
+    void Rasterizer::fillTile(const std::vector<const Edge *> &candidates, std::size_t left, std::size_t top,
+                              std::size_t right, std::size_t bottom) const
+    {
+        std::vector<const Edge *> edges;
+        for (auto edge : candidates)
+        {
+            if (edge->y1 > top && edge->y0 < bottom && edge->minX < right && edge->maxX > left)
+            {
+                edges.push_back(edge);
+            }
+        }
+        if (edges.empty())
+        {
+            return;
+        }
+
+        const auto channels = _bitmap.get_channels();
+        const auto gray = _bitmap.get_format() == Bitmap::Format::Gray;
+        const float target[4] = {static_cast<float>(gray ? luminance(_color) : _color.red),
+                                 static_cast<float>(_color.green), static_cast<float>(_color.blue), 255.0f};
+        const auto opacity = gray ? 1.0f : _color.alpha / 255.0f;
+        const auto weight = 1.0f / SUBSAMPLES;
+        std::vector<float> cover(right - left, 0.0f);
+        std::vector<const Edge *> active;
+        std::vector<std::pair<double, int>> crossings;
+        std::size_t next = 0;
+        for (auto y = top; y < bottom; ++y)
+        {
+            // Rows between shapes are skipped rather than scanned.
+            if (active.empty())
+            {
+                if (next == edges.size())
+                {
+                    break;
+                }
+                y = std::max(y, static_cast<std::size_t>(std::max(edges[next]->y0, 0.0)));
+                if (y >= bottom)
+                {
+                    break;
+                }
+            }
+            auto low = cover.size();
+            std::size_t high = 0;
+            for (auto sample = 0; sample < SUBSAMPLES; ++sample)
+            {
+                auto scanline = y + (sample + 0.5) / SUBSAMPLES;
+                while (next < edges.size() && edges[next]->y0 <= scanline)
+                {
+                    active.push_back(edges[next++]);
+                }
+                active.erase(std::remove_if(active.begin(), active.end(),
+                                            [scanline](const Edge *edge) { return edge->y1 <= scanline; }),
+                             active.end());
+                if (active.empty())
+                {
+                    continue;
+                }
+                crossings.clear();
+                for (auto edge : active)
+                {
+                    crossings.emplace_back(edge->x0 + (scanline - edge->y0) * edge->slope, edge->winding);
+                }
+                std::sort(crossings.begin(), crossings.end());
+                auto winding = 0;
+                for (std::size_t index = 0; index + 1 < crossings.size(); ++index)
+                {
+                    winding += crossings[index].second;
+                    if (winding != 0)
+                    {
+                        addSpan(cover, left, crossings[index].first, crossings[index + 1].first, weight, low, high);
+                    }
+                }
+            }
+            if (low >= high)
+            {
+                continue;
+            }
+            // Spans within a sub-scanline never overlap, so coverage stays
+            // within 1 and needs no clamping, which would keep these loops
+            // from vectorizing. The coverage is read through a plain pointer
+            // because the pixel stores, being bytes, could otherwise alias
+            // the vector's own.
+            auto pixels = _bitmap.row(y) + left * channels;
+            auto coverage = cover.data();
+            if (channels == 1)
+            {
+                for (auto x = low; x < high; ++x)
+                {
+                    auto alpha = coverage[x] * opacity;
+                    pixels[x] = static_cast<std::uint8_t>(pixels[x] + (target[0] - pixels[x]) * alpha + 0.5f);
+                    coverage[x] = 0;
+                }
+                continue;
+            }
+            for (auto x = low; x < high; ++x)
+            {
+                auto alpha = coverage[x] * opacity;
+                for (std::size_t channel = 0; channel < 4; ++channel)
+                {
+                    auto &pixel = pixels[4 * x + channel];
+                    pixel = static_cast<std::uint8_t>(pixel + (target[channel] - pixel) * alpha + 0.5f);
+                }
+                coverage[x] = 0;
+            }
+        }
+    }
+
+}
@@ -0,0 +1,171 @@
+// raster.hpp
+//
+// Draws shape trees into pixels in-process, for previews and thumbnails
+// without a PostScript interpreter. A shape is laid out (see layout.hpp),
+// each leaf traces its strokes into a Path, and every stroke segment is
+// widened into a quadrilateral. The quadrilaterals are filled together by
+// a scanline pass with the nonzero rule, so overlapping strokes darken
+// nothing twice, with four sub-scanlines per row for antialiasing.
+//
+// Spans are accumulated into a row of coverage and blended into the
+// bitmap in one straight loop per row, which the compiler vectorizes in
+// optimized builds (the default; see CMakeLists.txt).
+// The bitmap is filled in square tiles, each from only the edges that
+// reach it. With a thread pool the tiles are filled in parallel; they
+// share the edge list read-only and write disjoint pixels, so the result
+// is the same as with one thread.
+//
+
+#ifndef CS372_CPS_RASTER_H
+#define CS372_CPS_RASTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "layout.hpp"
+#include "path.hpp"
+#include "shape.hpp"
+#include "sink.hpp"
+#include "threadpool.hpp"
+
+namespace cps
+{
+
+    struct Color
+    {
+        std::uint8_t red{0};
+        std::uint8_t green{0};
+        std::uint8_t blue{0};
+        std::uint8_t alpha{255};
+    };
+
+    // Eight bits per channel, rows top to bottom, channels interleaved.
+    class Bitmap
+    {
+    public:
+        enum class Format
+        {
+            Gray,
+            Rgba
+        };
+
+        // Starts out opaque white, like a blank page.
+        Bitmap(std::size_t width, std::size_t height, Format format = Format::Gray);
+
+        std::size_t get_width() const;
+
+        std::size_t get_height() const;
+
+        Format get_format() const;
+
+        std::size_t get_channels() const;
+
+        std::uint8_t *row(std::size_t y);
+
+        const std::uint8_t *row(std::size_t y) const;
+
+        const std::vector<std::uint8_t> &pixels() const;
+
+        // Gray bitmaps hold the color's luminance and ignore its alpha.
+        Color get_pixel(std::size_t x, std::size_t y) const;
+
+        void fill(const Color &color);
+
+        // Binary PGM for gray bitmaps and PPM for color ones, which drops
+        // the alpha channel.
+        void writePpm(Sink &sink) const;
+
+        // PNG with the image data in stored (uncompressed) deflate blocks,
+        // which any reader accepts and costs nothing to write.
+        void writePng(Sink &sink) const;
+
+    private:
+        std::size_t _width;
+        std::size_t _height;
+        Format _format;
+        std::vector<std::uint8_t> _pixels;
+    };
+
+    class Rasterizer
+    {
+    public:
+        static constexpr std::size_t DEFAULT_TILE_SIZE = 64;
+
+        // Sub-scanlines per row of pixels.
+        static constexpr int SUBSAMPLES = 4;
+
+        // Draws into bitmap, which must outlive the rasterizer. The initial
+        // transform puts one point on each pixel with the origin at the
+        // bottom left, as on a 72 dpi page.
+        explicit Rasterizer(Bitmap &bitmap);
+
+        // Maps shape coordinates to pixels, with y growing downwards.
+        const Transform &get_transform() const;
+
+        void set_transform(const Transform &transform);
+
+        // Sets the transform to show all of box as large as it fits,
+        // centered, without distorting it.
+        void fit(const BoundingBox &box);
+
+        Color get_color() const;
+
+        void set_color(const Color &color);
+
+        // In shape units, like setlinewidth. Strokes are never drawn
+        // thinner than a pixel, so small thumbnails stay legible.
+        double get_lineWidth() const;
+
+        void set_lineWidth(double width);
+
+        // When set, tiles are filled in parallel on the pool.
+        ThreadPool *get_threadPool() const;
+
+        void set_threadPool(ThreadPool *threadPool);
+
+        std::size_t get_tileSize() const;
+
+        void set_tileSize(std::size_t size);
+
+        // Strokes every leaf of shape, centered on the origin, over what
+        // the bitmap already holds. Detail below a pixel is simplified as
+        // it is for Sink::set_resolution.
+        void draw(Shape &shape);
+
+    private:
+        // A non-horizontal edge with y0 < y1, in pixels, and the span of x
+        // covered by the quadrilateral it belongs to.
+        struct Edge
+        {
+            double x0;
+            double y0;
+            double x1;
+            double y1;
+            double slope;
+            double minX;
+            double maxX;
+            int winding;
+        };
+
+        void strokePath(const Transform &device, double halfWidth);
+
+        void addEdge(const Path::Point &from, const Path::Point &to, double minX, double maxX);
+
+        // Fills the tile from the candidates that reach it, in order of y0.
+        void fillTile(const std::vector<const Edge *> &candidates, std::size_t left, std::size_t top,
+                      std::size_t right, std::size_t bottom) const;
+
+        Bitmap &_bitmap;
+        Transform _transform;
+        Color _color{};
+        double _lineWidth{1};
+        ThreadPool *_threadPool{nullptr};
+        std::size_t _tileSize{DEFAULT_TILE_SIZE};
+        Path _path{};
+        std::vector<Edge> _edges{};
+    };
+
+}
+
+#endif //CS372_CPS_RASTER_H
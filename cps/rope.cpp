@@ -0,0 +1,134 @@
+// rope.cpp
+//
+
+#include "rope.hpp"
+
+#include <utility>
+
+namespace cps
+{
+
+    Rope::Node::~Node()
+    {
+        // Release long chains of nodes with a loop rather than recursion.
+        std::vector<std::shared_ptr<const Node>> pending;
+        for (auto &piece : pieces)
+        {
+            if (piece.rope && piece.rope.use_count() == 1)
+            {
+                pending.push_back(std::move(piece.rope));
+            }
+        }
+        while (!pending.empty())
+        {
+            auto node = std::move(pending.back());
+            pending.pop_back();
+            for (auto &piece : const_cast<Node &>(*node).pieces)
+            {
+                if (piece.rope && piece.rope.use_count() == 1)
+                {
+                    pending.push_back(std::move(piece.rope));
+                }
+            }
+        }
+    }
+
+    Rope::Rope(std::string text)
+    {
+        append(std::move(text));
+    }
+
+    Rope &Rope::append(std::string text)
+    {
+        if (text.empty())
+        {
+            return *this;
+        }
+        auto &node = mutableNode();
+        node.size += text.size();
+        if (!node.pieces.empty() && !node.pieces.back().rope)
+        {
+            node.pieces.back().text += text;
+        }
+        else
+        {
+            node.pieces.push_back({std::move(text), nullptr});
+        }
+        return *this;
+    }
+
+    Rope &Rope::append(const Rope &rope)
+    {
+        if (rope.empty())
+        {
+            return *this;
+        }
+        // Take the reference first so appending a rope to itself links the
+        // old contents rather than the node being modified.
+        std::shared_ptr<const Node> linked = rope._node;
+        auto &node = mutableNode();
+        node.size += linked->size;
+        node.pieces.push_back({std::string(), std::move(linked)});
+        return *this;
+    }
+
+    std::size_t Rope::size() const
+    {
+        return _node ? _node->size : 0;
+    }
+
+    bool Rope::empty() const
+    {
+        return size() == 0;
+    }
+
+    void Rope::writeTo(Sink &sink) const
+    {
+        if (!_node)
+        {
+            return;
+        }
+        std::vector<std::pair<const Node *, std::size_t>> stack{{_node.get(), 0}};
+        while (!stack.empty())
+        {
+            auto &top = stack.back();
+            if (top.second == top.first->pieces.size())
+            {
+                stack.pop_back();
+                continue;
+            }
+            const auto &piece = top.first->pieces[top.second++];
+            if (piece.rope)
+            {
+                stack.emplace_back(piece.rope.get(), 0);
+            }
+            else
+            {
+                sink.write(piece.text.data(), piece.text.size());
+            }
+        }
+    }
+
+    std::string Rope::str() const
+    {
+        BufferSink sink;
+        sink.reserve(size());
+        writeTo(sink);
+        return sink.release();
+    }
+
+    Rope::Node &Rope::mutableNode()
+    {
+        if (!_node)
+        {
+            _node = std::make_shared<Node>();
+        }
+        else if (_node.use_count() > 1)
+        {
+            // Copy on write: other ropes still link the current pieces.
+            _node = std::make_shared<Node>(*_node);
+        }
+        return *_node;
+    }
+
+}
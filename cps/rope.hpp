@@ -0,0 +1,69 @@
+// rope.hpp
+//
+// A rope of PostScript text. Appending one rope to another links the
+// other's pieces by reference instead of copying them, so building a
+// fragment for a deeply nested scene costs the same at every level and
+// the text is only copied once, when the rope is finally written out.
+//
+
+#ifndef CS372_CPS_ROPE_H
+#define CS372_CPS_ROPE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sink.hpp"
+
+namespace cps
+{
+
+    class Rope
+    {
+    public:
+        Rope() = default;
+
+        explicit Rope(std::string text);
+
+        Rope &append(std::string text);
+
+        Rope &append(const Rope &rope);
+
+        std::size_t size() const;
+
+        bool empty() const;
+
+        void writeTo(Sink &sink) const;
+
+        std::string str() const;
+
+    private:
+        struct Node;
+
+        struct Piece
+        {
+            std::string text;
+            std::shared_ptr<const Node> rope;
+        };
+
+        struct Node
+        {
+            Node() = default;
+
+            Node(const Node &) = default;
+
+            ~Node();
+
+            std::vector<Piece> pieces;
+            std::size_t size{0};
+        };
+
+        Node &mutableNode();
+
+        std::shared_ptr<Node> _node{};
+    };
+
+}
+
+#endif //CS372_CPS_ROPE_H
@@ -4,19 +4,115 @@
 //
 #include <sstream>
 using std::stringstream;
-#include <cmath>
-using std::cos, std::sin;
 
 #include "shape.hpp"
+#include "arena.hpp"
+#include "compoundshape.hpp"
+#include "layout.hpp"
+#include "primitives.hpp"
 
-#include <algorithm>
+#include <cstddef>
 #include <random>
 #include <functional>
 
 namespace cps
 {
 
+    // BoundingBox Struct
+    BoundingBox BoundingBox::none()
+    {
+        return {0, 0, -1, -1};
+    }
+
+    bool BoundingBox::empty() const
+    {
+        return left > right || bottom > top;
+    }
+
+    void BoundingBox::include(const BoundingBox &other)
+    {
+        if (other.empty())
+        {
+            return;
+        }
+        if (empty())
+        {
+            *this = other;
+            return;
+        }
+        left = std::min(left, other.left);
+        bottom = std::min(bottom, other.bottom);
+        right = std::max(right, other.right);
+        top = std::max(top, other.top);
+    }
+
+    bool BoundingBox::intersects(const BoundingBox &other) const
+    {
+        return !empty() && !other.empty() &&
+               left <= other.right && other.left <= right && bottom <= other.top && other.bottom <= top;
+    }
+
+    void BoundingBox::expand(double margin)
+    {
+        if (empty())
+        {
+            return;
+        }
+        left -= margin;
+        bottom -= margin;
+        right += margin;
+        top += margin;
+    }
+
     // Base Class
+    Shape::Shape(const Shape &other)
+            : _height{other._height}, _width{other._width}
+    {}
+
+    // Scaled shapes left drawing this one forget it, so they do not unlink
+    // themselves from a shape that is gone when they are destroyed in turn.
+    Shape::~Shape()
+    {
+        for (auto observer = _observers; observer; observer = observer->_nextObserver)
+        {
+            observer->_originalShape = nullptr;
+        }
+    }
+
+    Shape &Shape::operator=(const Shape &other)
+    {
+        _height = other._height;
+        _width = other._width;
+        invalidateParent();
+        return *this;
+    }
+
+    namespace
+    {
+        // Every shape is preceded by the resource it came from, so delete
+        // can give it back without knowing whether an arena was active.
+        constexpr std::size_t ALLOCATION_HEADER = alignof(std::max_align_t);
+    }
+
+    void *Shape::operator new(std::size_t size)
+    {
+        auto resource = currentResource();
+        auto block = resource->allocate(size + ALLOCATION_HEADER, ALLOCATION_HEADER);
+        *static_cast<std::pmr::memory_resource **>(block) = resource;
+        return static_cast<char *>(block) + ALLOCATION_HEADER;
+    }
+
+    void Shape::operator delete(void *pointer, std::size_t size)
+    {
+        if (!pointer)
+        {
+            return;
+        }
+        auto block = static_cast<char *>(pointer) - ALLOCATION_HEADER;
+        auto resource = *reinterpret_cast<std::pmr::memory_resource **>(block);
+        resource->deallocate(block, size + ALLOCATION_HEADER, ALLOCATION_HEADER);
+    }
+
     double Shape::get_height()
     {
         return _height;
@@ -30,11 +126,261 @@ namespace cps
     void Shape::set_height(double height)
     {
         _height = height;
+        invalidateParent();
     }
 
     void Shape::set_width(double width)
     {
         _width = width;
+        invalidateParent();
+    }
+
+    bool Shape::invalidate()
+    {
+        return true;
+    }
+
+    // A loop rather than recursion, so a change deep in a tall tree does
+    // not use stack in proportion to its depth. The chain of parents is
+    // followed first; Scaled shapes met along the way are kept on a stack
+    // and their own chains followed afterwards.
+    void Shape::invalidateParent()
+    {
+        std::vector<Shape *> pending;
+        auto shape = this;
+        while (true)
+        {
+            for (auto observer = shape->_observers; observer; observer = observer->_nextObserver)
+            {
+                if (observer->invalidate())
+                {
+                    pending.push_back(observer);
+                }
+            }
+            shape = shape->_parent;
+            if (shape && shape->invalidate())
+            {
+                continue;
+            }
+            if (pending.empty())
+            {
+                return;
+            }
+            shape = pending.back();
+            pending.pop_back();
+        }
+    }
+
+    void Shape::adopt(Shape &child, Shape *parent)
+    {
+        child._parent = parent;
+    }
+
+    void Shape::setSize(double width, double height)
+    {
+        _width = width;
+        _height = height;
+    }
+
+    void Shape::layout(LayoutBuilder &builder)
+    {
+        if (get_numChildren() == 0)
+        {
+            builder.place(*this);
+            return;
+        }
+        traverse(builder, [](Shape &) { return true; }, [&](Shape &child) { child.layout(builder); });
+    }
+
+    void Shape::emitPdf(Sink &)
+    {}
+
+    void Shape::trace(Path &)
+    {}
+
+    Rope Shape::fragment()
+    {
+        BufferSink glue;
+        if (get_numChildren() == 0)
+        {
+            emit(glue);
+            return Rope(glue.release());
+        }
+        Rope rope;
+        traverse(static_cast<Sink &>(glue), [](Shape &) { return true; }, [&](Shape &child) {
+            rope.append(glue.release());
+            rope.append(child.fragment());
+        });
+        rope.append(glue.release());
+        return rope;
+    }
+
+    std::size_t Shape::get_numChildren()
+    {
+        return 0;
+    }
+
+    Shape &Shape::childAt(std::size_t)
+    {
+        return *this;
+    }
+
+    void Shape::openChildren(Sink &)
+    {}
+
+    void Shape::openChildren(LayoutBuilder &)
+    {}
+
+    void Shape::beforeChild(std::size_t, double &, Sink &)
+    {}
+
+    void Shape::beforeChild(std::size_t, double &, LayoutBuilder &)
+    {}
+
+    void Shape::afterChild(std::size_t, double &, Sink &)
+    {}
+
+    void Shape::afterChild(std::size_t, double &, LayoutBuilder &)
+    {}
+
+    void Shape::closeChildren(double &, Sink &)
+    {}
+
+    void Shape::closeChildren(double &, LayoutBuilder &)
+    {}
+
+    void Shape::openChildren(TrackedSink &target)
+    {
+        openChildren(target.sink);
+        openChildren(target.builder);
+    }
+
+    // The sink and builder steps each advance a copy of the same cursor.
+    void Shape::beforeChild(std::size_t index, double &cursor, TrackedSink &target)
+    {
+        auto shadow = cursor;
+        beforeChild(index, cursor, target.sink);
+        beforeChild(index, shadow, target.builder);
+    }
+
+    void Shape::afterChild(std::size_t index, double &cursor, TrackedSink &target)
+    {
+        auto shadow = cursor;
+        afterChild(index, cursor, target.sink);
+        afterChild(index, shadow, target.builder);
+    }
+
+    void Shape::closeChildren(double &cursor, TrackedSink &target)
+    {
+        auto shadow = cursor;
+        closeChildren(cursor, target.sink);
+        closeChildren(shadow, target.builder);
+    }
+
+    bool Shape::emitsWhole()
+    {
+        return false;
+    }
+
+    void Shape::emitTree(Sink &sink)
+    {
+        traverse(sink, [](Shape &child) { return !child.emitsWhole(); }, [&](Shape &child) { child.emit(sink); });
+    }
+
+    CompoundShape *Shape::pendingMetrics()
+    {
+        return nullptr;
+    }
+
+    CompoundShape *Shape::pendingBounds()
+    {
+        return nullptr;
+    }
+
+    void Shape::releaseChildren(std::vector<Shape_ptr> &)
+    {}
+
+    void Shape::destroyAll(std::vector<Shape_ptr> &pending)
+    {
+        while (!pending.empty())
+        {
+            auto shape = std::move(pending.back());
+            pending.pop_back();
+            shape->releaseChildren(pending);
+        }
+    }
+
+    void Shape::visitChildren(const std::function<void(Shape &)> &)
+    {}
+
+    std::size_t Shape::get_nodeCount()
+    {
+        return 1;
+    }
+
+    BoundingBox Shape::get_bounds()
+    {
+        auto width = get_width();
+        auto height = get_height();
+        return {-width / 2, -height / 2, width / 2, height / 2};
+    }
+
+    std::pair<double, double> Shape::get_drift()
+    {
+        return {0, 0};
+    }
+
+    std::stringstream Shape::generate()
+    {
+        BufferSink sink;
+        emit(sink);
+        return std::stringstream(sink.release());
+    }
+
+    std::stringstream Shape::generate(const BoundingBox &clip)
+    {
+        BufferSink sink;
+        emitVisible(sink, clip);
+        return std::stringstream(sink.release());
+    }
+
+    void Shape::emitVisible(Sink &sink, const BoundingBox &clip)
+    {
+        std::vector<Placement> unused;
+        LayoutBuilder builder(unused);
+        auto visible = [&](Shape &shape) {
+            return transformed(shape.get_bounds(), builder.current()).intersects(clip);
+        };
+        // A subtree left out still moves the current point as it would have.
+        auto drift = [&](Shape &shape, bool write) {
+            auto offset = shape.get_drift();
+            if (offset.first != 0 || offset.second != 0)
+            {
+                if (write)
+                {
+                    writeSpacer(sink, offset.first, offset.second);
+                }
+                builder.translate(offset.first, offset.second);
+            }
+        };
+        auto leaf = [&](Shape &shape) {
+            if (visible(shape))
+            {
+                shape.emit(sink);
+                drift(shape, false);
+            }
+            else
+            {
+                drift(shape, true);
+            }
+        };
+        if (get_numChildren() == 0 || !visible(*this))
+        {
+            leaf(*this);
+            return;
+        }
+        TrackedSink target{sink, builder};
+        traverse(target, visible, leaf);
     }
 
     // Circle Class
@@ -55,30 +401,44 @@ namespace cps
     void Circle::set_height(double height)
     {
         _radius = height / 2;
+        invalidateParent();
     }
 
     void Circle::set_width(double width)
     {
         _radius = width / 2;
+        invalidateParent();
     }
 
-    std::stringstream Circle::generate()
+    void Circle::emit(Sink &sink)
     {
-        return std::stringstream("0 0 " + std::to_string(_radius) + " 0 360 arc stroke\n");
+        writeCircle(sink, _radius);
+    }
+
+    void Circle::emitPdf(Sink &sink)
+    {
+        writePdfCircle(sink, _radius);
+    }
+
+    void Circle::trace(Path &path)
+    {
+        traceCircle(path, _radius);
     }
 
     // Rectangle Class
-    std::stringstream Rectangle::generate()
+    void Rectangle::emit(Sink &sink)
+    {
+        writeRectangle(sink, get_width(), get_height());
+    }
+
+    void Rectangle::emitPdf(Sink &sink)
     {
-        return std::stringstream("newpath\n"
-                                 + std::to_string(-1 * get_width() / 2) + " " + std::to_string(-1 * get_height() / 2) +
-                                 " moveto\n"
-                                 + std::to_string(get_width()) + " 0 rlineto\n"
-                                 + "0 " + std::to_string(get_height()) + " rlineto\n"
-                                 + std::to_string(-1 * get_width()) + " 0 rlineto\n"
-                                                                      "closepath\n"
-                                                                      "0 0 moveto\n"
-                                                                      "stroke\n");
+        writePdfRectangle(sink, get_width(), get_height());
+    }
+
+    void Rectangle::trace(Path &path)
+    {
+        traceRectangle(path, get_width(), get_height());
     }
 
     Rectangle::Rectangle(double width, double height)
@@ -93,108 +453,107 @@ namespace cps
         _numSides = numSides;
         _sideLength = sideLength;
 
-        if (numSides % 2 == 1)
-        {
-            set_height(sideLength * (1.0 + cos(pi / numSides)) / (2.0 * sin(pi / numSides)));
-            set_width((sideLength * sin(pi * (numSides - 1) / (2 * numSides))) / sin(pi / numSides));
-        }
-        else if (numSides % 4 == 0)
-        {
-            set_height(sideLength * (cos(pi / numSides)) / (sin(pi / numSides)));
-            set_width(get_height());
-        }
-        else
-        {
-            set_height(sideLength * (cos(pi / numSides)) / (sin(pi / numSides)));
-            set_width(sideLength / sin(pi / numSides));
-        }
+        auto size = polygonSize(numSides, sideLength);
+        set_width(size.first);
+        set_height(size.second);
     }
 
-    std::stringstream Polygon::generate()
+    void Polygon::emit(Sink &sink)
     {
-        std::stringstream output;
+        writePolygon(sink, _numSides, _sideLength, get_width(), get_height());
+    }
 
-        output << "/length " << std::to_string(_sideLength) << " def\n";
-        output << "/nSides " << std::to_string(_numSides) << " def\n";
-        output << "/angle { 360 nSides div } def\n";
-        output << "gsave\n";
-        output << std::to_string(-get_width() / 2) << " " << std::to_string(-get_height() / 2) << " translate\n";
-        output << "newpath\n";
-        output << "0 0 moveto\n";
-        output << "0 angle 360 {\n";
-        output << "length 0 lineto\n";
-        output << "length 0 translate\n";
-        output << "angle rotate\n";
-        output << "} for\n";
-        output << "closepath\n";
-        output << "stroke\n";
-        output << "grestore\n";
+    void Polygon::emitPdf(Sink &sink)
+    {
+        writePdfPolygon(sink, _numSides, _sideLength, get_width(), get_height());
+    }
 
-        return output;
+    void Polygon::trace(Path &path)
+    {
+        tracePolygon(path, _numSides, _sideLength, get_width(), get_height());
     }
 
     Skyline::Skyline(int numOfBuildings)
-            : _buildings{generateBuildings(numOfBuildings)}
+            : Skyline(numOfBuildings, nextSeed())
+    {}
+
+    Skyline::Skyline(int numOfBuildings, std::uint64_t seed)
+            : _buildings(static_cast<std::size_t>(std::max(numOfBuildings, 0)), currentResource())
     {
-        double maxWidth = 0.0;
-        for (const auto &building : _buildings)
+        generateBuildings(seed, 0, _buildings, 0, _buildings.size());
+        updateSize();
+    }
+
+    Skyline::Skyline(const std::vector<Footprint> &footprints)
+            : _buildings(buildingsFromFootprints(footprints), currentResource())
+    {
+        updateSize();
+    }
+
+    bool Skyline::get_outline() const
+    {
+        return _outline;
+    }
+
+    // The outline is built here rather than on first emit so emitting
+    // never modifies the shape.
+    void Skyline::set_outline(bool outline)
+    {
+        _outline = outline;
+        if (_outline && _outlinePoints.empty())
         {
-            maxWidth += building.width;
-            maxWidth += building.spacing;
+            _outlinePoints = skylineOutline(_buildings.columns());
         }
-        maxWidth += _buildings.front().spacing;
+    }
 
-        double maxHeight = 0.0;
-        if (!_buildings.empty())
+    void Skyline::emit(Sink &sink)
+    {
+        if (!_outline)
         {
-            maxHeight = std::max_element(
-                    _buildings.begin(),
-                    _buildings.end(),
-                    [](auto a, auto b) { return a.height < b.height; })->height;
+            writeSkyline(sink, get_width(), get_height(), _buildings.columns());
+            return;
         }
-
-        set_width(maxWidth);
-        set_height(maxHeight);
+        writeSkylineOutline(sink, get_width(), get_height(), _outlinePoints);
     }
 
-    std::stringstream Skyline::generate()
+    void Skyline::emitPdf(Sink &sink)
     {
-        std::stringstream output;
-        output << "gsave" << std::endl;
-        output << (-(get_width() / 2)) << " " << (-(get_height() / 2)) << " moveto" << std::endl;
-        for (auto building : _buildings)
+        if (!_outline)
         {
-            output << building.spacing << " 0 rlineto" << std::endl;
-            output << "0 " << building.height << " rlineto" << std::endl;
-            output << building.width << " 0 rlineto" << std::endl;
-            output << "0 " << -building.height << " rlineto" << std::endl;
+            writePdfSkyline(sink, get_width(), get_height(), _buildings.columns());
+            return;
         }
-
-        output << _buildings.front().spacing << " 0 rlineto" << std::endl;
-        output << "0 0 moveto" << std::endl;
-        output << "stroke" << std::endl;
-        output << "grestore" << std::endl;
-        return output;
+        writePdfSkylineOutline(sink, get_width(), get_height(), _outlinePoints);
     }
 
-    std::vector<Skyline::Building> Skyline::generateBuildings(int numOfBuildings)
+    void Skyline::trace(Path &path)
     {
-        std::random_device rd;
-        std::mt19937 generator(rd());
-
-        std::uniform_real_distribution<> randomHeight(10, 100);
-        std::uniform_real_distribution<> randomWidth(20, 50);
-        std::uniform_real_distribution<> randomSpacing(5, 20);
-
-        std::vector<Building> outputVector(numOfBuildings);
-        for (auto &building : outputVector)
+        if (!_outline)
         {
-            building.height = randomHeight(generator);
-            building.width = randomWidth(generator);
-            building.spacing = randomSpacing(generator);
+            traceSkyline(path, get_width(), get_height(), _buildings.columns());
+            return;
         }
+        traceSkylineOutline(path, get_width(), get_height(), _outlinePoints);
+    }
+
+    std::size_t Skyline::get_nodeCount()
+    {
+        return 1 + _buildings.size();
+    }
 
-        return outputVector;
+    // Only the first skyline on each thread touches std::random_device.
+    std::uint64_t Skyline::nextSeed()
+    {
+        thread_local std::uint64_t state = (std::uint64_t(std::random_device{}()) << 32) ^ std::random_device{}();
+        state += 0x9e3779b97f4a7c15ULL;
+        return state;
+    }
+
+    void Skyline::updateSize()
+    {
+        auto size = skylineSize(_buildings.columns());
+        set_width(size.first);
+        set_height(size.second);
     }
 
     Spacer::Spacer(double width, double height)
@@ -203,37 +562,131 @@ namespace cps
         set_height(height);
     }
 
-    std::stringstream Spacer::generate()
+    void Spacer::emit(Sink &sink)
     {
-        return std::stringstream(
-                std::to_string(get_width()) + " " +
-                std::to_string(get_height()) + " translate\n"
-        );
+        writeSpacer(sink, get_width(), get_height());
     }
 
+    void Spacer::layout(LayoutBuilder &builder)
+    {
+        builder.translate(get_width(), get_height());
+    }
+
+    // A spacer marks nothing.
+    BoundingBox Spacer::get_bounds()
+    {
+        return BoundingBox::none();
+    }
 
-    Rotated::Rotated(Shape_ptr shape, int degrees) : _rotation{degrees}
+    std::pair<double, double> Spacer::get_drift()
     {
-        if (degrees == 90 || degrees == 270)
+        return {get_width(), get_height()};
+    }
+
+
+    Rotated::Rotated(Shape_ptr shape, int degrees)
+            : _originalShape{std::move(shape)}, _rotation{degrees}
+    {
+        adopt(*_originalShape, this);
+        updateSize();
+    }
+
+    Rotated::~Rotated()
+    {
+        std::vector<Shape_ptr> pending;
+        releaseChildren(pending);
+        destroyAll(pending);
+    }
+
+    bool Rotated::invalidate()
+    {
+        updateSize();
+        return true;
+    }
+
+    void Rotated::updateSize()
+    {
+        if (_rotation == 90 || _rotation == 270)
         {
-            set_height(shape->get_width());
-            set_width(shape->get_height());
+            setSize(_originalShape->get_height(), _originalShape->get_width());
         }
         else
         {
-            set_width(shape->get_width());
-            set_height(shape->get_height());
+            setSize(_originalShape->get_width(), _originalShape->get_height());
+        }
+        _nodeCount = 1 + _originalShape->get_nodeCount();
+        _boundsValid = false;
+    }
+
+    void Rotated::emit(Sink &sink)
+    {
+        emitTree(sink);
+    }
+
+    std::size_t Rotated::get_numChildren()
+    {
+        return 1;
+    }
+
+    Shape &Rotated::childAt(std::size_t)
+    {
+        return *_originalShape;
+    }
+
+    void Rotated::openChildren(Sink &sink)
+    {
+        sink << "gsave\n" << _rotation << " rotate\n";
+    }
+
+    void Rotated::openChildren(LayoutBuilder &builder)
+    {
+        builder.save();
+        builder.rotate(_rotation);
+    }
+
+    void Rotated::closeChildren(double &, Sink &sink)
+    {
+        sink << "grestore\n";
+    }
+
+    void Rotated::closeChildren(double &, LayoutBuilder &builder)
+    {
+        builder.restore();
+    }
+
+    void Rotated::releaseChildren(std::vector<Shape_ptr> &pending)
+    {
+        if (_originalShape)
+        {
+            pending.push_back(std::move(_originalShape));
         }
+    }
 
-        _originalShape = std::move(shape);
+    void Rotated::visitChildren(const std::function<void(Shape &)> &visitor)
+    {
+        visitor(*_originalShape);
+    }
+
+    std::size_t Rotated::get_nodeCount()
+    {
+        return _nodeCount;
+    }
+
+    BoundingBox Rotated::get_bounds()
+    {
+        if (!_boundsValid)
+        {
+            Transform rotation;
+            rotation.rotate(_rotation);
+            _bounds = transformed(_originalShape->get_bounds(), rotation);
+            _boundsValid = true;
+        }
+        return _bounds;
     }
 
-    std::stringstream Rotated::generate()
+    CompoundShape *Rotated::pendingBounds()
     {
-        return std::stringstream("gsave\n"
-                                 + std::to_string(_rotation) + " rotate\n"
-                                 + _originalShape->generate().str()
-                                 + "grestore\n");
+        return _originalShape->pendingBounds();
     }
 
 }
@@ -6,20 +6,79 @@
 #ifndef CS372_CPS_SHAPE_H
 #define CS372_CPS_SHAPE_H
 
+#include <algorithm>
 #include <sstream>
 #include <cmath>
 #include <vector>
 #include <memory>
+#include <memory_resource>
+#include <functional>
+#include <cstdint>
+#include <random>
+#include <type_traits>
+#include <utility>
+
+#include "arena.hpp"
+#include "primitives.hpp"
+#include "rope.hpp"
+#include "sink.hpp"
 
 namespace cps
 {
 
+    class LayoutBuilder;
+    class CompoundShape;
+    class Scaled;
+
+    // Every path is stroked with the default line width, half of which
+    // falls outside the path; see BoundingBox::expand.
+    constexpr double LINE_WIDTH = 1;
+
+    // An axis-aligned rectangle in user space.
+    struct BoundingBox
+    {
+        double left{0};
+        double bottom{0};
+        double right{0};
+        double top{0};
+
+        // A box covering nothing, for shapes that make no marks. Including it
+        // changes nothing and it intersects nothing.
+        static BoundingBox none();
+
+        bool empty() const;
+
+        // Grows this box to cover other as well.
+        void include(const BoundingBox &other);
+
+        // True when the boxes share any point, edges included.
+        bool intersects(const BoundingBox &other) const;
+
+        // Grows a non-empty box by margin on every side. Bounds cover the
+        // paths a shape strokes, so page boxes add LINE_WIDTH / 2 to take in
+        // the outer half of the strokes along their edges.
+        void expand(double margin);
+    };
+
     class Shape
     {
     public:
         using Shape_ptr = std::unique_ptr<Shape>;
 
-        virtual ~Shape() = default;
+        Shape() = default;
+
+        // Copies never inherit the original's place in a tree.
+        Shape(const Shape &other);
+
+        Shape &operator=(const Shape &other);
+
+        virtual ~Shape();
+
+        // Shapes come from the current Arena when one is active; see
+        // arena.hpp.
+        static void *operator new(std::size_t size);
+
+        static void operator delete(void *pointer, std::size_t size);
 
         virtual double get_height();
 
@@ -29,11 +88,148 @@ namespace cps
 
         virtual void set_width(double width);
 
-        virtual std::stringstream generate() = 0;
+        virtual void emit(Sink &sink) = 0;
+
+        // Describes this shape to a layout pass; see layout.hpp. Leaves
+        // place themselves, containers walk their children.
+        virtual void layout(LayoutBuilder &builder);
+
+        // The same text emit writes, as a rope that links the fragments of
+        // child shapes instead of copying them.
+        virtual Rope fragment();
+
+        // Writes this leaf as PDF content stream operators; see pdf.hpp.
+        // Containers are drawn through a layout instead, and leaves with no
+        // PDF form draw nothing.
+        virtual void emitPdf(Sink &sink);
+
+        // Traces this leaf's strokes into path; see raster.hpp. As with
+        // emitPdf, containers are drawn through a layout, and leaves that
+        // mark nothing trace nothing.
+        virtual void trace(Path &path);
+
+        // Calls visitor on each direct child, in emission order.
+        virtual void visitChildren(const std::function<void(Shape &)> &visitor);
+
+        // The box this shape's marks fall within, relative to the current
+        // point it is emitted at. Most shapes are centered on that point.
+        virtual BoundingBox get_bounds();
+
+        // How far emitting this shape moves the current point for whatever
+        // follows it. Only Spacers move it; Rotated and Scaled shapes put
+        // back whatever their children did.
+        virtual std::pair<double, double> get_drift();
+
+        // Emits only the parts of this shape that can show inside clip,
+        // which is given in the coordinates this shape is emitted in. A
+        // subtree whose bounds, under the rotations, scales and translations
+        // above it, lie wholly outside is left out except for its drift.
+        // Compounds are walked in place rather than split across a pool.
+        void emitVisible(Sink &sink, const BoundingBox &clip);
+
+        // A rough measure of the work emitting this shape takes: the shapes
+        // in its subtree, with each skyline building counted as one. Used to
+        // split parallel emission into even pieces.
+        virtual std::size_t get_nodeCount();
+
+        std::stringstream generate();
+
+        std::stringstream generate(const BoundingBox &clip);
+
+    protected:
+        // Called when the size of this shape or of one of its children has
+        // changed. Shapes that cache sizes derived from their children
+        // override this to update or drop the cache, and return false when
+        // nothing above them needs telling.
+        virtual bool invalidate();
+
+        void invalidateParent();
+
+        static void adopt(Shape &child, Shape *parent);
+
+        // Sets the size without notifying the parent, for shapes that are
+        // already being notified.
+        void setSize(double width, double height);
+
+        // Containers emit, lay out and fragment their subtrees through these
+        // steps, which traverse() drives from an explicit stack so nesting
+        // is limited by memory rather than by the call stack. The cursor is
+        // per container and starts at zero. Leaves keep the defaults.
+        virtual std::size_t get_numChildren();
+
+        virtual Shape &childAt(std::size_t index);
+
+        virtual void openChildren(Sink &sink);
+
+        virtual void openChildren(LayoutBuilder &builder);
+
+        virtual void beforeChild(std::size_t index, double &cursor, Sink &sink);
+
+        virtual void beforeChild(std::size_t index, double &cursor, LayoutBuilder &builder);
+
+        virtual void afterChild(std::size_t index, double &cursor, Sink &sink);
+
+        virtual void afterChild(std::size_t index, double &cursor, LayoutBuilder &builder);
+
+        virtual void closeChildren(double &cursor, Sink &sink);
+
+        virtual void closeChildren(double &cursor, LayoutBuilder &builder);
+
+        // A sink followed by a builder tracking the transform in effect, for
+        // passes that need to know where they are drawing.
+        struct TrackedSink
+        {
+            Sink &sink;
+            LayoutBuilder &builder;
+        };
+
+        void openChildren(TrackedSink &target);
+
+        void beforeChild(std::size_t index, double &cursor, TrackedSink &target);
+
+        void afterChild(std::size_t index, double &cursor, TrackedSink &target);
+
+        void closeChildren(double &cursor, TrackedSink &target);
+
+        // True for a container that emits itself some other way, such as a
+        // compound splitting across a thread pool; emitTree hands it to
+        // emit() rather than expanding it in place.
+        virtual bool emitsWhole();
+
+        // Walks this container's subtree, expanding the children descend
+        // accepts and handing every other child to leaf.
+        template<typename Target, typename Descend, typename Leaf>
+        void traverse(Target &target, Descend descend, Leaf leaf);
+
+        void emitTree(Sink &sink);
+
+        // The compound below this shape, if any, whose cached sizes are out
+        // of date; compounds bring such children up to date before measuring
+        // themselves.
+        virtual CompoundShape *pendingMetrics();
+
+        // Likewise for bounds and drift, which compounds work out separately
+        // and only when asked.
+        virtual CompoundShape *pendingBounds();
+
+        // Moves the children of this shape into pending.
+        virtual void releaseChildren(std::vector<Shape_ptr> &pending);
+
+        // Destroys the shapes in pending and all their descendants.
+        static void destroyAll(std::vector<Shape_ptr> &pending);
 
     private:
+        friend class CompoundShape;
+        friend class Scaled;
+        friend class Rotated;
+
         double _height{0};
         double _width{0};
+        Shape *_parent{nullptr};
+        // Scaled shapes drawing this one, linked through their own
+        // _nextObserver. They are not parents, but they measure this shape,
+        // so changes to it must reach the compounds holding them as well.
+        Scaled *_observers{nullptr};
     };
 
 
@@ -52,7 +248,11 @@ namespace cps
 
         void set_width(double width) override;
 
-        std::stringstream generate() override;
+        void emit(Sink &sink) override;
+
+        void emitPdf(Sink &sink) override;
+
+        void trace(Path &path) override;
 
     private:
 
@@ -66,7 +266,11 @@ namespace cps
 
         Rectangle(double, double);
 
-        std::stringstream generate() override;
+        void emit(Sink &sink) override;
+
+        void emitPdf(Sink &sink) override;
+
+        void trace(Path &path) override;
 
     private:
     };
@@ -76,7 +280,13 @@ namespace cps
     public:
         Spacer(double, double);
 
-        std::stringstream generate() override;
+        void emit(Sink &sink) override;
+
+        void layout(LayoutBuilder &builder) override;
+
+        BoundingBox get_bounds() override;
+
+        std::pair<double, double> get_drift() override;
 
     private:
     };
@@ -88,12 +298,15 @@ namespace cps
 
         Polygon(int, double);
 
-        std::stringstream generate() override;
+        void emit(Sink &sink) override;
+
+        void emitPdf(Sink &sink) override;
+
+        void trace(Path &path) override;
 
     private:
-        const double pi = std::acos(-1);
-        float _numSides{0};
-        float _sideLength{0};
+        int _numSides{0};
+        double _sideLength{0};
     };
 
     class Square : public Polygon
@@ -119,19 +332,51 @@ namespace cps
     public:
         explicit Skyline(int);
 
-        std::stringstream generate() override;
+        // The same seed always produces the same skyline.
+        Skyline(int, std::uint64_t seed);
 
-    private:
-        struct Building
+        // Draws every building from a caller-supplied random engine.
+        template<typename Engine, typename = typename std::remove_reference_t<Engine>::result_type>
+        Skyline(int numOfBuildings, Engine &&engine)
+                : _buildings(static_cast<std::size_t>(std::max(numOfBuildings, 0)), currentResource())
         {
-            double spacing;
-            double height;
-            double width;
-        };
+            std::uniform_real_distribution<> randomHeight(10, 100);
+            std::uniform_real_distribution<> randomWidth(20, 50);
+            std::uniform_real_distribution<> randomSpacing(5, 20);
+            for (std::size_t index = 0; index < _buildings.size(); ++index)
+            {
+                _buildings.heights()[index] = randomHeight(engine);
+                _buildings.widths()[index] = randomWidth(engine);
+                _buildings.spacings()[index] = randomSpacing(engine);
+            }
+            updateSize();
+        }
+
+        // Buildings placed by their left edges, so they can overlap.
+        explicit Skyline(const std::vector<Footprint> &footprints);
+
+        // Outline mode strokes only the merged envelope of the buildings
+        // instead of every building's sides.
+        bool get_outline() const;
+
+        void set_outline(bool outline);
+
+        void emit(Sink &sink) override;
+
+        void emitPdf(Sink &sink) override;
 
-        static std::vector<Building> generateBuildings(int);
+        void trace(Path &path) override;
 
-        std::vector<Building> _buildings;
+        std::size_t get_nodeCount() override;
+
+    private:
+        static std::uint64_t nextSeed();
+
+        void updateSize();
+
+        Buildings _buildings;
+        bool _outline{false};
+        std::vector<OutlinePoint> _outlinePoints;
     };
 
     class Rotated : public Shape
@@ -139,13 +384,90 @@ namespace cps
     public:
         Rotated(Shape_ptr, int);
 
-        std::stringstream generate() override;
+        ~Rotated() override;
+
+        void emit(Sink &sink) override;
+
+        void visitChildren(const std::function<void(Shape &)> &visitor) override;
+
+        std::size_t get_nodeCount() override;
+
+        BoundingBox get_bounds() override;
+
+    protected:
+        bool invalidate() override;
+
+        std::size_t get_numChildren() override;
+
+        Shape &childAt(std::size_t index) override;
+
+        void openChildren(Sink &sink) override;
+
+        void openChildren(LayoutBuilder &builder) override;
+
+        void closeChildren(double &cursor, Sink &sink) override;
+
+        void closeChildren(double &cursor, LayoutBuilder &builder) override;
+
+        void releaseChildren(std::vector<Shape_ptr> &pending) override;
+
+        CompoundShape *pendingBounds() override;
 
     private:
+        void updateSize();
+
         Shape_ptr _originalShape;
         int _rotation;
+        std::size_t _nodeCount{1};
+        // Worked out on the first get_bounds() after a change, like a
+        // compound's.
+        BoundingBox _bounds{};
+        bool _boundsValid{false};
     };
 
+    template<typename Target, typename Descend, typename Leaf>
+    void Shape::traverse(Target &target, Descend descend, Leaf leaf)
+    {
+        struct Frame
+        {
+            Shape *shape;
+            std::size_t next;
+            double cursor;
+        };
+        std::vector<Frame> stack;
+        openChildren(target);
+        stack.push_back({this, 0, 0.0});
+        while (!stack.empty())
+        {
+            auto &frame = stack.back();
+            auto shape = frame.shape;
+            if (frame.next == shape->get_numChildren())
+            {
+                shape->closeChildren(frame.cursor, target);
+                stack.pop_back();
+                if (!stack.empty())
+                {
+                    auto &parent = stack.back();
+                    parent.shape->afterChild(parent.next - 1, parent.cursor, target);
+                }
+                continue;
+            }
+            auto index = frame.next++;
+            shape->beforeChild(index, frame.cursor, target);
+            auto &child = shape->childAt(index);
+            if (child.get_numChildren() > 0 && descend(child))
+            {
+                child.openChildren(target);
+                stack.push_back({&child, 0, 0.0});
+            }
+            else
+            {
+                leaf(child);
+                shape->afterChild(index, frame.cursor, target);
+            }
+        }
+    }
+
 }
 
 #endif //CS372_CPS_SHAPE_H
@@ -0,0 +1,256 @@
+// sink.cpp
+//
+
+#include "sink.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <system_error>
+#include <unistd.h>
+
+namespace cps
+{
+
+    // Base Class
+    Sink &Sink::operator<<(std::string_view text)
+    {
+        write(text.data(), text.size());
+        return *this;
+    }
+
+    Sink &Sink::operator<<(const char *text)
+    {
+        return *this << std::string_view(text);
+    }
+
+    Sink &Sink::operator<<(const std::string &text)
+    {
+        return *this << std::string_view(text);
+    }
+
+    Sink &Sink::operator<<(char c)
+    {
+        write(&c, 1);
+        return *this;
+    }
+
+    Sink &Sink::operator<<(double value)
+    {
+        writeNumber(value);
+        return *this;
+    }
+
+    void Sink::writeNumber(double value)
+    {
+        char text[MAX_NUMBER_LENGTH];
+        auto end = formatNumber(text, text + sizeof text, value, _settings.numberFormat);
+        write(text, static_cast<std::size_t>(end - text));
+    }
+
+    void Sink::writeInteger(long long value)
+    {
+        char text[24];
+        auto end = formatInteger(text, text + sizeof text, value);
+        write(text, static_cast<std::size_t>(end - text));
+    }
+
+    void Sink::writeInteger(unsigned long long value)
+    {
+        char text[24];
+        auto end = formatInteger(text, text + sizeof text, value);
+        write(text, static_cast<std::size_t>(end - text));
+    }
+
+    NumberFormat Sink::get_numberFormat() const
+    {
+        return _settings.numberFormat;
+    }
+
+    void Sink::set_numberFormat(NumberFormat format)
+    {
+        _settings.numberFormat = format;
+    }
+
+    double Sink::get_resolution() const
+    {
+        return _settings.resolution;
+    }
+
+    void Sink::set_resolution(double dotsPerInch)
+    {
+        _settings.resolution = dotsPerInch > 0 ? dotsPerInch : 0;
+    }
+
+    void Sink::pushScale(double x, double y)
+    {
+        _savedScales.push_back(_settings.scale);
+        _settings.scale *= std::max(std::abs(x), std::abs(y));
+    }
+
+    void Sink::popScale()
+    {
+        _settings.scale = _savedScales.back();
+        _savedScales.pop_back();
+    }
+
+    double Sink::get_pixelSize() const
+    {
+        if (_settings.resolution == 0)
+        {
+            return 0;
+        }
+        return 72.0 / _settings.resolution / _settings.scale;
+    }
+
+    Sink::Settings Sink::get_settings() const
+    {
+        return _settings;
+    }
+
+    void Sink::set_settings(const Settings &settings)
+    {
+        _settings = settings;
+    }
+
+    // OstreamSink Class
+    OstreamSink::OstreamSink(std::ostream &out)
+            : _out(out)
+    {}
+
+    void OstreamSink::write(const char *data, std::size_t size)
+    {
+        _out.write(data, static_cast<std::streamsize>(size));
+    }
+
+    void OstreamSink::flush()
+    {
+        _out.flush();
+    }
+
+    // BufferSink Class
+    void BufferSink::write(const char *data, std::size_t size)
+    {
+        _buffer.append(data, size);
+    }
+
+    void BufferSink::reserve(std::size_t size)
+    {
+        _buffer.reserve(size);
+    }
+
+    void BufferSink::clear()
+    {
+        _buffer.clear();
+    }
+
+    const std::string &BufferSink::str() const
+    {
+        return _buffer;
+    }
+
+    std::string BufferSink::release()
+    {
+        std::string output;
+        output.swap(_buffer);
+        return output;
+    }
+
+    // CountingSink Class
+    CountingSink::CountingSink(Sink &target)
+            : _target(target)
+    {
+        set_settings(target.get_settings());
+    }
+
+    void CountingSink::write(const char *data, std::size_t size)
+    {
+        _count += size;
+        _target.write(data, size);
+    }
+
+    void CountingSink::flush()
+    {
+        _target.flush();
+    }
+
+    std::uint64_t CountingSink::get_count() const
+    {
+        return _count;
+    }
+
+    // FileDescriptorSink Class
+    FileDescriptorSink::FileDescriptorSink(int fd, std::size_t bufferSize)
+            : _fd{fd}, _buffer(bufferSize == 0 ? 1 : bufferSize)
+    {}
+
+    FileDescriptorSink::~FileDescriptorSink()
+    {
+        try
+        {
+            flush();
+        }
+        catch (const std::system_error &)
+        {
+            // Reported by flush() when it is called explicitly.
+        }
+    }
+
+    void FileDescriptorSink::write(const char *data, std::size_t size)
+    {
+        if (_used + size > _buffer.size())
+        {
+            flush();
+            if (size >= _buffer.size())
+            {
+                writeAll(data, size);
+                return;
+            }
+        }
+        std::memcpy(_buffer.data() + _used, data, size);
+        _used += size;
+    }
+
+    void FileDescriptorSink::writeNumber(double value)
+    {
+        if (_buffer.size() < MAX_NUMBER_LENGTH)
+        {
+            Sink::writeNumber(value);
+            return;
+        }
+        if (_buffer.size() - _used < MAX_NUMBER_LENGTH)
+        {
+            flush();
+        }
+        auto first = _buffer.data() + _used;
+        auto end = formatNumber(first, _buffer.data() + _buffer.size(), value, get_numberFormat());
+        _used += static_cast<std::size_t>(end - first);
+    }
+
+    void FileDescriptorSink::flush()
+    {
+        auto pending = _used;
+        _used = 0;
+        writeAll(_buffer.data(), pending);
+    }
+
+    void FileDescriptorSink::writeAll(const char *data, std::size_t size)
+    {
+        while (size > 0)
+        {
+            auto written = ::write(_fd, data, size);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "cps::FileDescriptorSink");
+            }
+            data += written;
+            size -= static_cast<std::size_t>(written);
+        }
+    }
+
+}
@@ -0,0 +1,185 @@
+// sink.hpp
+//
+// Destinations for generated PostScript. Shapes write straight into a Sink
+// so a whole document is produced in one pass without building and copying
+// intermediate fragments.
+//
+
+#ifndef CS372_CPS_SINK_H
+#define CS372_CPS_SINK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "format.hpp"
+
+namespace cps
+{
+
+    class Sink
+    {
+    public:
+        // Everything besides the text itself that decides what shapes write,
+        // so sinks collecting part of another sink's output can match it.
+        struct Settings
+        {
+            NumberFormat numberFormat{NumberFormat::Fixed};
+            double resolution{0};
+            double scale{1};
+        };
+
+        virtual ~Sink() = default;
+
+        virtual void write(const char *data, std::size_t size) = 0;
+
+        virtual void flush()
+        {}
+
+        virtual void writeNumber(double value);
+
+        void writeInteger(long long value);
+
+        void writeInteger(unsigned long long value);
+
+        NumberFormat get_numberFormat() const;
+
+        void set_numberFormat(NumberFormat format);
+
+        // Level of detail. With a device resolution set, in dots per inch,
+        // leaf shapes replace detail finer than a device pixel with simpler
+        // geometry; see primitives.hpp. Zero, the default, keeps all detail.
+        double get_resolution() const;
+
+        void set_resolution(double dotsPerInch);
+
+        // Scaled shapes push their scale factors while their children are
+        // written, so the pixel size follows the current user space. The
+        // larger factor counts, so nothing that shows is simplified away.
+        void pushScale(double x, double y);
+
+        void popScale();
+
+        // The side of a device pixel in current user units, or zero when
+        // no resolution is set.
+        double get_pixelSize() const;
+
+        Settings get_settings() const;
+
+        void set_settings(const Settings &settings);
+
+        Sink &operator<<(std::string_view text);
+
+        Sink &operator<<(const char *text);
+
+        Sink &operator<<(const std::string &text);
+
+        Sink &operator<<(char c);
+
+        Sink &operator<<(double value);
+
+        template<typename Integer, typename = std::enable_if_t<std::is_integral_v<Integer>>>
+        Sink &operator<<(Integer value)
+        {
+            if constexpr (std::is_signed_v<Integer>)
+            {
+                writeInteger(static_cast<long long>(value));
+            }
+            else
+            {
+                writeInteger(static_cast<unsigned long long>(value));
+            }
+            return *this;
+        }
+
+    private:
+        Settings _settings{};
+        std::vector<double> _savedScales{};
+    };
+
+    // Forwards everything to an existing std::ostream.
+    class OstreamSink : public Sink
+    {
+    public:
+        explicit OstreamSink(std::ostream &out);
+
+        void write(const char *data, std::size_t size) override;
+
+        void flush() override;
+
+    private:
+        std::ostream &_out;
+    };
+
+    // Collects everything into a growable in-memory buffer.
+    class BufferSink : public Sink
+    {
+    public:
+        BufferSink() = default;
+
+        void write(const char *data, std::size_t size) override;
+
+        void reserve(std::size_t size);
+
+        void clear();
+
+        const std::string &str() const;
+
+        std::string release();
+
+    private:
+        std::string _buffer;
+    };
+
+    // Forwards everything to another sink, counting the bytes that pass
+    // through.
+    class CountingSink : public Sink
+    {
+    public:
+        explicit CountingSink(Sink &target);
+
+        void write(const char *data, std::size_t size) override;
+
+        void flush() override;
+
+        std::uint64_t get_count() const;
+
+    private:
+        Sink &_target;
+        std::uint64_t _count{0};
+    };
+
+    // Writes to a POSIX file descriptor through a fixed-size buffer. The
+    // descriptor is not closed by the sink.
+    class FileDescriptorSink : public Sink
+    {
+    public:
+        explicit FileDescriptorSink(int fd, std::size_t bufferSize = 1 << 16);
+
+        FileDescriptorSink(const FileDescriptorSink &) = delete;
+
+        FileDescriptorSink &operator=(const FileDescriptorSink &) = delete;
+
+        ~FileDescriptorSink() override;
+
+        void write(const char *data, std::size_t size) override;
+
+        void writeNumber(double value) override;
+
+        void flush() override;
+
+    private:
+        void writeAll(const char *data, std::size_t size);
+
+        int _fd;
+        std::vector<char> _buffer;
+        std::size_t _used{0};
+    };
+
+}
+
+#endif //CS372_CPS_SINK_H
@@ -0,0 +1,310 @@
+// spatialindex.cpp
+//
+
+#include "spatialindex.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+namespace cps
+{
+
+    namespace
+    {
+        bool sameBox(const BoundingBox &a, const BoundingBox &b)
+        {
+            return a.left == b.left && a.bottom == b.bottom && a.right == b.right && a.top == b.top;
+        }
+
+        // Unlike BoundingBox::intersects, boxes that only share an edge do
+        // not count.
+        bool overlapInside(const BoundingBox &a, const BoundingBox &b)
+        {
+            return !a.empty() && !b.empty() &&
+                   a.left < b.right && b.left < a.right && a.bottom < b.top && b.bottom < a.top;
+        }
+
+        double area(const BoundingBox &box)
+        {
+            return box.empty() ? 0 : (box.right - box.left) * (box.top - box.bottom);
+        }
+    }
+
+    // SpatialIndex Class
+    SpatialIndex::SpatialIndex(const Layout &layout)
+            : _items(itemBounds(layout))
+    {
+        build();
+    }
+
+    std::vector<BoundingBox> SpatialIndex::itemBounds(const Layout &layout)
+    {
+        std::vector<BoundingBox> items;
+        items.reserve(layout.placements().size());
+        for (const auto &placement : layout.placements())
+        {
+            items.push_back(transformed(placement.shape->get_bounds(), placement.transform));
+        }
+        return items;
+    }
+
+    // Splits top-down at the median along the longer side of the box the
+    // item centers span, so the tree is balanced whatever the scene.
+    void SpatialIndex::build()
+    {
+        _nodes.clear();
+        _order.resize(_items.size());
+        std::iota(_order.begin(), _order.end(), 0u);
+        _leafOf.assign(_items.size(), 0);
+        if (_items.empty())
+        {
+            return;
+        }
+        auto centerX = [this](std::uint32_t item) { return _items[item].left + _items[item].right; };
+        auto centerY = [this](std::uint32_t item) { return _items[item].bottom + _items[item].top; };
+
+        _nodes.reserve(2 * (_items.size() / LEAF_SIZE + 1));
+        _nodes.push_back({BoundingBox::none(), NO_PARENT, 0, static_cast<std::uint32_t>(_items.size())});
+        std::vector<std::uint32_t> pending{0};
+        while (!pending.empty())
+        {
+            auto node = pending.back();
+            pending.pop_back();
+            auto first = _nodes[node].first;
+            auto count = _nodes[node].count;
+            if (count <= LEAF_SIZE)
+            {
+                for (auto index = first; index < first + count; ++index)
+                {
+                    _leafOf[_order[index]] = node;
+                }
+                continue;
+            }
+            auto begin = _order.begin() + first;
+            auto end = begin + count;
+            auto [minX, maxX] = std::minmax_element(begin, end, [&](auto a, auto b) { return centerX(a) < centerX(b); });
+            auto [minY, maxY] = std::minmax_element(begin, end, [&](auto a, auto b) { return centerY(a) < centerY(b); });
+            auto middle = begin + count / 2;
+            if (centerX(*maxX) - centerX(*minX) >= centerY(*maxY) - centerY(*minY))
+            {
+                std::nth_element(begin, middle, end, [&](auto a, auto b) { return centerX(a) < centerX(b); });
+            }
+            else
+            {
+                std::nth_element(begin, middle, end, [&](auto a, auto b) { return centerY(a) < centerY(b); });
+            }
+            auto children = static_cast<std::uint32_t>(_nodes.size());
+            auto half = count / 2;
+            _nodes.push_back({BoundingBox::none(), node, first, half});
+            _nodes.push_back({BoundingBox::none(), node, first + half, count - half});
+            _nodes[node].first = children;
+            _nodes[node].count = 0;
+            pending.push_back(children);
+            pending.push_back(children + 1);
+        }
+        for (auto node = _nodes.size(); node-- > 0;)
+        {
+            fitNode(static_cast<std::uint32_t>(node));
+        }
+    }
+
+    void SpatialIndex::fitNode(std::uint32_t node)
+    {
+        auto &current = _nodes[node];
+        if (current.count == 0)
+        {
+            current.bounds = _nodes[current.first].bounds;
+            current.bounds.include(_nodes[current.first + 1].bounds);
+            return;
+        }
+        current.bounds = BoundingBox::none();
+        for (auto index = current.first; index < current.first + current.count; ++index)
+        {
+            current.bounds.include(_items[_order[index]]);
+        }
+    }
+
+    std::size_t SpatialIndex::get_numItems() const
+    {
+        return _items.size();
+    }
+
+    BoundingBox SpatialIndex::get_bounds(Item item) const
+    {
+        return _items[item];
+    }
+
+    BoundingBox SpatialIndex::get_bounds() const
+    {
+        return _nodes.empty() ? BoundingBox::none() : _nodes[0].bounds;
+    }
+
+    template<typename Visit>
+    void SpatialIndex::search(const BoundingBox &area, Visit visit) const
+    {
+        if (_nodes.empty())
+        {
+            return;
+        }
+        // Depth first, so the stack never holds more than the tree is deep.
+        std::vector<std::uint32_t> pending;
+        pending.reserve(64);
+        pending.push_back(0);
+        while (!pending.empty())
+        {
+            auto &node = _nodes[pending.back()];
+            pending.pop_back();
+            if (!node.bounds.intersects(area))
+            {
+                continue;
+            }
+            if (node.count == 0)
+            {
+                pending.push_back(node.first);
+                pending.push_back(node.first + 1);
+                continue;
+            }
+            for (auto index = node.first; index < node.first + node.count; ++index)
+            {
+                if (_items[_order[index]].intersects(area))
+                {
+                    visit(_order[index]);
+                }
+            }
+        }
+    }
+
+    std::vector<SpatialIndex::Item> SpatialIndex::query(double x, double y) const
+    {
+        return query(BoundingBox{x, y, x, y});
+    }
+
+    std::vector<SpatialIndex::Item> SpatialIndex::query(const BoundingBox &area) const
+    {
+        std::vector<Item> found;
+        search(area, [&found](std::uint32_t item) { found.push_back(item); });
+        std::sort(found.begin(), found.end());
+        return found;
+    }
+
+    // Walks the tree against itself: a node pairs with itself by pairing up
+    // its children, and two nodes are only opened while their boxes overlap,
+    // opening the larger first.
+    std::vector<std::pair<SpatialIndex::Item, SpatialIndex::Item>> SpatialIndex::overlaps() const
+    {
+        std::vector<std::pair<Item, Item>> found;
+        auto testItems = [&](std::uint32_t a, std::uint32_t b) {
+            if (overlapInside(_items[a], _items[b]))
+            {
+                found.emplace_back(std::min(a, b), std::max(a, b));
+            }
+        };
+        if (_nodes.empty())
+        {
+            return found;
+        }
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> pending{{0, 0}};
+        while (!pending.empty())
+        {
+            auto [a, b] = pending.back();
+            pending.pop_back();
+            auto &nodeA = _nodes[a];
+            auto &nodeB = _nodes[b];
+            if (a == b)
+            {
+                if (nodeA.count == 0)
+                {
+                    pending.emplace_back(nodeA.first, nodeA.first);
+                    pending.emplace_back(nodeA.first + 1, nodeA.first + 1);
+                    pending.emplace_back(nodeA.first, nodeA.first + 1);
+                    continue;
+                }
+                for (auto i = nodeA.first; i < nodeA.first + nodeA.count; ++i)
+                {
+                    for (auto j = i + 1; j < nodeA.first + nodeA.count; ++j)
+                    {
+                        testItems(_order[i], _order[j]);
+                    }
+                }
+                continue;
+            }
+            if (!overlapInside(nodeA.bounds, nodeB.bounds))
+            {
+                continue;
+            }
+            if (nodeA.count != 0 && nodeB.count != 0)
+            {
+                for (auto i = nodeA.first; i < nodeA.first + nodeA.count; ++i)
+                {
+                    for (auto j = nodeB.first; j < nodeB.first + nodeB.count; ++j)
+                    {
+                        testItems(_order[i], _order[j]);
+                    }
+                }
+            }
+            else if (nodeA.count != 0 || (nodeB.count == 0 && area(nodeB.bounds) > area(nodeA.bounds)))
+            {
+                pending.emplace_back(a, nodeB.first);
+                pending.emplace_back(a, nodeB.first + 1);
+            }
+            else
+            {
+                pending.emplace_back(nodeA.first, b);
+                pending.emplace_back(nodeA.first + 1, b);
+            }
+        }
+        std::sort(found.begin(), found.end());
+        return found;
+    }
+
+    void SpatialIndex::refit(Item item, const BoundingBox &bounds)
+    {
+        _items[item] = bounds;
+        for (auto node = _leafOf[item]; node != NO_PARENT; node = _nodes[node].parent)
+        {
+            auto before = _nodes[node].bounds;
+            fitNode(node);
+            if (sameBox(before, _nodes[node].bounds))
+            {
+                return;
+            }
+        }
+    }
+
+    // Parents come before their children, so one sweep from the back refits
+    // every changed branch after its children.
+    void SpatialIndex::refit(const Layout &layout)
+    {
+        auto items = itemBounds(layout);
+        if (items.size() != _items.size())
+        {
+            _items = std::move(items);
+            build();
+            return;
+        }
+        std::vector<bool> dirty(_nodes.size(), false);
+        for (std::size_t item = 0; item < items.size(); ++item)
+        {
+            if (!sameBox(items[item], _items[item]))
+            {
+                _items[item] = items[item];
+                dirty[_leafOf[item]] = true;
+            }
+        }
+        for (auto node = _nodes.size(); node-- > 0;)
+        {
+            if (!dirty[node])
+            {
+                continue;
+            }
+            auto before = _nodes[node].bounds;
+            fitNode(static_cast<std::uint32_t>(node));
+            auto parent = _nodes[node].parent;
+            if (parent != NO_PARENT && !sameBox(before, _nodes[node].bounds))
+            {
+                dirty[parent] = true;
+            }
+        }
+    }
+
+}
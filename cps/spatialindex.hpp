@@ -0,0 +1,99 @@
+// spatialindex.hpp
+//
+// A bounding-volume hierarchy over the leaves of a laid-out scene, for
+// hit-testing and overlap checks. Each placement of a Layout becomes an
+// item whose box is the leaf's bounds under its absolute transform, so
+// the offsets of horizontal and vertical compounds, rotations and scales
+// are all accounted for. Queries visit only the branches whose boxes can
+// match, which takes logarithmic time in a scene of reasonably sized
+// shapes.
+//
+// Items are numbered as the placements they came from. When shapes
+// change size or move, refit() updates the boxes in place without
+// rebuilding the tree; it stays correct however far things move, though
+// queries slow down if the scene is rearranged wholesale.
+//
+
+#ifndef CS372_CPS_SPATIALINDEX_H
+#define CS372_CPS_SPATIALINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility> // pair
+#include <vector>
+
+#include "layout.hpp"
+#include "shape.hpp"
+
+namespace cps
+{
+
+    class SpatialIndex
+    {
+    public:
+        using Item = std::size_t;
+
+        // Indexes layout.placements(); the layout need not outlive the index.
+        explicit SpatialIndex(const Layout &layout);
+
+        std::size_t get_numItems() const;
+
+        // The box of item, or of the whole scene when called without one.
+        BoundingBox get_bounds(Item item) const;
+
+        BoundingBox get_bounds() const;
+
+        // The items whose boxes hold the point, edges included, in
+        // ascending order.
+        std::vector<Item> query(double x, double y) const;
+
+        // The items whose boxes meet area, edges included, in ascending
+        // order.
+        std::vector<Item> query(const BoundingBox &area) const;
+
+        // Every pair of items whose boxes overlap by more than an edge, each
+        // pair once with the lower item first, sorted. Shapes placed side by
+        // side by a compound touch without overlapping.
+        std::vector<std::pair<Item, Item>> overlaps() const;
+
+        // Moves item to bounds, refitting the boxes above it. Stops as soon
+        // as a box above it is unchanged.
+        void refit(Item item, const BoundingBox &bounds);
+
+        // Takes new boxes for every item from a fresh layout of the same
+        // scene and refits only the branches that changed. A layout with a
+        // different number of placements rebuilds the index instead.
+        void refit(const Layout &layout);
+
+    private:
+        static constexpr std::uint32_t LEAF_SIZE = 4;
+        static constexpr std::uint32_t NO_PARENT = UINT32_MAX;
+
+        // Nodes are stored parents first. An inner node's children are at
+        // first and first + 1; a leaf holds _order[first, first + count).
+        struct Node
+        {
+            BoundingBox bounds;
+            std::uint32_t parent;
+            std::uint32_t first;
+            std::uint32_t count;
+        };
+
+        static std::vector<BoundingBox> itemBounds(const Layout &layout);
+
+        void build();
+
+        void fitNode(std::uint32_t node);
+
+        template<typename Visit>
+        void search(const BoundingBox &area, Visit visit) const;
+
+        std::vector<BoundingBox> _items{};
+        std::vector<std::uint32_t> _order{};
+        std::vector<std::uint32_t> _leafOf{};
+        std::vector<Node> _nodes{};
+    };
+
+}
+
+#endif //CS372_CPS_SPATIALINDEX_H
@@ -0,0 +1,167 @@
+// threadpool.cpp
+//
+
+#include "threadpool.hpp"
+
+#include <algorithm>
+
+namespace cps
+{
+
+    namespace
+    {
+        // The pool that owns the current thread, if any, and the thread's
+        // index in it.
+        thread_local const void *workerPool = nullptr;
+        thread_local std::size_t workerIndex = 0;
+    }
+
+    ThreadPool::ThreadPool(std::size_t numThreads)
+    {
+        if (numThreads == 0)
+        {
+            numThreads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (std::size_t i = 0; i < numThreads; ++i)
+        {
+            _workers.push_back(std::make_unique<Worker>());
+        }
+        _threads.reserve(numThreads);
+        for (std::size_t i = 0; i < numThreads; ++i)
+        {
+            _threads.emplace_back([this, i] { run(i); });
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _ready.notify_all();
+        for (auto &thread : _threads)
+        {
+            thread.join();
+        }
+    }
+
+    std::size_t ThreadPool::get_numThreads() const
+    {
+        return _threads.size();
+    }
+
+    bool ThreadPool::onWorkerThread()
+    {
+        return workerPool != nullptr;
+    }
+
+    void ThreadPool::enqueue(std::function<void()> task)
+    {
+        // Counted before the task becomes visible, and under _mutex so a
+        // worker about to sleep cannot miss it.
+        auto own = workerPool == this;
+        auto waiting = false;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            ++_queued;
+            waiting = _waiting > 0;
+            if (!own)
+            {
+                _shared.push_back(std::move(task));
+            }
+        }
+        if (own)
+        {
+            auto &worker = *_workers[workerIndex];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.tasks.push_back(std::move(task));
+        }
+        _ready.notify_one();
+        if (waiting)
+        {
+            _finished.notify_one();
+        }
+    }
+
+    bool ThreadPool::takeTask(std::function<void()> &task)
+    {
+        if (_queued.load() == 0)
+        {
+            return false;
+        }
+        auto own = workerPool == this;
+        if (own)
+        {
+            auto &worker = *_workers[workerIndex];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (!worker.tasks.empty())
+            {
+                task = std::move(worker.tasks.back());
+                worker.tasks.pop_back();
+                --_queued;
+                return true;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_shared.empty())
+            {
+                task = std::move(_shared.front());
+                _shared.pop_front();
+                --_queued;
+                return true;
+            }
+        }
+        auto start = own ? workerIndex + 1 : 0;
+        for (std::size_t offset = 0; offset < _workers.size(); ++offset)
+        {
+            auto &victim = *_workers[(start + offset) % _workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                --_queued;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool ThreadPool::runPendingTask()
+    {
+        std::function<void()> task;
+        if (!takeTask(task))
+        {
+            return false;
+        }
+        task();
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_waiting > 0)
+        {
+            _finished.notify_all();
+        }
+        return true;
+    }
+
+    void ThreadPool::run(std::size_t index)
+    {
+        workerPool = this;
+        workerIndex = index;
+        for (;;)
+        {
+            if (runPendingTask())
+            {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(_mutex);
+            _ready.wait(lock, [this] { return _stopping || _queued.load() > 0; });
+            if (_stopping && _queued.load() == 0)
+            {
+                return;
+            }
+        }
+    }
+
+}
@@ -0,0 +1,119 @@
+// threadpool.hpp
+//
+// A work-stealing pool. Each worker keeps its own deque: tasks submitted
+// from a worker go on the back of that worker's deque and are taken from
+// the back (newest first, while their data is still in cache), and idle
+// workers steal from the front of other deques (oldest first, which in a
+// recursive split are the biggest pieces). Tasks submitted from outside
+// the pool go through a shared queue.
+//
+// A thread waiting on a result with wait() runs other queued tasks until
+// the result is ready, so tasks may submit and wait on subtasks without
+// tying up a worker or deadlocking. With nothing left to run it sleeps
+// until a task finishes or another is queued.
+//
+
+#ifndef CS372_CPS_THREADPOOL_H
+#define CS372_CPS_THREADPOOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cps
+{
+
+    class ThreadPool
+    {
+    public:
+        // Zero threads means one per hardware thread.
+        explicit ThreadPool(std::size_t numThreads = 0);
+
+        ThreadPool(const ThreadPool &) = delete;
+
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        // Finishes every queued task before returning.
+        ~ThreadPool();
+
+        template<typename Function>
+        auto submit(Function function) -> std::future<decltype(function())>
+        {
+            auto task = std::make_shared<std::packaged_task<decltype(function())()>>(std::move(function));
+            auto result = task->get_future();
+            enqueue([task] { (*task)(); });
+            return result;
+        }
+
+        // Runs queued tasks on the calling thread until result is ready,
+        // then returns its value.
+        template<typename Result>
+        Result wait(std::future<Result> &result)
+        {
+            while (!isReady(result))
+            {
+                if (runPendingTask())
+                {
+                    continue;
+                }
+                // Checked under _mutex, which every finished task takes
+                // before notifying, so the wakeup cannot be missed.
+                std::unique_lock<std::mutex> lock(_mutex);
+                ++_waiting;
+                _finished.wait(lock, [&] { return _queued.load() > 0 || isReady(result); });
+                --_waiting;
+            }
+            return result.get();
+        }
+
+        std::size_t get_numThreads() const;
+
+        // True on a thread owned by any ThreadPool.
+        static bool onWorkerThread();
+
+    private:
+        struct Worker
+        {
+            std::mutex mutex;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        template<typename Result>
+        static bool isReady(const std::future<Result> &result)
+        {
+            return result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        }
+
+        void enqueue(std::function<void()> task);
+
+        // Takes one task from this thread's own deque, the shared queue or
+        // another worker, in that order, and runs it.
+        bool runPendingTask();
+
+        bool takeTask(std::function<void()> &task);
+
+        void run(std::size_t index);
+
+        std::vector<std::unique_ptr<Worker>> _workers;
+        std::vector<std::thread> _threads;
+        std::deque<std::function<void()>> _shared;
+        std::mutex _mutex;
+        std::condition_variable _ready;
+        // Wakes threads blocked in wait() when a task finishes or is queued.
+        std::condition_variable _finished;
+        std::size_t _waiting{0};
+        std::atomic<std::size_t> _queued{0};
+        bool _stopping{false};
+    };
+
+}
+
+#endif //CS372_CPS_THREADPOOL_H
@@ -1,7 +1,5 @@
 // example.cpp
 
-#include <fstream>
-using std::fstream;
 #include <vector>
 using std::vector;
 #include <memory>
@@ -14,45 +12,83 @@ using std::move;
 using namespace cps;
 
 int main() {
-    auto fileName{"test.ps"};
-    fstream file(fileName, fstream::out);
+    Document document("test.ps");
+    auto &file = document.beginPage({0, 0, 8.5*INCH, 11*INCH});
 
-    file << START_FILE;
+    Spacer(4*INCH, 1*INCH).emit(file);
+    Skyline(10).emit(file);
 
-    file << Spacer(4*INCH, 1*INCH).generate().str();
-    file << Skyline(10).generate().str();
-
-    file << Spacer(-1*INCH, 3*INCH).generate().str();
+    Spacer(-1*INCH, 3*INCH).emit(file);
 
     { // 3x3 grid
         auto rectangles = vector<Shape::Shape_ptr>();
         rectangles.push_back(make_unique<Rectangle>(INCH, INCH));
         rectangles.push_back(make_unique<Rectangle>(INCH, INCH));
-        VerticalShapes column(move(rectangles));
-        column.pushShape(make_unique<Rectangle>(INCH, INCH));
-        
-        file << column.generate().str();
-        file << Spacer(INCH, 0).generate().str();
-        file << column.generate().str();
-        file << Spacer(INCH, 0).generate().str();
-        file << column.generate().str();
+        auto columnShape = make_unique<VerticalShapes>(move(rectangles));
+        columnShape->pushShape(make_unique<Rectangle>(INCH, INCH));
+
+        // Emitted once as a procedure, then called three times.
+        auto column = Instance::define(move(columnShape));
+        InstanceDefinitions definitions;
+        definitions.write(column, file);
+
+        Instance(column).emit(file);
+        Spacer(INCH, 0).emit(file);
+        Instance(column).emit(file);
+        Spacer(INCH, 0).emit(file);
+        Instance(column).emit(file);
     }
 
-    file << Spacer(-1*INCH, -2*INCH).generate().str();
+    Spacer(-1*INCH, -2*INCH).emit(file);
 
     Circle c1(0.5*INCH);
-    file << Scaled(c1, {1, 1}).generate().str();
-    file << Scaled(c1, {2, 1}).generate().str();
-    file << Scaled(c1, {4, 1}).generate().str();
+    Scaled(c1, {1, 1}).emit(file);
+    Scaled(c1, {2, 1}).emit(file);
+    Scaled(c1, {4, 1}).emit(file);
  
-    file << Spacer(-1*INCH, 6*INCH).generate().str();
+    Spacer(-1*INCH, 6*INCH).emit(file);
 
     HorizontalShapes horizontal;
     horizontal.pushShape(make_unique<Square>(INCH));
     horizontal.pushShape(make_unique<Circle>(INCH));
-    file << Scaled(horizontal, {2, 1}).generate().str();
+    Scaled(horizontal, {2, 1}).emit(file);
+
+    document.close();
+
+    { // The same grid as a PDF, with the column written once as a form
+        auto rectangles = vector<Shape::Shape_ptr>();
+        for (auto i = 0; i < 3; ++i) {
+            rectangles.push_back(make_unique<Rectangle>(INCH, INCH));
+        }
+        auto column = Instance::define(make_unique<VerticalShapes>(move(rectangles)));
 
-    file << SHOWPAGE;
+        HorizontalShapes grid;
+        for (auto i = 0; i < 3; ++i) {
+            grid.pushShape(make_unique<Instance>(column));
+            grid.pushShape(make_unique<Spacer>(INCH, 0));
+        }
+
+        PdfDocument pdf("test.pdf");
+        pdf.addPage(grid);
+        pdf.close();
+    }
+
+    { // A preview image, drawn without a PostScript interpreter
+        HorizontalShapes columns;
+        for (auto i = 0; i < 3; ++i) {
+            columns.pushShape(make_unique<Rectangle>(INCH, 3*INCH));
+            columns.pushShape(make_unique<Spacer>(INCH, 0));
+        }
+
+        Bitmap bitmap(256, 128);
+        Rasterizer rasterizer(bitmap);
+        rasterizer.fit(columns.get_bounds());
+        rasterizer.draw(columns);
+
+        OutputFile png("test.png");
+        bitmap.writePng(png.sink());
+        png.close();
+    }
 
     return 0;
 }
\ No newline at end of file
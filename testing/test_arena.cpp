@@ -0,0 +1,92 @@
+// test_arena.cpp
+//
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+using std::make_unique;
+using std::move;
+
+#include "catch.hpp"
+#include "../cps/arena.hpp"
+#include "../cps/shape.hpp"
+#include "../cps/compoundshape.hpp"
+using namespace cps;
+
+namespace
+{
+    class CountingResource : public std::pmr::memory_resource
+    {
+    public:
+        std::size_t allocations{0};
+
+    private:
+        void *do_allocate(std::size_t bytes, std::size_t alignment) override
+        {
+            ++allocations;
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+
+        void do_deallocate(void *pointer, std::size_t bytes, std::size_t alignment) override
+        {
+            std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+        }
+
+        bool do_is_equal(const memory_resource &other) const noexcept override
+        {
+            return this == &other;
+        }
+    };
+
+    Shape::Shape_ptr makeScene()
+    {
+        auto scene = make_unique<HorizontalShapes>();
+        for (auto column = 0; column < 50; ++column)
+        {
+            vector<Shape::Shape_ptr> shapes;
+            shapes.push_back(make_unique<Circle>(column + 1));
+            shapes.push_back(make_unique<Rectangle>(column + 1, 5));
+            shapes.push_back(make_unique<Triangle>(10));
+            scene->pushShape(make_unique<VerticalShapes>(move(shapes)));
+        }
+        return scene;
+    }
+}
+
+TEST_CASE("Arena")
+{
+    auto expected = makeScene()->generate().str();
+
+    CountingResource upstream;
+    {
+        Arena arena(1 << 12, &upstream);
+        Shape::Shape_ptr scene;
+        {
+            ArenaScope scope(arena);
+            scene = makeScene();
+        }
+
+        SECTION("Shapes Come From The Arena In Large Blocks")
+        {
+            REQUIRE(upstream.allocations > 0);
+            REQUIRE(upstream.allocations < 20);
+        }
+
+        SECTION("Arena Scenes Behave The Same")
+        {
+            REQUIRE(scene->generate().str() == expected);
+            REQUIRE(scene->get_width() == makeScene()->get_width());
+        }
+
+        SECTION("Heap Shapes Mix With Arena Shapes")
+        {
+            auto &compound = dynamic_cast<HorizontalShapes &>(*scene);
+            compound.pushShape(make_unique<Circle>(1));
+            REQUIRE(compound.get_numShapes() == 51);
+        }
+    }
+}
@@ -0,0 +1,330 @@
+// test_document.cpp
+//
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+using std::string;
+using std::vector;
+using std::make_unique;
+using std::move;
+
+#include "catch.hpp"
+#include "../cps/document.hpp"
+#include "../cps/compoundshape.hpp"
+#include "../cps/prolog.hpp"
+#include "../cps/threadpool.hpp"
+using namespace cps;
+
+namespace
+{
+    // Remembers how much had been written each time it was flushed.
+    class RecordingSink : public BufferSink
+    {
+    public:
+        void flush() override
+        {
+            flushedAt.push_back(str().size());
+        }
+
+        vector<std::size_t> flushedAt;
+    };
+
+    const string HEADER = "%!PS-Adobe-3.0\n"
+                          "%%BoundingBox: (atend)\n"
+                          "%%Pages: (atend)\n"
+                          "%%EndComments\n"
+                          "%%BeginProlog\n"
+                          + PROLOG +
+                          "%%EndProlog\n";
+
+    // A page whose content depends on its number, with a call to a shared
+    // instance and a skyline heavy enough to take real work.
+    Shape::Shape_ptr numberedPage(int number)
+    {
+        static const auto mark = Instance::define(make_unique<Circle>(3));
+        auto page = make_unique<VerticalShapes>();
+        page->pushShape(make_unique<Skyline>(number % 50 + 1, std::uint64_t(number)));
+        page->pushShape(make_unique<Instance>(mark));
+        page->pushShape(make_unique<Rotated>(make_unique<Rectangle>(number, 2 * number), 90));
+        return page;
+    }
+
+    string readFile(const string &path)
+    {
+        std::ifstream file(path);
+        std::stringstream contents;
+        contents << file.rdbuf();
+        return contents.str();
+    }
+}
+
+TEST_CASE("Document")
+{
+    SECTION("Header Once, Then Each Page")
+    {
+        BufferSink sink;
+        {
+            Document document(sink);
+            REQUIRE(sink.str() == HEADER);
+            Circle circle(5);
+            Rectangle rectangle(10, 21);
+            document.addPage(circle);
+            document.addPage(rectangle);
+            REQUIRE(document.get_numPages() == 2);
+        }
+        REQUIRE(sink.str() == HEADER
+                              + "%%Page: 1 1\n"
+                                "%%PageBoundingBox: 0 0 11 11\n"
+                                "save\n"
+                                "5.500000 5.500000 translate\n"
+                              + Circle(5).generate().str() + "restore\nshowpage\n"
+                              + "%%Page: 2 2\n"
+                                "%%PageBoundingBox: 0 0 11 22\n"
+                                "save\n"
+                                "5.500000 11.000000 translate\n"
+                              + Rectangle(10, 21).generate().str() + "restore\nshowpage\n"
+                              + "%%Trailer\n"
+                                "%%BoundingBox: 0 0 11 22\n"
+                                "%%Pages: 2\n"
+                                "%%EOF\n");
+    }
+
+    SECTION("Pages Without Bounds")
+    {
+        BufferSink sink;
+        Document document(sink);
+        document.beginPage() << "% first\n";
+        document.close();
+        REQUIRE(sink.str() == HEADER + "%%Page: 1 1\nsave\n% first\nrestore\nshowpage\n"
+                                       "%%Trailer\n%%BoundingBox: 0 0 0 0\n%%Pages: 1\n%%EOF\n");
+    }
+
+    SECTION("Pages Are Flushed As They End")
+    {
+        RecordingSink sink;
+        Document document(sink);
+        auto &page = document.beginPage();
+        Circle(5).emit(page);
+        REQUIRE(sink.flushedAt.empty());
+        document.beginPage() << "% second\n";
+        REQUIRE(sink.flushedAt.size() == 1);
+        REQUIRE(sink.flushedAt[0] == sink.str().find("%%Page: 2 2"));
+        document.close();
+        REQUIRE(document.get_numPages() == 2);
+        REQUIRE(sink.flushedAt.back() == sink.str().size());
+        document.close();
+        REQUIRE(document.get_numPages() == 2);
+    }
+
+    SECTION("Each Page Defines The Instances It Calls")
+    {
+        auto column = Instance::define(make_unique<Rectangle>(10, 20));
+        HorizontalShapes row;
+        row.pushShape(make_unique<Instance>(column));
+        row.pushShape(make_unique<Instance>(column));
+
+        BufferSink sink;
+        Document document(sink);
+        document.addPage(row);
+        auto firstPage = sink.str().substr(document.get_lastPage().offset);
+        document.addPage(row);
+        auto secondPage = sink.str().substr(document.get_lastPage().offset);
+        REQUIRE(firstPage.find("/" + column->name + " {") != string::npos);
+        REQUIRE(secondPage.substr(secondPage.find('\n')) == firstPage.substr(firstPage.find('\n')));
+    }
+
+    SECTION("Page Index Locates Every Page")
+    {
+        BufferSink sink;
+        BufferSink index;
+        Document document(sink);
+        document.set_pageIndex(index);
+        for (auto page = 1; page <= 12; ++page)
+        {
+            Circle circle(page);
+            document.addPage(circle);
+        }
+        document.close();
+        REQUIRE(index.str().size() == 12 * Document::PAGE_INDEX_RECORD);
+
+        const auto &text = sink.str();
+        for (auto page = 1; page <= 12; ++page)
+        {
+            auto record = index.str().substr((page - 1) * Document::PAGE_INDEX_RECORD, Document::PAGE_INDEX_RECORD);
+            REQUIRE(record.back() == '\n');
+            auto offset = std::stoull(record.substr(0, 20));
+            auto length = std::stoull(record.substr(21, 20));
+            auto expected = "%%Page: " + std::to_string(page) + " " + std::to_string(page) + "\n";
+            REQUIRE(text.compare(offset, expected.size(), expected) == 0);
+            REQUIRE(text.compare(offset + length - 9, 9, "showpage\n") == 0);
+        }
+    }
+
+    SECTION("Writes Files")
+    {
+        const string path = "cps_test_document.ps";
+        const string indexPath = "cps_test_document.idx";
+        {
+            Document document(path);
+            document.set_pageIndex(indexPath);
+            Circle circle(5);
+            document.addPage(circle);
+        }
+        auto contents = readFile(path);
+        auto index = readFile(indexPath);
+        std::remove(path.c_str());
+        std::remove(indexPath.c_str());
+        REQUIRE(contents.compare(0, HEADER.size(), HEADER) == 0);
+        REQUIRE(contents.find(Circle(5).generate().str() + "restore\nshowpage\n") != string::npos);
+        REQUIRE(index.size() == Document::PAGE_INDEX_RECORD);
+        REQUIRE(std::stoull(index.substr(0, 20)) == HEADER.size());
+        REQUIRE(std::stoull(index.substr(21, 20)) == contents.find("%%Trailer") - HEADER.size());
+    }
+
+    SECTION("Unopenable Paths Throw")
+    {
+        REQUIRE_THROWS_AS(Document("no/such/directory/out.ps"), std::system_error);
+    }
+
+    SECTION("Parallel Pages Match Sequential Output")
+    {
+        BufferSink sequentialText;
+        BufferSink sequentialIndex;
+        {
+            Document document(sequentialText);
+            document.set_pageIndex(sequentialIndex);
+            for (auto page = 1; page <= 60; ++page)
+            {
+                document.addPage(numberedPage(page));
+            }
+        }
+
+        ThreadPool pool(3);
+        BufferSink parallelText;
+        BufferSink parallelIndex;
+        {
+            Document document(parallelText);
+            document.set_pageIndex(parallelIndex);
+            document.set_threadPool(&pool);
+            document.set_pageWindow(4);
+            REQUIRE(document.get_threadPool() == &pool);
+            REQUIRE(document.get_pageWindow() == 4);
+            for (auto page = 1; page <= 60; ++page)
+            {
+                if (page % 2 == 0)
+                {
+                    document.addPage(numberedPage(page));
+                }
+                else
+                {
+                    document.generatePage([page] { return numberedPage(page); });
+                }
+                REQUIRE(document.get_numPages() + 4 >= static_cast<std::size_t>(page));
+            }
+        }
+        REQUIRE(parallelText.str() == sequentialText.str());
+        REQUIRE(parallelIndex.str() == sequentialIndex.str());
+    }
+
+    SECTION("Direct Pages Keep Their Place Among Parallel Ones")
+    {
+        ThreadPool pool(2);
+        BufferSink sink;
+        Document document(sink);
+        document.set_threadPool(&pool);
+        document.generatePage([] { return numberedPage(1); });
+        document.generatePage([] { return numberedPage(2); });
+        document.beginPage() << "% third\n";
+        document.generatePage([] { return numberedPage(4); });
+        document.close();
+        const auto &text = sink.str();
+        REQUIRE(document.get_numPages() == 4);
+        REQUIRE(text.find("%%Page: 3 3\nsave\n% third\nrestore\nshowpage\n") != string::npos);
+        REQUIRE(text.find("%%Page: 2 2") < text.find("%%Page: 3 3"));
+        REQUIRE(text.find("%%Page: 3 3") < text.find("%%Page: 4 4"));
+    }
+
+    SECTION("Overview Pages At A Low Resolution")
+    {
+        // Six dots per inch make a pixel 12 points across, wider than the
+        // instance's circle, and pages on the pool are simplified alike.
+        ThreadPool pool(2);
+        BufferSink sequential;
+        BufferSink parallel;
+        {
+            Document document(sequential);
+            Document pooled(parallel);
+            REQUIRE(document.get_resolution() == 0);
+            document.set_resolution(6);
+            pooled.set_resolution(6);
+            pooled.set_threadPool(&pool);
+            for (auto page = 1; page <= 10; ++page)
+            {
+                document.addPage(numberedPage(page));
+                pooled.addPage(numberedPage(page));
+            }
+        }
+        REQUIRE(parallel.str() == sequential.str());
+        REQUIRE(sequential.str().find("rectfill") != string::npos);
+
+        // A document takes the resolution of the sink it writes into.
+        BufferSink low;
+        low.set_resolution(6);
+        REQUIRE(Document(low).get_resolution() == 6);
+    }
+
+    SECTION("Parallel Pages Share Compound Definitions")
+    {
+        auto row = make_unique<HorizontalShapes>();
+        row->pushShape(make_unique<Circle>(4));
+        row->pushShape(make_unique<Rotated>(make_unique<Rectangle>(6, 12), 90));
+        const auto shared = Instance::define(move(row));
+        auto page = [&shared](int number) -> Shape::Shape_ptr {
+            auto column = make_unique<VerticalShapes>();
+            for (auto copy = 0; copy < number % 5 + 1; ++copy)
+            {
+                column->pushShape(make_unique<Instance>(shared));
+            }
+            return column;
+        };
+
+        // Pooled first, so no page has measured the definition before.
+        ThreadPool pool(3);
+        BufferSink parallel;
+        {
+            Document document(parallel);
+            document.set_threadPool(&pool);
+            for (auto number = 1; number <= 40; ++number)
+            {
+                document.generatePage([&page, number] { return page(number); });
+            }
+        }
+        BufferSink sequential;
+        {
+            Document document(sequential);
+            for (auto number = 1; number <= 40; ++number)
+            {
+                document.addPage(page(number));
+            }
+        }
+        REQUIRE(parallel.str() == sequential.str());
+    }
+
+    SECTION("A Failing Page Propagates")
+    {
+        ThreadPool pool(2);
+        BufferSink sink;
+        Document document(sink);
+        document.set_threadPool(&pool);
+        document.generatePage([] { return numberedPage(1); });
+        document.generatePage([]() -> Shape::Shape_ptr { throw std::runtime_error("page failed"); });
+        REQUIRE_THROWS_AS(document.close(), std::runtime_error);
+        REQUIRE(document.get_numPages() == 1);
+    }
+}
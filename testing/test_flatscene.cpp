@@ -0,0 +1,104 @@
+// test_flatscene.cpp
+//
+
+#include <memory>
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+using std::make_unique;
+using std::move;
+
+#include "catch.hpp"
+#include "../cps/shape.hpp"
+#include "../cps/compoundshape.hpp"
+#include "../cps/flatscene.hpp"
+using namespace cps;
+
+TEST_CASE("Flat Scene")
+{
+    flat::Scene scene;
+    auto circle = scene.circle(10);
+    auto rectangle = scene.rectangle(80, 40);
+    auto horizontal = scene.horizontal({circle, rectangle, scene.triangle(30)});
+    auto vertical = scene.vertical({scene.rotated(horizontal, 90), scene.spacer(5, 5), scene.square(20)});
+    auto root = scene.layered({vertical, scene.scaled(circle, {2, 1}), scene.polygon(7, 12)});
+
+    vector<Shape::Shape_ptr> row;
+    row.push_back(make_unique<Circle>(10));
+    row.push_back(make_unique<Rectangle>(80, 40));
+    row.push_back(make_unique<Triangle>(30));
+    vector<Shape::Shape_ptr> column;
+    column.push_back(make_unique<Rotated>(make_unique<HorizontalShapes>(move(row)), 90));
+    column.push_back(make_unique<Spacer>(5, 5));
+    column.push_back(make_unique<Square>(20));
+    Circle scaledCircle(10);
+    vector<Shape::Shape_ptr> layers;
+    layers.push_back(make_unique<VerticalShapes>(move(column)));
+    layers.push_back(make_unique<Scaled>(scaledCircle, std::make_pair(2.0, 1.0)));
+    layers.push_back(make_unique<Polygon>(7, 12));
+    LayeredShapes equivalent(move(layers));
+
+    SECTION("Sizes Match The Class Hierarchy")
+    {
+        REQUIRE(scene.get_width(horizontal) == Approx(20 + 80 + Triangle(30).get_width()));
+        REQUIRE(scene.get_width(root) == equivalent.get_width());
+        REQUIRE(scene.get_height(root) == equivalent.get_height());
+    }
+
+    SECTION("Output Matches The Class Hierarchy")
+    {
+        BufferSink sink;
+        scene.emit(root, sink);
+        REQUIRE(sink.str() == equivalent.generate().str());
+    }
+
+    SECTION("Level Of Detail Matches The Class Hierarchy")
+    {
+        // At 2 dots per inch a pixel is 36 points, and 72 under the scale.
+        BufferSink flatSink;
+        flatSink.set_resolution(2);
+        scene.emit(root, flatSink);
+        BufferSink shapeSink;
+        shapeSink.set_resolution(2);
+        equivalent.emit(shapeSink);
+        REQUIRE(flatSink.str() == shapeSink.str());
+        REQUIRE(flatSink.str().find("rectfill") != string::npos);
+    }
+
+    SECTION("Skyline Uses The Shared Writer")
+    {
+        vector<Building> buildings{{5, 10, 20}, {10, 30, 25}};
+        auto skyline = scene.skyline(buildings);
+        REQUIRE(scene.get_width(skyline) == 65);
+        REQUIRE(scene.get_height(skyline) == 30);
+
+        BufferSink expected;
+        writeSkyline(expected, 65, 30, Buildings(buildings).columns());
+        BufferSink sink;
+        scene.emit(skyline, sink);
+        REQUIRE(sink.str() == expected.str());
+    }
+
+    SECTION("Seeded Skyline Matches The Class Hierarchy")
+    {
+        auto skyline = scene.skyline(30, 372);
+        BufferSink sink;
+        scene.emit(skyline, sink);
+        REQUIRE(sink.str() == Skyline(30, 372u).generate().str());
+    }
+
+    SECTION("Skyline Outline Matches The Class Hierarchy")
+    {
+        auto skyline = scene.skyline(30, 372, true);
+        Skyline equivalentSkyline(30, 372u);
+        equivalentSkyline.set_outline(true);
+        BufferSink sink;
+        scene.emit(skyline, sink);
+        scene.emit(skyline, sink);
+        BufferSink expected;
+        equivalentSkyline.emit(expected);
+        equivalentSkyline.emit(expected);
+        REQUIRE(sink.str() == expected.str());
+    }
+}
@@ -0,0 +1,84 @@
+// test_instance.cpp
+//
+
+#include <memory>
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+using std::make_unique;
+using std::move;
+
+#include "catch.hpp"
+#include "../cps/shape.hpp"
+#include "../cps/compoundshape.hpp"
+#include "../cps/instance.hpp"
+#include "../cps/layout.hpp"
+using namespace cps;
+
+TEST_CASE("Instance")
+{
+    auto column = Instance::define(make_unique<Rectangle>(10, 20));
+    const auto &name = column->name;
+
+    vector<Shape::Shape_ptr> shapes;
+    shapes.push_back(make_unique<Instance>(column));
+    shapes.push_back(make_unique<Instance>(column));
+    shapes.push_back(make_unique<Instance>(column));
+    HorizontalShapes row(move(shapes));
+
+    SECTION("Sizes Come From The Definition")
+    {
+        REQUIRE(row.get_width() == 30);
+        REQUIRE(row.get_height() == 20);
+    }
+
+    SECTION("Use Sites Only Call The Procedure")
+    {
+        REQUIRE(Instance(column).generate().str() == name + "\n");
+        REQUIRE(row.generate().str() == name + "\n\n"
+                                        "5.000000 0 translate\n"
+                                        "5.000000 0 translate\n\n"
+                                        + name + "\n\n"
+                                        "5.000000 0 translate\n"
+                                        "5.000000 0 translate\n\n"
+                                        + name + "\n\n"
+                                        "-20.000000 0 translate\n");
+    }
+
+    SECTION("Definitions Are Written Once, Inner First")
+    {
+        auto grid = Instance::define(make_unique<VerticalShapes>([&] {
+            vector<Shape::Shape_ptr> rows;
+            rows.push_back(make_unique<Instance>(column));
+            rows.push_back(make_unique<Instance>(column));
+            return rows;
+        }()));
+
+        vector<Shape::Shape_ptr> page;
+        page.push_back(make_unique<Instance>(grid));
+        page.push_back(make_unique<Instance>(column));
+        LayeredShapes scene(move(page));
+
+        BufferSink sink;
+        InstanceDefinitions definitions;
+        definitions.write(scene, sink);
+        definitions.write(scene, sink);
+
+        const auto &text = sink.str();
+        auto columnDefinition = text.find("/" + name + " {\n");
+        auto gridDefinition = text.find("/" + grid->name + " {\n");
+        REQUIRE(columnDefinition == 0);
+        REQUIRE(gridDefinition != string::npos);
+        REQUIRE(text.find("/" + name + " {\n", columnDefinition + 1) == string::npos);
+        REQUIRE(text.substr(0, gridDefinition) == "/" + name + " {\n"
+                                                  + Rectangle(10, 20).generate().str()
+                                                  + "} bind def\n");
+        REQUIRE(definitions.contains(grid));
+    }
+
+    SECTION("Layout Expands Instances")
+    {
+        REQUIRE(Layout(row).placements().size() == 3);
+    }
+}
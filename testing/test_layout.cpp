@@ -0,0 +1,107 @@
+// test_layout.cpp
+//
+
+#include <memory>
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+using std::make_unique;
+using std::move;
+
+#include "catch.hpp"
+#include "../cps/shape.hpp"
+#include "../cps/compoundshape.hpp"
+#include "../cps/layout.hpp"
+using namespace cps;
+
+TEST_CASE("Transform")
+{
+    Transform transform;
+    REQUIRE(transform.isIdentity());
+
+    SECTION("Translate Then Rotate")
+    {
+        transform.translate(10, 0);
+        transform.rotate(90);
+        auto point = transform.apply(5, 0);
+        REQUIRE(point.first == 10);
+        REQUIRE(point.second == 5);
+        REQUIRE_FALSE(transform.isTranslation());
+    }
+
+    SECTION("Scale Then Translate")
+    {
+        transform.scale(2, 3);
+        transform.translate(1, 1);
+        auto point = transform.apply(0, 0);
+        REQUIRE(point.first == 2);
+        REQUIRE(point.second == 3);
+    }
+}
+
+TEST_CASE("Layout")
+{
+    SECTION("Horizontal Offsets")
+    {
+        vector<Shape::Shape_ptr> shapes;
+        shapes.push_back(make_unique<Circle>(10));
+        shapes.push_back(make_unique<Rectangle>(40, 10));
+        shapes.push_back(make_unique<Circle>(5));
+        HorizontalShapes horizontal(move(shapes));
+
+        Layout layout(horizontal);
+        const auto &placements = layout.placements();
+        REQUIRE(placements.size() == 3);
+        REQUIRE(placements[0].transform.e == 0);
+        REQUIRE(placements[1].transform.e == 30);
+        REQUIRE(placements[2].transform.e == 55);
+        REQUIRE(layout.finalTransform().isIdentity());
+    }
+
+    SECTION("Nested Vertical Inside Rotated")
+    {
+        vector<Shape::Shape_ptr> shapes;
+        shapes.push_back(make_unique<Rectangle>(10, 20));
+        shapes.push_back(make_unique<Rectangle>(10, 20));
+        Rotated rotated(make_unique<VerticalShapes>(move(shapes)), 90);
+
+        Layout layout(rotated);
+        const auto &placements = layout.placements();
+        REQUIRE(placements.size() == 2);
+        auto second = placements[1].transform.apply(0, 0);
+        REQUIRE(second.first == -20);
+        REQUIRE(second.second == 0);
+    }
+
+    SECTION("Spacers Move Later Shapes")
+    {
+        vector<Shape::Shape_ptr> shapes;
+        shapes.push_back(make_unique<Spacer>(7, 3));
+        shapes.push_back(make_unique<Circle>(1));
+        LayeredShapes layered(move(shapes));
+
+        Layout layout(layered);
+        REQUIRE(layout.placements().size() == 1);
+        REQUIRE(layout.placements()[0].transform.e == 7);
+        REQUIRE(layout.finalTransform().f == 3);
+    }
+
+    SECTION("Emission")
+    {
+        vector<Shape::Shape_ptr> shapes;
+        shapes.push_back(make_unique<Circle>(10));
+        shapes.push_back(make_unique<Circle>(10));
+        HorizontalShapes horizontal(move(shapes));
+
+        BufferSink sink;
+        Layout(horizontal).emit(sink);
+        REQUIRE(sink.str() == "gsave\n"
+                              "0 0 10.000000 0 360 arc stroke\n"
+                              "grestore\n"
+                              "gsave\n"
+                              "20.000000 0.000000 translate\n"
+                              "0 0 10.000000 0 360 arc stroke\n"
+                              "grestore\n");
+    }
+}
@@ -0,0 +1,121 @@
+// test_ops.cpp
+//
+
+#include <memory>
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+using std::make_unique;
+using std::move;
+
+#include "catch.hpp"
+#include "../cps/shape.hpp"
+#include "../cps/compoundshape.hpp"
+#include "../cps/ops.hpp"
+using namespace cps;
+
+namespace
+{
+    string optimized(const string &postScript)
+    {
+        BufferSink output;
+        {
+            PeepholeSink sink(output);
+            sink << postScript;
+        }
+        return output.str();
+    }
+}
+
+TEST_CASE("Op Stream")
+{
+    SECTION("Tokens Become Typed Ops")
+    {
+        OpSink sink;
+        sink << "0 0 " << 10.0 << " 0 360 arc stroke\n/name { 3 100 cpsPolygon } bind def\n";
+        sink.flush();
+
+        const auto &stream = sink.get_ops();
+        const auto &ops = stream.ops();
+        REQUIRE(ops.size() == 8);
+        REQUIRE(ops[0].code == OpCode::Arc);
+        REQUIRE(ops[0].operandCount == 5);
+        REQUIRE(stream.operand(ops[0], 2) == 10);
+        REQUIRE(ops[1].code == OpCode::Stroke);
+        REQUIRE(ops[2].name == "/name");
+        REQUIRE(ops[4].name == "cpsPolygon");
+        REQUIRE(ops[4].operandCount == 2);
+    }
+
+    SECTION("Adjacent Translates Merge")
+    {
+        REQUIRE(optimized("10 0 translate\n10 0 translate\n") == "20 0 translate\n");
+        REQUIRE(optimized("10 0 translate\n-10 0 translate\nstroke\n") == "stroke\n");
+        REQUIRE(optimized("0 0 translate\n") == "");
+    }
+
+    SECTION("Redundant Moveto And Empty Saves")
+    {
+        REQUIRE(optimized("newpath\n1 1 moveto\n2 0 rlineto\nclosepath\n0 0 moveto\nstroke\n")
+                == "newpath\n1 1 moveto\n2 0 rlineto\nclosepath\nstroke\n");
+        REQUIRE(optimized("gsave\n5 5 translate\n90 rotate\ngrestore\n") == "");
+    }
+
+    SECTION("Comments And Strings Survive")
+    {
+        REQUIRE(optimized("%%Page: 1 1\n(a (nested) string\\)) show\n")
+                == "%%Page: 1 1\n(a (nested) string\\))\nshow\n");
+    }
+
+    SECTION("Flushes Keep Partial Operators")
+    {
+        BufferSink output;
+        PeepholeSink sink(output);
+        sink << "10 0 tran";
+        sink.flush();
+        REQUIRE(output.str().empty());
+        sink << "slate\n";
+        sink << 5.0 << " ";
+        sink.flush();
+        REQUIRE(output.str() == "10 0 translate\n");
+        sink << "5 moveto\n";
+        sink.finish();
+        REQUIRE(output.str() == "10 0 translate\n5 5 moveto\n");
+
+        BufferSink split;
+        PeepholeSink splitSink(split);
+        splitSink << "1 0 translate\n";
+        splitSink.flush();
+        splitSink << "2 0 translate\n";
+        splitSink.finish();
+        REQUIRE(split.str() == "1 0 translate\n2 0 translate\n");
+        REQUIRE(optimized("1 0 translate\n2 0 translate\n") == "3 0 translate\n");
+    }
+
+    SECTION("Horizontal Shapes Shrink")
+    {
+        vector<Shape::Shape_ptr> shapes;
+        shapes.push_back(make_unique<Circle>(10));
+        shapes.push_back(make_unique<Rectangle>(10, 20));
+        HorizontalShapes horizontal(move(shapes));
+
+        BufferSink output;
+        {
+            PeepholeSink sink(output);
+            horizontal.emit(sink);
+        }
+        REQUIRE(output.str() == "0 0 10 0 360 arc\n"
+                                "stroke\n"
+                                "15 0 translate\n"
+                                "newpath\n"
+                                "-5 -10 moveto\n"
+                                "10 0 rlineto\n"
+                                "0 20 rlineto\n"
+                                "-10 0 rlineto\n"
+                                "closepath\n"
+                                "stroke\n"
+                                "-15 0 translate\n");
+        REQUIRE(output.str().size() < horizontal.generate().str().size());
+    }
+}
@@ -0,0 +1,232 @@
+// test_pdf.cpp
+//
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+using std::string;
+using std::vector;
+using std::make_unique;
+using std::move;
+
+#include "catch.hpp"
+#include "../cps/pdf.hpp"
+#include "../cps/compoundshape.hpp"
+using namespace cps;
+
+namespace
+{
+    std::size_t count(const string &text, const string &pattern)
+    {
+        std::size_t found = 0;
+        for (auto at = text.find(pattern); at != string::npos; at = text.find(pattern, at + 1))
+        {
+            ++found;
+        }
+        return found;
+    }
+
+    // Checks the trailer points at the cross-reference table and every
+    // entry in it at the object it numbers, and returns the entries.
+    vector<std::size_t> checkXref(const string &pdf)
+    {
+        auto table = pdf.rfind("\nxref\n") + 1;
+        REQUIRE(table != 0);
+        auto start = pdf.find("startxref\n", table + 1);
+        REQUIRE(std::stoul(pdf.substr(start + 10)) == table);
+
+        std::istringstream lines(pdf.substr(table + 5));
+        std::size_t first, size;
+        lines >> first >> size;
+        REQUIRE(first == 0);
+        REQUIRE(pdf.find("/Size " + std::to_string(size) + " ") != string::npos);
+        auto entries = table + pdf.substr(table).find("0000000000 65535 f \n");
+        vector<std::size_t> offsets;
+        for (std::size_t object = 1; object < size; ++object)
+        {
+            auto entry = pdf.substr(entries + 20 * object, 20);
+            REQUIRE(entry.substr(10) == " 00000 n \n");
+            auto offset = std::stoul(entry.substr(0, 10));
+            REQUIRE(pdf.substr(offset, std::to_string(object).size() + 7) == std::to_string(object) + " 0 obj\n");
+            offsets.push_back(offset);
+        }
+        return offsets;
+    }
+
+    // Checks each stream holds exactly as many bytes as its /Length says.
+    void checkStreams(const string &pdf)
+    {
+        for (auto at = pdf.find("/Length "); at != string::npos; at = pdf.find("/Length ", at + 1))
+        {
+            auto length = std::stoul(pdf.substr(at + 8));
+            auto begin = pdf.find(">>\nstream\n", at) + 10;
+            REQUIRE(pdf.substr(begin + length, 11) == "\nendstream\n");
+        }
+    }
+
+    string readFile(const string &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        std::stringstream contents;
+        contents << file.rdbuf();
+        return contents.str();
+    }
+}
+
+TEST_CASE("PDF Document")
+{
+    SECTION("Header, Objects And Trailer")
+    {
+        BufferSink sink;
+        Circle circle(5);
+        Rectangle rectangle(10, 21);
+        {
+            PdfDocument document(sink);
+            REQUIRE(sink.str().substr(0, 9) == "%PDF-1.4\n");
+            document.addPage(circle);
+            document.addPage(rectangle);
+            REQUIRE(document.get_numPages() == 2);
+        }
+        auto pdf = sink.str();
+        REQUIRE(pdf.substr(pdf.size() - 6) == "%%EOF\n");
+        // Catalog, page tree, then a content stream and a page each.
+        REQUIRE(checkXref(pdf).size() == 6);
+        checkStreams(pdf);
+        REQUIRE(count(pdf, "/Type /Page ") == 2);
+        REQUIRE(pdf.find("/Kids [ 4 0 R 6 0 R ] /Count 2") != string::npos);
+        REQUIRE(pdf.find("/Type /Catalog /Pages 2 0 R") != string::npos);
+        REQUIRE(pdf.find("/MediaBox [-5.500000 -5.500000 5.500000 5.500000]") != string::npos);
+        REQUIRE(pdf.find("/MediaBox [-5.500000 -11.000000 5.500000 11.000000]") != string::npos);
+        REQUIRE(pdf.find("-5.000000 -10.500000 10.000000 21.000000 re S\n") != string::npos);
+        // Circles are four Bezier curves, closed.
+        REQUIRE(count(pdf, " c\n") == 4);
+    }
+
+    SECTION("Pages Follow Compound Offsets")
+    {
+        vector<Shape::Shape_ptr> shapes;
+        shapes.push_back(make_unique<Rectangle>(10, 10));
+        shapes.push_back(make_unique<Rotated>(make_unique<Rectangle>(10, 20), 90));
+        HorizontalShapes horizontal(move(shapes));
+        BufferSink sink;
+        PdfDocument document(sink);
+        document.addPage(horizontal, {0, 0, 200, 100});
+        document.close();
+
+        auto pdf = sink.str();
+        REQUIRE(pdf.find("/MediaBox [0.000000 0.000000 200.000000 100.000000]") != string::npos);
+        REQUIRE(pdf.find("0.000000 1.000000 -1.000000 0.000000 15.000000 0.000000 cm\n") != string::npos);
+        REQUIRE(count(pdf, "q\n") == count(pdf, "Q\n"));
+        REQUIRE(count(pdf, "q\n") == 2);
+        checkXref(pdf);
+        checkStreams(pdf);
+    }
+
+    SECTION("Instances Become Forms")
+    {
+        auto star = Instance::define(make_unique<Polygon>(5, 10));
+        auto pair = make_unique<HorizontalShapes>();
+        pair->pushShape(make_unique<Instance>(star));
+        pair->pushShape(make_unique<Instance>(star));
+        auto pairs = Instance::define(move(pair));
+
+        VerticalShapes page;
+        page.pushShape(make_unique<Instance>(star));
+        page.pushShape(make_unique<Instance>(pairs));
+        page.pushShape(make_unique<Instance>(pairs));
+        BufferSink sink;
+        {
+            PdfDocument document(sink);
+            document.addPage(page);
+            document.addPage(page);
+        }
+        auto pdf = sink.str();
+        checkXref(pdf);
+        checkStreams(pdf);
+        // One form each, however often they are drawn and on however many
+        // pages, with the polygon written only in its own form.
+        REQUIRE(count(pdf, "/Subtype /Form") == 2);
+        REQUIRE(count(pdf, " l\n") == 4);
+        REQUIRE(count(pdf, "/" + star->name + " Do\n") == 4);
+        REQUIRE(count(pdf, "/" + pairs->name + " Do\n") == 4);
+        // The form for the pair draws the star, so comes after it.
+        auto starForm = pdf.find("/Subtype /Form");
+        auto pairForm = pdf.find("/Subtype /Form", starForm + 1);
+        REQUIRE(pdf.find("/" + star->name + " Do\n") > starForm);
+        REQUIRE(pdf.find("/" + star->name + " 3 0 R", pairForm) != string::npos);
+    }
+
+    SECTION("Form Boxes Cover Strokes")
+    {
+        auto box = Instance::define(make_unique<Rectangle>(10, 20));
+        Instance instance(box);
+        BufferSink sink;
+        {
+            PdfDocument document(sink);
+            document.addPage(instance);
+        }
+        auto pdf = sink.str();
+        REQUIRE(pdf.find("/BBox [-5.500000 -10.500000 5.500000 10.500000]") != string::npos);
+        REQUIRE(pdf.find("/MediaBox [-5.500000 -10.500000 5.500000 10.500000]") != string::npos);
+        checkXref(pdf);
+    }
+
+    SECTION("Level Of Detail")
+    {
+        vector<Shape::Shape_ptr> shapes;
+        for (auto i = 0; i < 100; ++i)
+        {
+            shapes.push_back(make_unique<Circle>(0.1));
+        }
+        HorizontalShapes dots(move(shapes));
+        BufferSink fine;
+        BufferSink coarse;
+        {
+            PdfDocument document(fine);
+            document.addPage(dots);
+            PdfDocument overview(coarse);
+            overview.set_resolution(72);
+            REQUIRE(overview.get_resolution() == 72);
+            overview.addPage(dots);
+        }
+        REQUIRE(count(fine.str(), " c\n") == 400);
+        REQUIRE(count(coarse.str(), " c\n") == 0);
+        REQUIRE(count(coarse.str(), " re f\n") == 100);
+        checkXref(coarse.str());
+        checkStreams(coarse.str());
+    }
+
+    SECTION("Empty Pages")
+    {
+        LayeredShapes empty;
+        BufferSink sink;
+        {
+            PdfDocument document(sink);
+            document.addPage(empty);
+        }
+        REQUIRE(sink.str().find("/MediaBox [0.000000 0.000000 612.000000 792.000000]") != string::npos);
+        checkXref(sink.str());
+    }
+
+    SECTION("Writing Files")
+    {
+        auto path = "test_pdf_output.pdf";
+        Circle circle(20);
+        BufferSink expected;
+        {
+            PdfDocument document(path);
+            document.addPage(circle);
+            document.close();
+            PdfDocument buffered(expected);
+            buffered.addPage(circle);
+        }
+        REQUIRE(readFile(path) == expected.str());
+        std::remove(path);
+
+        REQUIRE_THROWS_AS(PdfDocument("no/such/directory/out.pdf"), std::system_error);
+    }
+}
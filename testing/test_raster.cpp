@@ -0,0 +1,330 @@
+// test_raster.cpp
+//
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+using std::make_unique;
+using std::move;
+
+#include "catch.hpp"
+#include "../cps/raster.hpp"
+#include "../cps/compoundshape.hpp"
+#include "../cps/threadpool.hpp"
+using namespace cps;
+
+namespace
+{
+    std::uint32_t readUint32(const string &data, std::size_t at)
+    {
+        return std::uint32_t(std::uint8_t(data[at])) << 24 | std::uint32_t(std::uint8_t(data[at + 1])) << 16 |
+               std::uint32_t(std::uint8_t(data[at + 2])) << 8 | std::uint32_t(std::uint8_t(data[at + 3]));
+    }
+
+    std::uint32_t slowCrc32(const string &data)
+    {
+        std::uint32_t crc = 0xFFFFFFFFu;
+        for (auto byte : data)
+        {
+            crc ^= std::uint8_t(byte);
+            for (auto bit = 0; bit < 8; ++bit)
+            {
+                crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+            }
+        }
+        return ~crc;
+    }
+
+    // Checks every chunk's CRC and unpacks the stored deflate blocks, then
+    // returns the rows without their filter bytes.
+    string pngPixels(const string &png, std::size_t width, std::size_t height, std::size_t channels)
+    {
+        REQUIRE(png.substr(0, 8) == "\x89PNG\r\n\x1A\n");
+        string data;
+        vector<string> types;
+        for (std::size_t at = 8; at < png.size();)
+        {
+            auto length = readUint32(png, at);
+            auto type = png.substr(at + 4, 4);
+            auto body = png.substr(at + 8, length);
+            REQUIRE(readUint32(png, at + 8 + length) == slowCrc32(type + body));
+            if (type == "IHDR")
+            {
+                REQUIRE(readUint32(body, 0) == width);
+                REQUIRE(readUint32(body, 4) == height);
+                REQUIRE(body[9] == (channels == 1 ? 0 : 6));
+            }
+            else if (type == "IDAT")
+            {
+                data += body;
+            }
+            types.push_back(type);
+            at += 12 + length;
+        }
+        REQUIRE(types == vector<string>{"IHDR", "IDAT", "IEND"});
+
+        string raw;
+        std::size_t at = 2;
+        for (auto last = false; !last;)
+        {
+            last = (data[at] & 1) != 0;
+            auto size = std::size_t(std::uint8_t(data[at + 1])) | std::size_t(std::uint8_t(data[at + 2])) << 8;
+            raw += data.substr(at + 5, size);
+            at += 5 + size;
+        }
+        REQUIRE(at + 4 == data.size());
+        string pixels;
+        for (std::size_t y = 0; y < height; ++y)
+        {
+            auto line = y * (width * channels + 1);
+            REQUIRE(raw[line] == 0);
+            pixels += raw.substr(line + 1, width * channels);
+        }
+        return pixels;
+    }
+
+    int gray(const Bitmap &bitmap, std::size_t x, std::size_t y)
+    {
+        return bitmap.get_pixel(x, y).red;
+    }
+}
+
+TEST_CASE("Bitmap")
+{
+    SECTION("Pixels")
+    {
+        Bitmap bitmap(4, 3);
+        REQUIRE(bitmap.get_channels() == 1);
+        REQUIRE(bitmap.pixels() == vector<std::uint8_t>(12, 255));
+        bitmap.fill({255, 0, 0, 255});
+        REQUIRE(gray(bitmap, 3, 2) == 76);
+
+        Bitmap color(2, 2, Bitmap::Format::Rgba);
+        REQUIRE(color.get_channels() == 4);
+        color.fill({1, 2, 3, 4});
+        color.row(1)[4] = 9;
+        REQUIRE(color.get_pixel(1, 1).red == 9);
+        REQUIRE(color.get_pixel(0, 1).alpha == 4);
+    }
+
+    SECTION("PPM")
+    {
+        Bitmap bitmap(3, 2);
+        bitmap.row(1)[2] = 7;
+        BufferSink sink;
+        bitmap.writePpm(sink);
+        REQUIRE(sink.str() == string("P5\n3 2\n255\n") + string(5, '\xFF') + "\x07");
+
+        Bitmap color(1, 2, Bitmap::Format::Rgba);
+        color.fill({1, 2, 3, 4});
+        BufferSink colorSink;
+        color.writePpm(colorSink);
+        REQUIRE(colorSink.str() == string("P6\n1 2\n255\n\x01\x02\x03\x01\x02\x03"));
+    }
+
+    SECTION("PNG")
+    {
+        Bitmap bitmap(5, 4);
+        bitmap.row(2)[3] = 42;
+        BufferSink sink;
+        bitmap.writePng(sink);
+        REQUIRE(pngPixels(sink.str(), 5, 4, 1) ==
+                string(bitmap.pixels().begin(), bitmap.pixels().end()));
+
+        // Large enough to need several stored blocks.
+        Bitmap color(300, 100, Bitmap::Format::Rgba);
+        color.fill({10, 20, 30, 40});
+        color.row(99)[1199] = 0;
+        BufferSink colorSink;
+        color.writePng(colorSink);
+        REQUIRE(pngPixels(colorSink.str(), 300, 100, 4) ==
+                string(color.pixels().begin(), color.pixels().end()));
+    }
+}
+
+TEST_CASE("Rasterizer")
+{
+    SECTION("Strokes Outlines")
+    {
+        Bitmap bitmap(100, 100);
+        Rasterizer rasterizer(bitmap);
+        rasterizer.set_transform({1, 0, 0, -1, 50, 50});
+        rasterizer.set_lineWidth(2);
+        Rectangle rectangle(60, 40);
+        rasterizer.draw(rectangle);
+
+        // The sides run along x = 20 and 80, y = 30 and 70, and each
+        // covers the pixels a unit to either side.
+        REQUIRE(gray(bitmap, 19, 50) == 0);
+        REQUIRE(gray(bitmap, 20, 50) == 0);
+        REQUIRE(gray(bitmap, 21, 50) == 255);
+        REQUIRE(gray(bitmap, 79, 50) == 0);
+        REQUIRE(gray(bitmap, 50, 30) == 0);
+        REQUIRE(gray(bitmap, 50, 69) == 0);
+        REQUIRE(gray(bitmap, 50, 50) == 255);
+        REQUIRE(gray(bitmap, 10, 50) == 255);
+        REQUIRE(gray(bitmap, 50, 90) == 255);
+
+        Circle circle(20);
+        rasterizer.draw(circle);
+        REQUIRE(gray(bitmap, 70, 50) < 64);
+        REQUIRE(gray(bitmap, 50, 30) == 0);
+        REQUIRE(gray(bitmap, 50, 50) == 255);
+        REQUIRE(gray(bitmap, 64, 36) < 192);
+    }
+
+    SECTION("Overlapping Strokes Darken Once")
+    {
+        Bitmap once(40, 40);
+        Bitmap twice(40, 40);
+        Circle circle(10.3);
+        vector<Shape::Shape_ptr> shapes;
+        shapes.push_back(make_unique<Circle>(10.3));
+        shapes.push_back(make_unique<Circle>(10.3));
+        LayeredShapes layered(move(shapes));
+
+        Rasterizer first(once);
+        first.set_transform({1, 0, 0, -1, 20, 20});
+        first.draw(circle);
+        Rasterizer second(twice);
+        second.set_transform({1, 0, 0, -1, 20, 20});
+        second.draw(layered);
+        REQUIRE((once.pixels() == twice.pixels()));
+    }
+
+    SECTION("Transforms And Fitting")
+    {
+        vector<Shape::Shape_ptr> shapes;
+        shapes.push_back(make_unique<Rectangle>(100, 10));
+        shapes.push_back(make_unique<Rotated>(make_unique<Rectangle>(100, 10), 90));
+        HorizontalShapes horizontal(move(shapes));
+        Bitmap bitmap(110, 100);
+        Rasterizer rasterizer(bitmap);
+        rasterizer.fit(horizontal.get_bounds());
+        rasterizer.set_lineWidth(2);
+        REQUIRE(rasterizer.get_transform().a == 1);
+        rasterizer.draw(horizontal);
+
+        // The bar lies across the left, the turned bar stands at the right.
+        REQUIRE(gray(bitmap, 50, 45) == 0);
+        REQUIRE(gray(bitmap, 50, 10) == 255);
+        REQUIRE(gray(bitmap, 100, 10) == 0);
+        REQUIRE(gray(bitmap, 105, 10) == 255);
+        REQUIRE(gray(bitmap, 109, 10) == 0);
+
+        Circle circle(5);
+        Scaled scaled(circle, {4, 1});
+        Bitmap stretched(60, 20);
+        Rasterizer stretcher(stretched);
+        stretcher.set_transform({1, 0, 0, -1, 30, 10});
+        stretcher.draw(scaled);
+        REQUIRE(gray(stretched, 10, 10) == 0);
+        REQUIRE(gray(stretched, 30, 10) == 255);
+    }
+
+    SECTION("Colors")
+    {
+        Bitmap bitmap(20, 20, Bitmap::Format::Rgba);
+        bitmap.fill({0, 0, 0, 0});
+        Rasterizer rasterizer(bitmap);
+        rasterizer.set_color({255, 128, 0, 255});
+        rasterizer.set_transform({1, 0, 0, -1, 10, 10});
+        rasterizer.set_lineWidth(4);
+        REQUIRE(rasterizer.get_lineWidth() == 4);
+        Rectangle rectangle(12, 12);
+        rasterizer.draw(rectangle);
+
+        auto stroke = bitmap.get_pixel(4, 10);
+        REQUIRE(stroke.red == 255);
+        REQUIRE(stroke.green == 128);
+        REQUIRE(stroke.blue == 0);
+        REQUIRE(stroke.alpha == 255);
+        REQUIRE(bitmap.get_pixel(10, 10).alpha == 0);
+
+        rasterizer.set_color({0, 0, 255, 128});
+        rasterizer.draw(rectangle);
+        stroke = bitmap.get_pixel(4, 10);
+        REQUIRE(stroke.red == 127);
+        REQUIRE(stroke.blue == 128);
+    }
+
+    SECTION("Thumbnails Keep Detail Legible")
+    {
+        // Far smaller than a pixel, but drawn as a dot, and strokes stay a
+        // pixel wide however small the scale.
+        Circle dot(0.01);
+        Rectangle big(1000, 1000);
+        Bitmap bitmap(10, 10);
+        Rasterizer rasterizer(bitmap);
+        rasterizer.set_transform({1, 0, 0, -1, 5, 5});
+        rasterizer.draw(dot);
+        REQUIRE(gray(bitmap, 5, 5) < 128);
+        REQUIRE(gray(bitmap, 2, 2) == 255);
+
+        Bitmap thumbnail(10, 10);
+        Rasterizer shrinker(thumbnail);
+        shrinker.fit(big.get_bounds());
+        shrinker.draw(big);
+        REQUIRE(gray(thumbnail, 0, 5) < 192);
+        REQUIRE(gray(thumbnail, 5, 5) == 255);
+
+        // A skyline far wider than it is tall shows as a band across the
+        // middle, traced from its envelope rather than every building.
+        Skyline skyline(100000, std::uint64_t(5));
+        Bitmap overview(64, 16);
+        Rasterizer overviewer(overview);
+        overviewer.fit(skyline.get_bounds());
+        overviewer.draw(skyline);
+        REQUIRE(gray(overview, 32, 8) < 192);
+        REQUIRE(gray(overview, 32, 2) == 255);
+    }
+
+    SECTION("Tiles Match One Pass")
+    {
+        auto grid = make_unique<VerticalShapes>();
+        for (auto row = 0; row < 12; ++row)
+        {
+            auto line = make_unique<HorizontalShapes>();
+            for (auto column = 0; column < 12; ++column)
+            {
+                line->pushShape(make_unique<Circle>(3 + (row + column) % 5));
+                line->pushShape(make_unique<Rotated>(make_unique<Polygon>(3 + column % 4, 6), 90));
+            }
+            line->pushShape(make_unique<Skyline>(40, std::uint64_t(row)));
+            grid->pushShape(move(line));
+        }
+        Bitmap single(257, 131, Bitmap::Format::Rgba);
+        Bitmap tiled(257, 131, Bitmap::Format::Rgba);
+        Rasterizer one(single);
+        one.fit(grid->get_bounds());
+        one.draw(*grid);
+
+        ThreadPool pool(4);
+        Rasterizer many(tiled);
+        many.set_threadPool(&pool);
+        many.set_tileSize(16);
+        REQUIRE(many.get_tileSize() == 16);
+        many.fit(grid->get_bounds());
+        many.draw(*grid);
+        REQUIRE((single.pixels() == tiled.pixels()));
+        REQUIRE((single.pixels() != Bitmap(257, 131, Bitmap::Format::Rgba).pixels()));
+    }
+
+    SECTION("Shapes Off The Bitmap")
+    {
+        Circle circle(10);
+        Bitmap bitmap(10, 10);
+        Rasterizer rasterizer(bitmap);
+        rasterizer.set_transform({1, 0, 0, -1, 500, -500});
+        rasterizer.draw(circle);
+        REQUIRE(bitmap.pixels() == vector<std::uint8_t>(100, 255));
+
+        LayeredShapes empty;
+        rasterizer.fit(empty.get_bounds());
+        rasterizer.draw(empty);
+        REQUIRE(bitmap.pixels() == vector<std::uint8_t>(100, 255));
+    }
+}
@@ -0,0 +1,78 @@
+// test_rope.cpp
+//
+
+#include <memory>
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+using std::make_unique;
+using std::move;
+
+#include "catch.hpp"
+#include "../cps/shape.hpp"
+#include "../cps/compoundshape.hpp"
+#include "../cps/rope.hpp"
+using namespace cps;
+
+TEST_CASE("Rope")
+{
+    Rope rope("gsave\n");
+
+    SECTION("Appending Text")
+    {
+        rope.append("90 rotate\n").append("");
+        REQUIRE(rope.size() == 16);
+        REQUIRE(rope.str() == "gsave\n90 rotate\n");
+    }
+
+    SECTION("Linked Ropes Are Not Changed By Later Appends")
+    {
+        Rope child("stroke\n");
+        rope.append(child);
+        child.append("showpage\n");
+        rope.append("grestore\n");
+
+        REQUIRE(rope.str() == "gsave\nstroke\ngrestore\n");
+        REQUIRE(child.str() == "stroke\nshowpage\n");
+    }
+
+    SECTION("Appending A Rope To Itself")
+    {
+        rope.append(rope);
+        REQUIRE(rope.str() == "gsave\ngsave\n");
+    }
+}
+
+TEST_CASE("Shape Fragments")
+{
+    SECTION("Match generate()")
+    {
+        vector<Shape::Shape_ptr> shapes;
+        shapes.push_back(make_unique<Circle>(10));
+        shapes.push_back(make_unique<Rectangle>(80, 40));
+        shapes.push_back(make_unique<Spacer>(5, 5));
+        Rotated rotated(make_unique<HorizontalShapes>(move(shapes)), 270);
+        Circle circle(3);
+        Scaled scaled(rotated, {2, 1});
+
+        REQUIRE(rotated.fragment().str() == rotated.generate().str());
+        REQUIRE(scaled.fragment().str() == scaled.generate().str());
+        REQUIRE(circle.fragment().str() == circle.generate().str());
+    }
+
+    SECTION("Deep Nesting")
+    {
+        Shape::Shape_ptr scene = make_unique<Circle>(1);
+        for (auto depth = 0; depth < 10000; ++depth)
+        {
+            vector<Shape::Shape_ptr> shapes;
+            shapes.push_back(move(scene));
+            shapes.push_back(make_unique<Circle>(1));
+            scene = make_unique<VerticalShapes>(move(shapes));
+        }
+
+        auto rope = scene->fragment();
+        REQUIRE(rope.str() == scene->generate().str());
+    }
+}
@@ -1,6 +1,7 @@
 // test_shape.cpp
 //
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <vector>
@@ -12,6 +13,8 @@ using std::move;
 #include "catch.hpp"
 #include "../cps/shape.hpp"
 #include "../cps/compoundshape.hpp"
+#include "../cps/layout.hpp"
+#include "../cps/prolog.hpp"
 using namespace cps;
 
 TEST_CASE("Circle")
@@ -60,22 +63,16 @@ TEST_CASE("Polygon", "[polygon]")
     {
         Polygon t(3, 100);
 
-        REQUIRE(t.generate().str() == "/length 100.000000 def\n" \
-            "/nSides 3.000000 def\n" \
-            "/angle { 360 nSides div } def\n" \
-            "gsave\n" \
+        REQUIRE(t.generate().str() == "gsave\n"
             "-50.000000 -43.301270 translate\n"
-            "newpath\n" \
-            "0 0 moveto\n" \
-            "0 angle 360 {\n" \
-            "length 0 lineto\n" \
-            "length 0 translate\n" \
-            "angle rotate\n" \
-            "} for\n" \
-            "closepath\n" \
-            "stroke\n" \
+            "3 100.000000 cpsPolygon\n"
             "grestore\n");
     }
+    SECTION("Procedure Is Bound In The Prolog")
+    {
+        REQUIRE(PROLOG.find("/" + POLYGON_PROCEDURE + " {") == 0);
+        REQUIRE(PROLOG.find("} bind def\n") != string::npos);
+    }
 }
 
 TEST_CASE("Triangle","[triangle]")
@@ -89,20 +86,9 @@ TEST_CASE("Triangle","[triangle]")
     {
         Triangle t(100);
 
-        REQUIRE( t.generate().str() == "/length 100.000000 def\n" \
-            "/nSides 3.000000 def\n" \
-            "/angle { 360 nSides div } def\n" \
-            "gsave\n" \
-            "-50.000000 -43.301270 translate\n" \
-            "newpath\n" \
-            "0 0 moveto\n" \
-            "0 angle 360 {\n" \
-            "length 0 lineto\n" \
-            "length 0 translate\n" \
-            "angle rotate\n" \
-            "} for\n" \
-            "closepath\n" \
-            "stroke\n" \
+        REQUIRE( t.generate().str() == "gsave\n"
+            "-50.000000 -43.301270 translate\n"
+            "3 100.000000 cpsPolygon\n"
             "grestore\n");
 
     }
@@ -119,20 +105,9 @@ TEST_CASE("Square","[square]")
     {
         Square s(100);
 
-        REQUIRE( s.generate().str() == "/length 100.000000 def\n" \
-            "/nSides 4.000000 def\n" \
-            "/angle { 360 nSides div } def\n" \
-            "gsave\n" \
-            "-50.000000 -50.000000 translate\n" \
-            "newpath\n" \
-            "0 0 moveto\n" \
-            "0 angle 360 {\n" \
-            "length 0 lineto\n" \
-            "length 0 translate\n" \
-            "angle rotate\n" \
-            "} for\n" \
-            "closepath\n" \
-            "stroke\n" \
+        REQUIRE( s.generate().str() == "gsave\n"
+            "-50.000000 -50.000000 translate\n"
+            "4 100.000000 cpsPolygon\n"
             "grestore\n");
 
     }
@@ -265,6 +240,102 @@ TEST_CASE("Vertical Shape")
 	}
 }
 
+TEST_CASE("Cached Compound Sizes")
+{
+    auto innerShape = make_unique<VerticalShapes>();
+    auto &inner = *innerShape;
+    inner.pushShape(make_unique<Circle>(10));
+
+    auto circleShape = make_unique<Circle>(5);
+    auto &circle = *circleShape;
+
+    HorizontalShapes outer;
+    outer.pushShape(move(innerShape));
+    outer.pushShape(move(circleShape));
+
+    REQUIRE(outer.get_width() == 30);
+    REQUIRE(outer.get_height() == 20);
+
+    SECTION("Pushing Into A Child Updates Ancestors")
+    {
+        inner.pushShape(make_unique<Rectangle>(40, 5));
+        REQUIRE(inner.get_width() == 40);
+        REQUIRE(outer.get_width() == 50);
+        REQUIRE(outer.get_height() == 25);
+    }
+
+    SECTION("Setters Update Ancestors")
+    {
+        circle.set_width(100);
+        REQUIRE(outer.get_width() == 120);
+        REQUIRE(outer.get_height() == 100);
+    }
+
+    SECTION("Rotated Follows Its Child")
+    {
+        auto rotatedInner = make_unique<HorizontalShapes>();
+        auto &rotatedChildren = *rotatedInner;
+        rotatedChildren.pushShape(make_unique<Rectangle>(10, 20));
+        Rotated rotated(move(rotatedInner), 90);
+        REQUIRE(rotated.get_width() == 20);
+
+        rotatedChildren.pushShape(make_unique<Rectangle>(10, 30));
+        REQUIRE(rotated.get_width() == 30);
+        REQUIRE(rotated.get_height() == 20);
+    }
+
+    SECTION("Moved Compounds Keep Tracking Children")
+    {
+        HorizontalShapes moved(move(outer));
+        REQUIRE(moved.get_width() == 30);
+        circle.set_width(20);
+        REQUIRE(moved.get_width() == 40);
+    }
+}
+
+TEST_CASE("Scaled Children Invalidate Their Compounds")
+{
+    Circle circle(10);
+    HorizontalShapes outer;
+    outer.pushShape(make_unique<Scaled>(circle, std::make_pair(1.0, 1.0)));
+    outer.pushShape(make_unique<Circle>(5));
+
+    REQUIRE(outer.get_width() == 30);
+    REQUIRE(outer.get_bounds().right - outer.get_bounds().left == 30);
+    auto drift = outer.get_drift();
+
+    circle.set_width(100);
+    REQUIRE(outer.get_width() == 110);
+    REQUIRE(outer.get_height() == 100);
+    REQUIRE(outer.get_bounds().right - outer.get_bounds().left == 110);
+    REQUIRE(outer.get_bounds().top - outer.get_bounds().bottom == 100);
+    REQUIRE(outer.get_drift() == drift);
+
+    SECTION("Through Several Wrappers")
+    {
+        Scaled twice(circle, {2, 2});
+        VerticalShapes column;
+        column.pushShape(make_unique<Scaled>(twice, std::make_pair(1.0, 1.0)));
+        REQUIRE(column.get_height() == 100);
+
+        circle.set_height(40);
+        REQUIRE(column.get_height() == 40);
+        REQUIRE(outer.get_width() == 50);
+    }
+
+    SECTION("Rotated Bounds Follow A Scaled Child")
+    {
+        Rotated rotated(make_unique<Scaled>(circle, std::make_pair(2.0, 1.0)), 90);
+        REQUIRE(rotated.get_bounds().top == 100);
+        REQUIRE(rotated.get_bounds().right == 50);
+
+        circle.set_width(20);
+        REQUIRE(rotated.get_width() == 20);
+        REQUIRE(rotated.get_bounds().top == Approx(20));
+        REQUIRE(rotated.get_bounds().right == Approx(10));
+    }
+}
+
 TEST_CASE("Rectangle")
 {
     Rectangle r1;
@@ -430,6 +501,375 @@ TEST_CASE("Skyline")
     //No further tests as results are random
 }
 
+TEST_CASE("Skyline Outline")
+{
+    SECTION("Adjacent And Overlapping Footprints Merge")
+    {
+        // Three buildings: the second overlaps the first and the third
+        // touches the second, so only one rise and fall is shared.
+        Skyline skyline({{10, 20, 30}, {20, 20, 50}, {40, 10, 20}});
+        REQUIRE(skyline.get_width() == 60);
+        REQUIRE(skyline.get_height() == 50);
+        skyline.set_outline(true);
+        REQUIRE(skyline.generate().str() == "gsave\n"
+                                            "-30.000000 -25.000000 moveto\n"
+                                            "10.000000 0 rlineto\n"
+                                            "0 30.000000 rlineto\n"
+                                            "10.000000 0 rlineto\n"
+                                            "0 20.000000 rlineto\n"
+                                            "20.000000 0 rlineto\n"
+                                            "0 -30.000000 rlineto\n"
+                                            "10.000000 0 rlineto\n"
+                                            "0 -20.000000 rlineto\n"
+                                            "10.000000 0 rlineto\n"
+                                            "0 0 moveto\n"
+                                            "stroke\n"
+                                            "grestore\n");
+    }
+
+    SECTION("Separate Buildings Keep Their Own Sides")
+    {
+        Buildings buildings({{5, 10, 20}, {10, 30, 25}});
+        auto outline = skylineOutline(buildings.columns());
+        REQUIRE(outline.size() == 4);
+        REQUIRE(outline[0].x == 5);
+        REQUIRE(outline[0].height == 10);
+        REQUIRE(outline[1].x == 25);
+        REQUIRE(outline[1].height == 0);
+        REQUIRE(outline[2].x == 35);
+        REQUIRE(outline[2].height == 30);
+        REQUIRE(outline[3].x == 60);
+        REQUIRE(outline[3].height == 0);
+    }
+
+    SECTION("Contained Buildings Disappear")
+    {
+        Buildings buildings(buildingsFromFootprints({{0, 100, 50}, {10, 20, 30}, {50, 10, 40}}));
+        auto outline = skylineOutline(buildings.columns());
+        REQUIRE(outline.size() == 2);
+        REQUIRE(outline[0].height == 50);
+        REQUIRE(outline[1].x == 100);
+    }
+}
+
+TEST_CASE("Building Columns")
+{
+    std::vector<double> values;
+    for (auto i = 0; i < 37; ++i)
+    {
+        values.push_back((i * 7) % 23 - 5.5);
+    }
+
+    SECTION("Reductions Match A Scalar Loop")
+    {
+        for (std::size_t count = 1; count <= values.size(); ++count)
+        {
+            double total = 0;
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                total += values[i];
+            }
+            REQUIRE(sumOf(values.data(), count) == Approx(total));
+            REQUIRE(maxOf(values.data(), count) == *std::max_element(values.begin(), values.begin() + count));
+            REQUIRE(minOf(values.data(), count) == *std::min_element(values.begin(), values.begin() + count));
+        }
+        REQUIRE(sumOf(values.data(), 0) == 0);
+    }
+
+    SECTION("Columns Round Trip Buildings")
+    {
+        Buildings buildings({{1, 2, 3}, {4, 5, 6}});
+        buildings.push_back({7, 8, 9});
+        REQUIRE(buildings.size() == 3);
+        REQUIRE(buildings[2].height == 8);
+        auto columns = buildings.columns(1, 2);
+        REQUIRE(columns.count == 2);
+        REQUIRE(columns.spacings[0] == 4);
+        REQUIRE(columns.widths[1] == 9);
+        REQUIRE(skylineSize(buildings.columns()).first == 3 + 6 + 9 + 1 + 4 + 7 + 1);
+        REQUIRE(skylineSize(buildings.columns()).second == 8);
+    }
+}
+
+TEST_CASE("Seeded Skyline")
+{
+    Skyline first(50, 372u);
+    Skyline second(50, 372u);
+    Skyline other(50, 373u);
+
+    SECTION("Same Seed Gives The Same Skyline")
+    {
+        REQUIRE(first.get_width() == second.get_width());
+        REQUIRE(first.generate().str() == second.generate().str());
+        REQUIRE(first.generate().str() != other.generate().str());
+    }
+
+    SECTION("Buildings Are Derived From Their Index")
+    {
+        Buildings all(100);
+        generateBuildings(372, 0, all, 0, all.size());
+        Buildings tail(50);
+        generateBuildings(372, 60, tail, 10, 40);
+        for (std::size_t i = 0; i < 40; ++i)
+        {
+            REQUIRE(tail[10 + i].height == all[60 + i].height);
+            REQUIRE(tail[10 + i].width == all[60 + i].width);
+            REQUIRE(tail[10 + i].spacing == all[60 + i].spacing);
+        }
+        REQUIRE(skylineBuilding(372, 7).width == all[7].width);
+        for (std::size_t i = 0; i < all.size(); ++i)
+        {
+            auto building = all[i];
+            REQUIRE(building.height >= 10);
+            REQUIRE(building.height < 100);
+            REQUIRE(building.width >= 20);
+            REQUIRE(building.width < 50);
+            REQUIRE(building.spacing >= 5);
+            REQUIRE(building.spacing < 20);
+        }
+    }
+
+    SECTION("Outline Of Spaced Buildings Is Unchanged")
+    {
+        Skyline outlined(50, 372u);
+        outlined.set_outline(true);
+        REQUIRE(outlined.get_outline());
+        REQUIRE(outlined.generate().str() == first.generate().str());
+    }
+
+    SECTION("Injected Engine")
+    {
+        Skyline fromEngine(20, std::mt19937(5));
+        std::mt19937 engine(5);
+        Skyline fromSameEngine(20, engine);
+        REQUIRE(fromEngine.generate().str() == fromSameEngine.generate().str());
+    }
+}
+
+TEST_CASE("Deeply Nested Shapes")
+{
+    // Far deeper than the call stack could follow recursively.
+    const auto depth = 1000000;
+    auto circle = make_unique<Circle>(5);
+    auto leaf = circle.get();
+    Shape::Shape_ptr shape = move(circle);
+    for (auto level = 0; level < depth; ++level)
+    {
+        if (level % 2 == 0)
+        {
+            shape = make_unique<Rotated>(move(shape), 90);
+        }
+        else
+        {
+            auto column = make_unique<VerticalShapes>();
+            column->pushShape(move(shape));
+            shape = move(column);
+        }
+    }
+
+    REQUIRE(shape->get_nodeCount() == depth + 1);
+    REQUIRE(shape->get_width() == 10);
+    REQUIRE(shape->get_height() == 10);
+
+    const string rotatedText = "gsave\n90 rotate\n" "grestore\n";
+    auto text = shape->generate().str();
+    REQUIRE(text.size() == leaf->generate().str().size() + (depth / 2) * (rotatedText.size() + 1));
+    REQUIRE(text.compare(0, 16, "gsave\n90 rotate\n") == 0);
+    REQUIRE(text.compare(text.size() - 10, 10, "grestore\n\n") == 0);
+    REQUIRE(shape->fragment().str() == text);
+
+    Layout layout(*shape);
+    REQUIRE(layout.placements().size() == 1);
+    REQUIRE(layout.placements()[0].shape == leaf);
+
+    leaf->set_width(20);
+    REQUIRE(shape->get_width() == 20);
+    REQUIRE(shape->get_height() == 20);
+
+    shape.reset();
+}
+
+TEST_CASE("Viewport Culling")
+{
+    auto row = make_unique<HorizontalShapes>();
+    for (auto i = 0; i < 10; ++i)
+    {
+        row->pushShape(make_unique<Circle>(5));
+    }
+
+    SECTION("Compound Bounds")
+    {
+        // Each circle is placed by its center, ten points after the last.
+        auto bounds = row->get_bounds();
+        REQUIRE(bounds.left == -5);
+        REQUIRE(bounds.right == 95);
+        REQUIRE(bounds.bottom == -5);
+        REQUIRE(bounds.top == 5);
+        REQUIRE(row->get_drift() == std::make_pair(0.0, 0.0));
+
+        row->pushShape(make_unique<Circle>(10));
+        REQUIRE(row->get_bounds().right == 115);
+        REQUIRE(row->get_bounds().top == 10);
+    }
+
+    SECTION("Spacers Drift")
+    {
+        Spacer spacer(30, 40);
+        REQUIRE(spacer.get_drift() == std::make_pair(30.0, 40.0));
+        LayeredShapes layers;
+        layers.pushShape(make_unique<Spacer>(30, 40));
+        layers.pushShape(make_unique<Circle>(5));
+        REQUIRE(layers.get_drift() == std::make_pair(30.0, 40.0));
+        REQUIRE(layers.get_bounds().left == 25);
+        REQUIRE(layers.get_bounds().top == 45);
+    }
+
+    SECTION("A Clip Around Everything Changes Nothing")
+    {
+        REQUIRE(row->generate({-100, -100, 200, 100}).str() == row->generate().str());
+    }
+
+    SECTION("Shapes Outside The Clip Are Left Out")
+    {
+        // Only the circles centered at 30, 40 and 50 reach into the clip.
+        auto count = [](const string &text, const string &pattern) {
+            std::size_t found = 0;
+            for (auto at = text.find(pattern); at != string::npos; at = text.find(pattern, at + 1))
+            {
+                ++found;
+            }
+            return found;
+        };
+        auto full = row->generate().str();
+        auto text = row->generate({30, -1, 50, 1}).str();
+        REQUIRE(count(text, " arc ") == 3);
+        REQUIRE(count(text, " translate\n") == count(full, " translate\n"));
+        REQUIRE(row->generate({200, 200, 300, 300}).str().find(" arc ") == string::npos);
+    }
+
+    SECTION("Culled Spacers Still Move What Follows")
+    {
+        LayeredShapes layers;
+        layers.pushShape(make_unique<Spacer>(100, 0));
+        layers.pushShape(make_unique<Circle>(5));
+        auto text = layers.generate({90, -10, 110, 10}).str();
+        REQUIRE(text == layers.generate().str());
+        REQUIRE(text.find("100.000000 0.000000 translate") != string::npos);
+
+        LayeredShapes blank;
+        blank.pushShape(make_unique<Spacer>(10, 10));
+        REQUIRE(blank.get_bounds().empty());
+        REQUIRE(blank.generate({-100, -100, 100, 100}).str() == "10.000000 10.000000 translate\n");
+    }
+
+    SECTION("Clipping Follows Rotation")
+    {
+        // Turned a quarter, the row runs up the y axis instead.
+        Rotated rotated(move(row), 90);
+        REQUIRE(rotated.get_bounds().bottom == Approx(-5));
+        REQUIRE(rotated.get_bounds().top == Approx(95));
+        REQUIRE(rotated.generate({-1, 80, 1, 90}).str().find(" arc ") != string::npos);
+        REQUIRE(rotated.generate({80, -1, 90, 1}).str().find(" arc ") == string::npos);
+    }
+}
+
+TEST_CASE("Level Of Detail")
+{
+    BufferSink sink;
+    REQUIRE(sink.get_pixelSize() == 0);
+    sink.set_resolution(72);
+    REQUIRE(sink.get_pixelSize() == 1);
+
+    SECTION("Scales Shrink The User Space")
+    {
+        sink.pushScale(0.5, -0.25);
+        REQUIRE(sink.get_pixelSize() == 2);
+        sink.pushScale(0.1, 0.1);
+        REQUIRE(sink.get_pixelSize() == Approx(20));
+        sink.popScale();
+        sink.popScale();
+        REQUIRE(sink.get_pixelSize() == 1);
+    }
+
+    SECTION("Tiny Shapes Become Dots")
+    {
+        Circle(0.2).emit(sink);
+        Rectangle(0.5, 0.9).emit(sink);
+        REQUIRE(sink.str() == "-0.500000 -0.500000 1.000000 1.000000 rectfill\n"
+                              "-0.500000 -0.500000 1.000000 1.000000 rectfill\n");
+        sink.clear();
+        Circle(1).emit(sink);
+        REQUIRE(sink.str() == Circle(1).generate().str());
+    }
+
+    SECTION("Polygons With Sub-Pixel Sides Become Circles")
+    {
+        Polygon polygon(300, 0.5);
+        polygon.emit(sink);
+        REQUIRE(sink.str().find(" 0 360 arc stroke\n") != string::npos);
+        REQUIRE(sink.str().find(POLYGON_PROCEDURE) == string::npos);
+        sink.clear();
+        Polygon(12, 1.5).emit(sink);
+        REQUIRE(sink.str() == Polygon(12, 1.5).generate().str());
+    }
+
+    SECTION("Dense Skylines Are Decimated Under A Scale")
+    {
+        Skyline skyline(2000, 11u);
+        Scaled scaled(skyline, {0.01, 0.01});
+        scaled.emit(sink);
+        auto text = sink.str();
+        auto full = scaled.generate().str();
+        std::size_t lines = std::count(text.begin(), text.end(), '\n');
+        // A pixel is 100 units across inside the scale.
+        REQUIRE(lines < 2 * (skyline.get_width() / 100 + 2) + 10);
+        REQUIRE(text.size() * 4 < full.size());
+
+        // Wide enough for every building to show, nothing changes.
+        Skyline few(20, 11u);
+        sink.clear();
+        few.emit(sink);
+        REQUIRE(sink.str() == few.generate().str());
+    }
+
+    SECTION("Decimation Only Grows The Envelope")
+    {
+        auto heightAt = [](const vector<OutlinePoint> &outline, double x) {
+            auto height = 0.0;
+            for (const auto &point : outline)
+            {
+                if (point.x > x)
+                {
+                    break;
+                }
+                height = point.height;
+            }
+            return height;
+        };
+        // Narrow, overlapping buildings, several to a cell.
+        vector<Footprint> footprints;
+        for (auto i = 0; i < 100; ++i)
+        {
+            footprints.push_back({i * 1.1, 0.5 + (i % 4) * 0.8, 5.0 + (i * 37) % 23});
+        }
+        Buildings buildings(buildingsFromFootprints(footprints));
+        auto original = skylineOutline(buildings.columns());
+        auto decimated = decimateOutline(original, 10);
+        auto envelope = skylineEnvelope(buildings.columns(), skylineSize(buildings.columns()).first, 10);
+        REQUIRE(decimated.size() * 4 < original.size());
+        REQUIRE(envelope.size() * 4 < original.size());
+        for (auto x = 0.0; x < 115; x += 0.125)
+        {
+            REQUIRE(heightAt(decimated, x) >= heightAt(original, x));
+            REQUIRE(heightAt(envelope, x) >= heightAt(original, x));
+        }
+        REQUIRE(decimated.back().height == 0);
+        REQUIRE(decimated.back().x == original.back().x);
+        REQUIRE(envelope.back().height == 0);
+        REQUIRE(envelope.back().x >= original.back().x);
+    }
+}
+
 /*
 TEST_CASE("Scaled Shape")
 {
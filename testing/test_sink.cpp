@@ -0,0 +1,125 @@
+// test_sink.cpp
+//
+
+#include <clocale>
+#include <cstdio>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+using std::string;
+using std::vector;
+using std::make_unique;
+using std::move;
+
+#include "catch.hpp"
+#include "../cps/shape.hpp"
+#include "../cps/compoundshape.hpp"
+using namespace cps;
+
+TEST_CASE("Buffer Sink")
+{
+    BufferSink sink;
+
+    SECTION("Text And Numbers")
+    {
+        sink << "0 " << 1.5 << " translate" << '\n' << 42;
+        REQUIRE(sink.str() == "0 1.500000 translate\n42");
+    }
+
+    SECTION("Release Empties The Buffer")
+    {
+        sink << "gsave\n";
+        REQUIRE(sink.release() == "gsave\n");
+        REQUIRE(sink.str().empty());
+    }
+
+    SECTION("Matches generate()")
+    {
+        vector<Shape::Shape_ptr> shapes;
+        shapes.push_back(make_unique<Circle>(10));
+        shapes.push_back(make_unique<Rectangle>(10, 25));
+        HorizontalShapes horizontal(move(shapes));
+
+        horizontal.emit(sink);
+        REQUIRE(sink.str() == horizontal.generate().str());
+    }
+}
+
+TEST_CASE("Ostream Sink")
+{
+    std::ostringstream out;
+    OstreamSink sink(out);
+
+    Circle(1).emit(sink);
+    REQUIRE(out.str() == "0 0 1.000000 0 360 arc stroke\n");
+}
+
+TEST_CASE("File Descriptor Sink")
+{
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+
+    {
+        FileDescriptorSink sink(fds[1], 8);
+        sink << "short ";
+        sink << "a write larger than the buffer\n";
+        Circle(1).emit(sink);
+    }
+    close(fds[1]);
+
+    string output;
+    char buffer[64];
+    ssize_t count;
+    while ((count = read(fds[0], buffer, sizeof buffer)) > 0)
+    {
+        output.append(buffer, static_cast<size_t>(count));
+    }
+    close(fds[0]);
+
+    REQUIRE(output == "short a write larger than the buffer\n0 0 1.000000 0 360 arc stroke\n");
+}
+
+TEST_CASE("Number Formatting")
+{
+    char text[MAX_NUMBER_LENGTH];
+    auto format = [&](double value, NumberFormat numberFormat) {
+        return string(text, formatNumber(text, text + sizeof text, value, numberFormat));
+    };
+
+    SECTION("Fixed Matches std::to_string")
+    {
+        for (auto value : {0.0, -0.0, 1.0, -43.30127018922193, 10.9, 1e-7, 123456789.125, 1e300})
+        {
+            REQUIRE(format(value, NumberFormat::Fixed) == std::to_string(value));
+        }
+    }
+
+    SECTION("Shortest Round Trip")
+    {
+        REQUIRE(format(10.0, NumberFormat::Shortest) == "10");
+        REQUIRE(format(0.1, NumberFormat::Shortest) == "0.1");
+        REQUIRE(format(-43.30127018922193, NumberFormat::Shortest) == "-43.30127018922193");
+    }
+
+    SECTION("Sink Number Format")
+    {
+        BufferSink sink;
+        sink.set_numberFormat(NumberFormat::Shortest);
+        Circle(10).emit(sink);
+        REQUIRE(sink.str() == "0 0 10 0 360 arc stroke\n");
+    }
+
+    SECTION("Independent Of The C Locale")
+    {
+        auto previous = string(std::setlocale(LC_NUMERIC, nullptr));
+        if (std::setlocale(LC_NUMERIC, "de_DE.UTF-8") != nullptr)
+        {
+            BufferSink sink;
+            sink << 1.5;
+            std::setlocale(LC_NUMERIC, previous.c_str());
+            REQUIRE(sink.str() == "1.500000");
+        }
+    }
+}
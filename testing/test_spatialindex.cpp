@@ -0,0 +1,225 @@
+// test_spatialindex.cpp
+//
+
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+using std::string;
+using std::vector;
+using std::make_unique;
+using std::move;
+
+#include "catch.hpp"
+#include "../cps/shape.hpp"
+#include "../cps/compoundshape.hpp"
+#include "../cps/layout.hpp"
+#include "../cps/spatialindex.hpp"
+using namespace cps;
+
+namespace
+{
+    // Rows of circles and rectangles of varying sizes, with every row laid
+    // over a copy of itself shifted by a spacer so shapes overlap.
+    std::unique_ptr<VerticalShapes> scene(int rows, int columns, std::uint32_t seed)
+    {
+        std::mt19937 engine(seed);
+        std::uniform_real_distribution<> size(2, 20);
+        auto grid = make_unique<VerticalShapes>();
+        for (auto row = 0; row < rows; ++row)
+        {
+            auto line = make_unique<HorizontalShapes>();
+            for (auto column = 0; column < columns; ++column)
+            {
+                if (column % 3 == 0)
+                {
+                    line->pushShape(make_unique<Circle>(size(engine)));
+                }
+                else if (column % 3 == 1)
+                {
+                    line->pushShape(make_unique<Rectangle>(size(engine), size(engine)));
+                }
+                else
+                {
+                    line->pushShape(make_unique<Rotated>(make_unique<Rectangle>(size(engine), 4), 90));
+                }
+            }
+            auto layers = make_unique<LayeredShapes>();
+            layers->pushShape(make_unique<Spacer>(size(engine), 0));
+            layers->pushShape(move(line));
+            grid->pushShape(move(layers));
+        }
+        return grid;
+    }
+
+    vector<SpatialIndex::Item> bruteForce(const SpatialIndex &index, const BoundingBox &area)
+    {
+        vector<SpatialIndex::Item> found;
+        for (SpatialIndex::Item item = 0; item < index.get_numItems(); ++item)
+        {
+            if (index.get_bounds(item).intersects(area))
+            {
+                found.push_back(item);
+            }
+        }
+        return found;
+    }
+
+    vector<std::pair<SpatialIndex::Item, SpatialIndex::Item>> bruteForceOverlaps(const SpatialIndex &index)
+    {
+        vector<std::pair<SpatialIndex::Item, SpatialIndex::Item>> found;
+        for (SpatialIndex::Item a = 0; a < index.get_numItems(); ++a)
+        {
+            for (auto b = a + 1; b < index.get_numItems(); ++b)
+            {
+                auto first = index.get_bounds(a);
+                auto second = index.get_bounds(b);
+                if (first.left < second.right && second.left < first.right &&
+                    first.bottom < second.top && second.bottom < first.top)
+                {
+                    found.emplace_back(a, b);
+                }
+            }
+        }
+        return found;
+    }
+}
+
+TEST_CASE("Spatial Index")
+{
+    SECTION("Items Follow Compound Offsets")
+    {
+        vector<Shape::Shape_ptr> shapes;
+        shapes.push_back(make_unique<Circle>(10));
+        shapes.push_back(make_unique<Rectangle>(40, 10));
+        shapes.push_back(make_unique<Circle>(5));
+        HorizontalShapes horizontal(move(shapes));
+        SpatialIndex index{Layout(horizontal)};
+
+        REQUIRE(index.get_numItems() == 3);
+        REQUIRE(index.get_bounds(1).left == 10);
+        REQUIRE(index.get_bounds(1).right == 50);
+        REQUIRE(index.get_bounds().left == -10);
+        REQUIRE(index.get_bounds().right == 60);
+
+        REQUIRE(index.query(0, 0) == vector<SpatialIndex::Item>{0});
+        REQUIRE(index.query(30, 4) == vector<SpatialIndex::Item>{1});
+        REQUIRE(index.query(30, 6).empty());
+        REQUIRE(index.query(10, 0) == vector<SpatialIndex::Item>({0, 1}));
+        REQUIRE(index.query(BoundingBox{45, -1, 100, 1}) == vector<SpatialIndex::Item>({1, 2}));
+        // Neighbours touch but do not overlap.
+        REQUIRE(index.overlaps().empty());
+    }
+
+    SECTION("Rotations And Scales")
+    {
+        vector<Shape::Shape_ptr> shapes;
+        shapes.push_back(make_unique<Rectangle>(10, 20));
+        shapes.push_back(make_unique<Rectangle>(10, 20));
+        Rotated rotated(make_unique<VerticalShapes>(move(shapes)), 90);
+        SpatialIndex index{Layout(rotated)};
+
+        // The column lies along the negative x axis once turned.
+        REQUIRE(index.query(-20, 0) == vector<SpatialIndex::Item>{1});
+        REQUIRE(index.get_bounds(1).left == Approx(-30));
+        REQUIRE(index.get_bounds(1).right == Approx(-10));
+        REQUIRE(index.query(0, 20).empty());
+
+        Circle circle(5);
+        Scaled scaled(circle, {3, 1});
+        SpatialIndex stretched{Layout(scaled)};
+        REQUIRE(stretched.get_bounds(0).right == 15);
+        REQUIRE(stretched.query(12, 0).size() == 1);
+    }
+
+    SECTION("Layered Shapes Overlap")
+    {
+        vector<Shape::Shape_ptr> shapes;
+        shapes.push_back(make_unique<Circle>(10));
+        shapes.push_back(make_unique<Rectangle>(4, 4));
+        shapes.push_back(make_unique<Spacer>(30, 0));
+        shapes.push_back(make_unique<Circle>(10));
+        LayeredShapes layered(move(shapes));
+        SpatialIndex index{Layout(layered)};
+
+        REQUIRE(index.get_numItems() == 3);
+        REQUIRE(index.overlaps() == vector<std::pair<SpatialIndex::Item, SpatialIndex::Item>>{{0, 1}});
+    }
+
+    SECTION("Matches A Brute Force Search")
+    {
+        auto shapes = scene(30, 40, 1);
+        SpatialIndex index{Layout(*shapes)};
+        REQUIRE(index.get_numItems() == 1200);
+
+        std::mt19937 engine(2);
+        auto bounds = index.get_bounds();
+        std::uniform_real_distribution<> x(bounds.left, bounds.right);
+        std::uniform_real_distribution<> y(bounds.bottom, bounds.top);
+        for (auto i = 0; i < 200; ++i)
+        {
+            auto left = x(engine);
+            auto bottom = y(engine);
+            BoundingBox area{left, bottom, left + i, bottom + i / 2.0};
+            REQUIRE(index.query(area) == bruteForce(index, area));
+            REQUIRE(index.query(left, bottom) == bruteForce(index, {left, bottom, left, bottom}));
+        }
+        auto overlaps = index.overlaps();
+        REQUIRE_FALSE(overlaps.empty());
+        REQUIRE(overlaps == bruteForceOverlaps(index));
+    }
+
+    SECTION("Refitting After Changes")
+    {
+        auto shapes = scene(10, 20, 3);
+        auto row = make_unique<HorizontalShapes>();
+        auto circle = make_unique<Circle>(5);
+        auto grown = circle.get();
+        row->pushShape(make_unique<Rectangle>(10, 10));
+        row->pushShape(move(circle));
+        row->pushShape(make_unique<Rectangle>(10, 10));
+        shapes->pushShape(move(row));
+        SpatialIndex index{Layout(*shapes)};
+        auto last = index.get_numItems() - 1;
+        REQUIRE(index.get_bounds(last).right - index.get_bounds(last - 2).left == 30);
+
+        // Growing the circle pushes its right-hand neighbour along.
+        grown->set_width(50);
+        Layout layout(*shapes);
+        index.refit(layout);
+        SpatialIndex rebuilt(layout);
+        for (SpatialIndex::Item item = 0; item < index.get_numItems(); ++item)
+        {
+            REQUIRE(index.get_bounds(item).right == rebuilt.get_bounds(item).right);
+        }
+        REQUIRE(index.get_bounds(last).right - index.get_bounds(last - 2).left == 70);
+        REQUIRE(index.get_bounds().top == rebuilt.get_bounds().top);
+        REQUIRE(index.overlaps() == rebuilt.overlaps());
+        auto area = index.get_bounds(last - 1);
+        REQUIRE(index.query(area) == rebuilt.query(area));
+
+        // A single item can be moved anywhere.
+        index.refit(0, {1000, 1000, 1010, 1010});
+        REQUIRE(index.query(1005, 1005) == vector<SpatialIndex::Item>{0});
+        REQUIRE(index.get_bounds().right == 1010);
+        REQUIRE(index.query(rebuilt.get_bounds(0)) == bruteForce(index, rebuilt.get_bounds(0)));
+
+        // A scene with different leaves is indexed afresh.
+        shapes->pushShape(make_unique<Circle>(1));
+        index.refit(Layout(*shapes));
+        REQUIRE(index.get_numItems() == rebuilt.get_numItems() + 1);
+    }
+
+    SECTION("Empty Scenes")
+    {
+        // An empty compound is placed like a leaf, but marks nothing.
+        LayeredShapes empty;
+        SpatialIndex index{Layout(empty)};
+        REQUIRE(index.get_numItems() == 1);
+        REQUIRE(index.get_bounds(0).empty());
+        REQUIRE(index.get_bounds().empty());
+        REQUIRE(index.query(0, 0).empty());
+        REQUIRE(index.overlaps().empty());
+    }
+}
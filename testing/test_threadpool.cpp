@@ -0,0 +1,247 @@
+// test_threadpool.cpp
+//
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+using std::make_unique;
+using std::move;
+
+#include "catch.hpp"
+#include "../cps/threadpool.hpp"
+#include "../cps/shape.hpp"
+#include "../cps/compoundshape.hpp"
+using namespace cps;
+
+namespace
+{
+    // A column of alternating shapes, with a seeded skyline every few rows so
+    // runs of children take uneven amounts of work.
+    template<typename Compound>
+    std::unique_ptr<Compound> column(int rows, std::uint64_t seed)
+    {
+        auto compound = make_unique<Compound>();
+        for (auto row = 0; row < rows; ++row)
+        {
+            if (row % 7 == 0)
+            {
+                compound->pushShape(make_unique<Skyline>(row + 1, seed + row));
+            }
+            else if (row % 2 == 0)
+            {
+                compound->pushShape(make_unique<Rectangle>(row + 0.25, 10));
+            }
+            else
+            {
+                compound->pushShape(make_unique<Rotated>(make_unique<Triangle>(row / 3.0), 90));
+            }
+        }
+        return compound;
+    }
+
+    class Failing : public Shape
+    {
+    public:
+        void emit(Sink &) override
+        {
+            throw std::runtime_error("emit failed");
+        }
+    };
+}
+
+TEST_CASE("Thread Pool")
+{
+    ThreadPool pool(4);
+    REQUIRE(pool.get_numThreads() == 4);
+    REQUIRE_FALSE(ThreadPool::onWorkerThread());
+
+    SECTION("Runs Submitted Tasks")
+    {
+        std::atomic<int> total{0};
+        vector<std::future<int>> results;
+        for (auto i = 0; i < 100; ++i)
+        {
+            results.push_back(pool.submit([i, &total] {
+                total += i;
+                return i * 2;
+            }));
+        }
+        for (auto i = 0; i < 100; ++i)
+        {
+            REQUIRE(results[i].get() == i * 2);
+        }
+        REQUIRE(total == 4950);
+    }
+
+    SECTION("Tasks Know They Are On A Worker")
+    {
+        REQUIRE(pool.submit([] { return ThreadPool::onWorkerThread(); }).get());
+    }
+
+    SECTION("Waiting Tasks Help Instead Of Blocking")
+    {
+        ThreadPool single(1);
+        auto outer = single.submit([&single] {
+            auto inner = single.submit([] { return 21; });
+            return single.wait(inner) * 2;
+        });
+        REQUIRE(single.wait(outer) == 42);
+    }
+
+    SECTION("Exceptions Reach The Caller")
+    {
+        auto result = pool.submit([]() -> int { throw std::runtime_error("failed"); });
+        REQUIRE_THROWS_AS(result.get(), std::runtime_error);
+    }
+}
+
+TEST_CASE("Node Counts")
+{
+    auto shapes = column<HorizontalShapes>(3, 1);
+    // The compound, a one-building skyline, a rectangle and a rotated triangle.
+    REQUIRE(shapes->get_nodeCount() == 1 + 2 + 1 + 2);
+    shapes->pushShape(make_unique<Skyline>(10, 5u));
+    REQUIRE(shapes->get_nodeCount() == 6 + 11);
+    Circle circle(3);
+    REQUIRE(Scaled(circle, {2, 2}).get_nodeCount() == 2);
+}
+
+TEST_CASE("Parallel Compound Emission")
+{
+    ThreadPool pool(3);
+
+    SECTION("Horizontal Matches Sequential")
+    {
+        auto shapes = column<HorizontalShapes>(200, 1);
+        auto sequential = shapes->generate().str();
+        shapes->set_threadPool(&pool);
+        shapes->set_parallelGrain(16);
+        REQUIRE(shapes->get_threadPool() == &pool);
+        REQUIRE(shapes->get_parallelGrain() == 16);
+        REQUIRE(shapes->generate().str() == sequential);
+    }
+
+    SECTION("Vertical Matches Sequential")
+    {
+        auto shapes = column<VerticalShapes>(200, 2);
+        auto sequential = shapes->generate().str();
+        shapes->set_threadPool(&pool);
+        shapes->set_parallelGrain(16);
+        REQUIRE(shapes->generate().str() == sequential);
+    }
+
+    SECTION("Layered Matches Sequential")
+    {
+        auto shapes = column<LayeredShapes>(50, 3);
+        auto sequential = shapes->generate().str();
+        shapes->set_threadPool(&pool);
+        shapes->set_parallelGrain(16);
+        REQUIRE(shapes->generate().str() == sequential);
+    }
+
+    SECTION("Nested Pools Do Not Deadlock")
+    {
+        auto grid = make_unique<HorizontalShapes>();
+        for (auto i = 0; i < 20; ++i)
+        {
+            auto inner = column<VerticalShapes>(30, i);
+            inner->set_threadPool(&pool);
+            inner->set_parallelGrain(8);
+            grid->pushShape(move(inner));
+        }
+        grid->pushShape(make_unique<Rotated>(column<VerticalShapes>(10, 99), 180));
+        auto sequential = grid->generate().str();
+        grid->set_threadPool(&pool);
+        grid->set_parallelGrain(8);
+        REQUIRE(grid->generate().str() == sequential);
+    }
+
+    SECTION("Unbalanced Trees Split Their Big Branches")
+    {
+        // Each level holds one small leaf beside a branch with the rest of
+        // the tree; only the outermost compound has a pool.
+        Shape::Shape_ptr tree = column<VerticalShapes>(40, 7);
+        for (auto level = 0; level < 12; ++level)
+        {
+            auto next = make_unique<HorizontalShapes>();
+            next->pushShape(make_unique<Circle>(level + 1));
+            next->pushShape(move(tree));
+            next->pushShape(column<VerticalShapes>(level * 3 + 1, level));
+            tree = move(next);
+        }
+        auto sequential = tree->generate().str();
+
+        auto root = dynamic_cast<HorizontalShapes *>(tree.get());
+        REQUIRE(root->get_nodeCount() > 500);
+        root->set_threadPool(&pool);
+        root->set_parallelGrain(20);
+        REQUIRE(tree->generate().str() == sequential);
+
+        ThreadPool single(1);
+        root->set_threadPool(&single);
+        REQUIRE(tree->generate().str() == sequential);
+    }
+
+    SECTION("Fewer Children Than Workers")
+    {
+        auto shapes = column<HorizontalShapes>(2, 4);
+        auto sequential = shapes->generate().str();
+        shapes->set_threadPool(&pool);
+        REQUIRE(shapes->generate().str() == sequential);
+
+        HorizontalShapes empty;
+        empty.set_threadPool(&pool);
+        REQUIRE(empty.generate().str().empty());
+    }
+
+    SECTION("Number Format Carries Into Workers")
+    {
+        auto shapes = column<VerticalShapes>(40, 5);
+        shapes->set_parallelGrain(4);
+        BufferSink sequential;
+        sequential.set_numberFormat(NumberFormat::Shortest);
+        shapes->emit(sequential);
+        shapes->set_threadPool(&pool);
+        BufferSink parallel;
+        parallel.set_numberFormat(NumberFormat::Shortest);
+        shapes->emit(parallel);
+        REQUIRE(parallel.str() == sequential.str());
+    }
+
+    SECTION("Level Of Detail Carries Into Workers")
+    {
+        // Scaled shapes only refer to what they scale.
+        vector<std::unique_ptr<VerticalShapes>> originals;
+        auto shapes = make_unique<HorizontalShapes>();
+        for (auto i = 0; i < 30; ++i)
+        {
+            originals.push_back(column<VerticalShapes>(8, i));
+            shapes->pushShape(make_unique<Scaled>(*originals.back(), std::make_pair(0.05, 0.05)));
+        }
+        shapes->set_parallelGrain(4);
+        BufferSink sequential;
+        sequential.set_resolution(72);
+        shapes->emit(sequential);
+        shapes->set_threadPool(&pool);
+        BufferSink parallel;
+        parallel.set_resolution(72);
+        shapes->emit(parallel);
+        REQUIRE(parallel.str() == sequential.str());
+        REQUIRE(parallel.str().find("rectfill") != string::npos);
+    }
+
+    SECTION("A Failing Child Propagates")
+    {
+        auto shapes = column<HorizontalShapes>(100, 6);
+        shapes->pushShape(make_unique<Failing>());
+        shapes->set_threadPool(&pool);
+        shapes->set_parallelGrain(8);
+        BufferSink sink;
+        REQUIRE_THROWS_AS(shapes->emit(sink), std::runtime_error);
+    }
+}